@@ -0,0 +1,367 @@
+/*
+**
+** Multi-pattern substring matching with an Aho-Corasick automaton.
+**
+** All patterns are compiled once into a single deterministic
+** automaton, so a line is classified in one pass over its bytes, at
+** one table lookup per byte, however many patterns there are. Each
+** pattern carries flags, and a match reports the flags of every
+** pattern that ends at that position.
+**
+** create_ac_matcher  (ac_matcher_t *ac)
+** destroy_ac_matcher (ac_matcher_t *ac)
+** add_ac_pattern     (ac_matcher_t *ac, const char *bytes, size_t len,
+**                     int flags)
+** compile_ac_matcher (ac_matcher_t *ac)
+** ac_scan            (ac_matcher_t *ac, int *state, int *flags,
+**                     int stop_mask, const char *bytes, size_t len)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "candidate_scan.h"
+#include "ac_matcher.h"
+
+/* bytes walked between looks at the caller's stop_mask */
+#define AC_STOP_EVERY 256
+
+
+/**********************************************************************
+** create_ac_matcher ()
+**
+** Start an empty matcher. Until it is compiled, ac_scan() matches
+** nothing.
+*/
+void
+create_ac_matcher (ac_matcher_t *ac)
+{
+	memset (ac, 0, sizeof (*ac));
+}
+
+
+/**********************************************************************
+** destroy_ac_matcher ()
+*/
+void
+destroy_ac_matcher (ac_matcher_t *ac)
+{
+	int i;
+
+	if (ac == NULL) return;
+	for (i = 0; i < ac->npatterns; i++) free (ac->patterns[i].bytes);
+	free (ac->patterns);
+	free (ac->next);
+	memset (ac, 0, sizeof (*ac));
+}
+
+
+/**********************************************************************
+** add_ac_pattern ()
+**
+** Queue a copy of a pattern for compile_ac_matcher(), so the caller's
+** bytes need not outlive the matcher. Empty patterns are ignored.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc or realloc failure
+*/
+int
+add_ac_pattern (ac_matcher_t *ac, const char *bytes, size_t len, int flags)
+{
+	ac_pattern_t *grown;
+	char *copy;
+
+	if (len == 0) return 0;
+	if (ac->npatterns == ac->maxpatterns)
+	{
+		grown = realloc (ac->patterns,
+		 (ac->maxpatterns ? ac->maxpatterns * 2 : 8)
+		 * sizeof (ac_pattern_t));
+		if (grown == NULL) return errno;
+		ac->patterns = grown;
+		ac->maxpatterns = ac->maxpatterns ? ac->maxpatterns * 2 : 8;
+	}
+	if ((copy = malloc (len)) == NULL) return errno;
+	memcpy (copy, bytes, len);
+	ac->patterns[ac->npatterns].bytes = copy;
+	ac->patterns[ac->npatterns].len = len;
+	ac->patterns[ac->npatterns].flags = flags;
+	ac->npatterns++;
+	return 0;
+}
+
+
+/**********************************************************************
+** compile_ac_matcher ()
+**
+** Build the trie of all patterns, then fill in the missing
+** transitions from the failure links in breadth-first order, so that
+** scanning never has to follow a failure link at run time. Last, lay
+** the table out for ac_scan(): each state's flags in front of its
+** transitions, and every state as the offset of its row.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc failure
+*/
+int
+compile_ac_matcher (ac_matcher_t *ac)
+{
+	int i, c, s, t, f;
+	size_t j, maxstates;
+	int *trans = NULL;
+	int *out = NULL;
+	int *fail = NULL;
+	int *queue = NULL;
+	int head, tail;
+	int nc, row;
+
+	free (ac->next);
+	ac->next = NULL;
+
+	/* class 0 is every byte that occurs in no pattern, for now */
+	memset (ac->class_of, 0, sizeof (ac->class_of));
+	nc = 1;
+	maxstates = 1;
+	ac->maxlen = 0;
+	for (i = 0; i < ac->npatterns; i++)
+	{
+		if (ac->patterns[i].len > ac->maxlen)
+		{
+			ac->maxlen = ac->patterns[i].len;
+		}
+		for (j = 0; j < ac->patterns[i].len; j++)
+		{
+			c = (unsigned char)ac->patterns[i].bytes[j];
+			if (ac->class_of[c] == 0) ac->class_of[c] = nc++;
+		}
+		maxstates += ac->patterns[i].len;
+	}
+	ac->nclasses = nc;
+
+	init_candidate_set (&ac->skip);
+	for (i = 0; i < ac->npatterns; i++)
+	{
+		add_candidate_pair (&ac->skip, ac->patterns[i].bytes,
+		 ac->patterns[i].len);
+	}
+
+	trans = malloc (maxstates * nc * sizeof (int));
+	out = calloc (maxstates, sizeof (int));
+	fail = malloc (maxstates * sizeof (int));
+	queue = malloc (maxstates * sizeof (int));
+	if (trans == NULL || out == NULL || fail == NULL || queue == NULL)
+	{
+		free (trans);
+		free (out);
+		free (fail);
+		free (queue);
+		destroy_ac_matcher (ac);
+		return errno = ENOMEM;
+	}
+	for (j = 0; j < maxstates * nc; j++) trans[j] = -1;
+
+	/* the trie; state 0 is the root */
+	ac->nstates = 1;
+	for (i = 0; i < ac->npatterns; i++)
+	{
+		s = 0;
+		for (j = 0; j < ac->patterns[i].len; j++)
+		{
+			c = ac->class_of[(unsigned char)ac->patterns[i].bytes[j]];
+			if (trans[s * nc + c] == -1)
+			{
+				trans[s * nc + c] = ac->nstates++;
+			}
+			s = trans[s * nc + c];
+		}
+		out[s] |= ac->patterns[i].flags;
+	}
+
+	/* failure links, breadth first, turning the trie into a DFA */
+	head = tail = 0;
+	for (c = 0; c < nc; c++)
+	{
+		t = trans[c];
+		if (t == -1) trans[c] = 0;
+		else
+		{
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+	while (head < tail)
+	{
+		s = queue[head++];
+		f = fail[s];
+		out[s] |= out[f];
+		for (c = 0; c < nc; c++)
+		{
+			t = trans[s * nc + c];
+			if (t == -1) trans[s * nc + c] = trans[f * nc + c];
+			else
+			{
+				fail[t] = trans[f * nc + c];
+				queue[tail++] = t;
+			}
+		}
+	}
+	free (fail);
+	free (queue);
+
+	/* rows of flags and transitions, states numbered by row offset */
+	row = nc + 1;
+	ac->next = malloc ((size_t)ac->nstates * row * sizeof (int));
+	if (ac->next == NULL)
+	{
+		free (trans);
+		free (out);
+		destroy_ac_matcher (ac);
+		return errno = ENOMEM;
+	}
+	for (s = 0; s < ac->nstates; s++)
+	{
+		ac->next[s * row] = out[s];
+		for (c = 0; c < nc; c++)
+		{
+			ac->next[s * row + 1 + c] = trans[s * nc + c] * row;
+		}
+	}
+	for (c = 0; c < 256; c++) ac->class_of[c]++;
+	free (trans);
+	free (out);
+	return 0;
+}
+
+
+/**********************************************************************
+** ac_scan ()
+**
+** Run the automaton from *state over bytes, up to but not including
+** the first newline. The flags of every match are ORed into *flags.
+** Scanning also stops once *flags has a bit of stop_mask set, when
+** the caller does not need to see the rest of the line; it may go a
+** little past the byte that set it.
+**
+** The end of the line is found first, with memchr(), so the walk over
+** it need not test every byte for a newline. While the automaton is
+** at the root, no partial match is pending, so it jumps straight to
+** the next candidate start with find_candidate().
+**
+** Without a candidate set, the walk has no branch on what was seen,
+** and stop_mask is only looked at every AC_STOP_EVERY bytes. Each step
+** waits for the one before it, so the second half of the bytes is
+** walked at the same time as the first, from the root: the state
+** only ever depends on the last maxlen bytes, so starting maxlen - 1
+** bytes early, the second walk is in step by the time it gets to the
+** second half. Matches found along the way are real ones either way.
+**
+** Return value: the number of bytes consumed. If it is less than
+** len, bytes[returned] is either a newline or the caller's stop.
+*/
+size_t
+ac_scan (ac_matcher_t *ac, int *state, int *flags, int stop_mask,
+ const char *bytes, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)bytes;
+	const unsigned char *end, *stop, *mid, *q;
+	const unsigned char *class_of = ac->class_of;
+	const int *next = ac->next;
+	size_t back = ac->maxlen - 1;
+	int s = *state;
+	int f = *flags;
+	int t, g;
+
+	end = memchr (p, '\n', len);
+	if (end == NULL) end = p + len;
+	if (next == NULL) /* nothing compiled */
+	{
+		return (const char *)end - bytes;
+	}
+	if (ac->skip.npairs > 0)
+	{
+		while (p < end)
+		{
+			if (s == 0)
+			{
+				/* on past the line if need be, for the wider blocks */
+				p += find_candidate (&ac->skip, (const char *)p,
+				 bytes + len - (const char *)p, 1);
+				if (p >= end) break;
+			}
+			s = next[s + class_of[*p++]];
+			f |= next[s];
+			if (f & stop_mask) break;
+		}
+		if (p > end) p = end;
+	} else {
+		while (p < end && !(f & stop_mask))
+		{
+			stop = end - p > AC_STOP_EVERY ? p + AC_STOP_EVERY : end;
+			mid = p + (stop - p) / 2;
+			if ((size_t)(mid - p) <= back)
+			{
+				while (p < stop)
+				{
+					s = next[s + class_of[*p++]];
+					f |= next[s];
+				}
+				continue;
+			}
+			q = mid - back;
+			t = 0;
+			g = 0;
+			while (p < mid)
+			{
+				s = next[s + class_of[*p++]];
+				f |= next[s];
+				t = next[t + class_of[*q++]];
+				g |= next[t];
+			}
+			while (q < stop)
+			{
+				t = next[t + class_of[*q++]];
+				g |= next[t];
+			}
+			p = stop;
+			s = t;
+			f |= g;
+		}
+	}
+	*state = s;
+	*flags = f;
+	return (const char *)p - bytes;
+}
@@ -0,0 +1,80 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _AC_MATCHER_H_ /* Brackets this whole file */
+#define _AC_MATCHER_H_
+
+#include <stddef.h>
+#include "candidate_scan.h"
+
+typedef struct
+ac_pattern_struct
+{
+	char *bytes;        /* a copy, owned by the matcher */
+	size_t len;
+	int flags;          /* reported when this pattern matches */
+}
+ac_pattern_t;
+
+/*
+** An Aho-Corasick automaton compiled to a full transition table.
+** Bytes that occur in no pattern share one input class, so the table
+** has one row of 1 + nclasses entries per state rather than 256. A
+** row holds the flags of every pattern ending in its state, then the
+** transitions; classes are numbered from 1. A state is the offset of
+** its row, the root 0, so a step is next[state + class_of[byte]] and
+** its flags are next[state].
+*/
+typedef struct
+ac_matcher_struct
+{
+	ac_pattern_t *patterns;
+	int npatterns;
+	int maxpatterns;
+	unsigned char class_of[256];
+	int nclasses;
+	int nstates;
+	size_t maxlen;          /* of the longest pattern */
+	int *next;              /* nstates rows of flags and transitions */
+	candidate_set_t skip;   /* where a match can start from the root */
+}
+ac_matcher_t;
+
+extern void create_ac_matcher (ac_matcher_t*);
+extern void destroy_ac_matcher (ac_matcher_t*);
+extern int add_ac_pattern (ac_matcher_t*, const char*, size_t, int);
+extern int compile_ac_matcher (ac_matcher_t*);
+extern size_t ac_scan (ac_matcher_t*, int*, int*, int, const char*, size_t);
+
+#endif /* _AC_MATCHER_H_ Brackets this whole file */
@@ -1,19 +1,30 @@
 /*
 **
-** An appendable, resizable character buffer.
+** An appendable, growable ring buffer of characters.
 ** 
 ** KPF - 2014-07-26
+** 2026-10-17 - reworked as a ring buffer with separate read and
+**              write cursors, so partially written data stays in
+**              place and the steady state never reallocates
 ** 
-** create_char_buffer         (char_buffer_t *bufptr, size_t size)
-** destroy_char_buffer        (char_buffer_t *bufptr)
-** resize_char_buffer         (char_buffer_t *bufptr, long  sizedelta)
-** append_to_char_buffer      (char_buffer_t *bufptr, char *message)
-** read_fd_into_char_buffer   (char_buffer_t *bufptr, int fd)
-** clear_char_buffer          (char_buffer_t *bufptr, size_t resize_to)
-** get_char_buffer_size       (char_buffer_t *bufptr)
-** get_char_buffer_space      (char_buffer_t *bufptr)
-** get_char_buffer_contlen    (char_buffer_t *bufptr)
-** get_char_buffer_read_ptr   (char_buffer_t *bufptr)
+** create_char_buffer          (char_buffer_t *bufptr, size_t size)
+** destroy_char_buffer         (char_buffer_t *bufptr)
+** resize_char_buffer          (char_buffer_t *bufptr, long  sizedelta)
+** append_to_char_buffer       (char_buffer_t *bufptr, char *message)
+** append_bytes_to_char_buffer (char_buffer_t *bufptr, const char *bytes,
+**                              size_t len)
+** read_fd_into_char_buffer    (char_buffer_t *bufptr, int fd)
+** write_char_buffer_to_fd     (char_buffer_t *bufptr, int fd)
+** consume_char_buffer         (char_buffer_t *bufptr, size_t n)
+** commit_char_buffer          (char_buffer_t *bufptr, size_t n)
+** clear_char_buffer           (char_buffer_t *bufptr, size_t resize_to)
+** get_char_buffer_size        (char_buffer_t *bufptr)
+** get_char_buffer_space       (char_buffer_t *bufptr)
+** get_char_buffer_contlen     (char_buffer_t *bufptr)
+** get_char_buffer_read_span   (char_buffer_t *bufptr, size_t *len)
+** get_char_buffer_write_span  (char_buffer_t *bufptr, size_t *len)
+** get_char_buffer_span_at     (char_buffer_t *bufptr, size_t pos,
+**                              size_t *len)
 **
 ** Copyright (c) 2016, Kris Feldmann
 ** All rights reserved.
@@ -55,17 +66,32 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
 //#include <malloc/malloc.h>
 #include <malloc.h>
 #include "buffer.h"
 
 
+/**********************************************************************
+** round_up_pow2 ()
+** 
+** Return the smallest power of two that is >= n (minimum 1).
+*/
+static size_t
+round_up_pow2 (size_t n)
+{
+	size_t p = 1;
+	while (p < n) p <<= 1;
+	return p;
+}
+
+
 /**********************************************************************
 ** create_char_buffer ()
 ** 
-** The parameter nullobj is a pointer to a null version of whatever
-** type will be stored in the buffer. For example, for a character
-** buffer, set nullobj to point to '\0'. For an int, use 0, etc.
+** Allocate the buffer memory. The requested size is rounded up to
+** the next power of two. The buffer struct must not already hold
+** memory (use destroy_char_buffer() first).
 ** 
 ** Return values:
 **   0  success
@@ -81,15 +107,15 @@ create_char_buffer (char_buffer_t *bufptr, size_t size)
 		status = errno = EFAULT;
 		goto end;
 	}
-	if (bufptr->memory != NULL) free (bufptr->memory);
+	size = round_up_pow2 (size);
 	bufptr->memory = (char *)malloc (size);
 	if (bufptr->memory == NULL) status = errno;
 	else
 	{
-		*(bufptr->memory) = '\0';
-		bufptr->ptr = bufptr->memory;
 		bufptr->size = size;
-		bufptr->space_remaining = size;
+		bufptr->mask = size - 1;
+		bufptr->read_pos = 0;
+		bufptr->write_pos = 0;
 	}
 end:
 	return status;
@@ -107,6 +133,7 @@ destroy_char_buffer (char_buffer_t *bufptr)
 		if (bufptr->memory != NULL)
 		{
 			free (bufptr->memory);
+			bufptr->memory = NULL;
 		}
 	}
 }
@@ -116,9 +143,12 @@ destroy_char_buffer (char_buffer_t *bufptr)
 ** resize_char_buffer ()
 **
 ** Resize a buffer by sizedelta units. Use a negative sizedelta value
-** to shrink the buffer. If shrinking, the value of sizedelta and
-** space_remaining are compared. If data would be lost, the return
-** value will be set to -1 and no change will be made.
+** to shrink the buffer. The new size is rounded up to a power of two.
+** If shrinking would leave less room than the unconsumed content,
+** the return value will be set to -1 and no change will be made.
+**
+** The cursors are left untouched, so absolute positions held by
+** callers (see get_char_buffer_span_at()) remain valid.
 ** 
 ** Return values:
 **  -1  requested shrink would cause data loss
@@ -129,112 +159,204 @@ int
 resize_char_buffer (char_buffer_t *bufptr, long sizedelta)
 {
 	int status = 0;
-	size_t newsize;
-	size_t offset;
+	size_t newsize, newmask;
+	size_t pos, len, offset;
+	char *span;
+	char *newmem;
 
 	if (!sizedelta) goto end;
-	if (sizedelta < 0)
+	if ((long)(bufptr->size) + sizedelta
+	 < (long)get_char_buffer_contlen (bufptr))
 	{
-		/* we can only shrink remaining space, not used space */
-		if ((long)(bufptr->space_remaining) + sizedelta < 0)
-		{
-			status = -1;
-			goto end;
-		}
+		status = -1;
+		goto end;
 	}
-	newsize = (size_t)((long)(bufptr->size) + sizedelta);
-	offset = bufptr->ptr - bufptr->memory;
+	newsize = round_up_pow2 ((size_t)((long)(bufptr->size) + sizedelta));
+	if (newsize == bufptr->size) goto end;
+	newmask = newsize - 1;
 
-	bufptr->memory = (char *)realloc (bufptr->memory, newsize);
-	if (bufptr->memory == NULL) status = errno;
-	else
+	newmem = (char *)malloc (newsize);
+	if (newmem == NULL)
+	{
+		status = errno;
+		goto end;
+	}
+	/* copy the content to the same positions under the new mask */
+	pos = bufptr->read_pos;
+	while (pos < bufptr->write_pos)
 	{
-		bufptr->size = newsize;
-		bufptr->space_remaining += sizedelta;
-		bufptr->ptr = bufptr->memory + offset;
+		span = get_char_buffer_span_at (bufptr, pos, &len);
+		offset = pos & newmask;
+		if (len > newsize - offset) len = newsize - offset;
+		memcpy (newmem + offset, span, len);
+		pos += len;
 	}
+
+	free (bufptr->memory);
+	bufptr->memory = newmem;
+	bufptr->size = newsize;
+	bufptr->mask = newmask;
 end:
 	return status;
 }
 
 
 /**********************************************************************
-** append_to_char_buffer ()
+** append_bytes_to_char_buffer ()
+** 
+** Copy len bytes into the buffer, wrapping as needed.
 ** 
 ** Return values:
 **   0        success
 **   ENOBUFS  not enough space remaining in the buffer
 */
 int
-append_to_char_buffer (char_buffer_t *bufptr, char *message)
+append_bytes_to_char_buffer (char_buffer_t *bufptr, const char *bytes,
+ size_t len)
 {
-	int status = 0;
-	int slen = strlen (message);
+	char *span;
+	size_t spanlen;
 
-	if (slen > bufptr->space_remaining)
+	if (len > get_char_buffer_space (bufptr))
 	{
-		status = errno = ENOBUFS;
-	} else {
-		bufptr->ptr = stpcpy (bufptr->ptr, message);
-		bufptr->space_remaining -= slen;
+		return errno = ENOBUFS;
 	}
-	return status;
+	while (len > 0)
+	{
+		span = get_char_buffer_write_span (bufptr, &spanlen);
+		if (spanlen > len) spanlen = len;
+		memcpy (span, bytes, spanlen);
+		commit_char_buffer (bufptr, spanlen);
+		bytes += spanlen;
+		len -= spanlen;
+	}
+	return 0;
 }
 
 
 /**********************************************************************
-** read_fd_into_char_buffer ()
+** append_to_char_buffer ()
 ** 
 ** Return values:
-**   0   success
-**   *   errno from read()
+**   0        success
+**   ENOBUFS  not enough space remaining in the buffer
 */
 int
+append_to_char_buffer (char_buffer_t *bufptr, char *message)
+{
+	return append_bytes_to_char_buffer (bufptr, message, strlen (message));
+}
+
+
+/**********************************************************************
+** read_fd_into_char_buffer ()
+** 
+** Fill as much of the free space as one readv() allows, including
+** the wrapped part at the start of memory.
+** 
+** Return values:
+**   >0  number of bytes read
+**    0  end of file, or no space left in the buffer
+**   -1  readv() failed; errno is set
+*/
+ssize_t
 read_fd_into_char_buffer (char_buffer_t *bufptr, int fd)
 {
-	int status = 0;
-	int readbytes;
-	readbytes = read (fd, bufptr->ptr, bufptr->space_remaining);
-	if (readbytes > 0)
-	{
-		bufptr->space_remaining -= readbytes;
-		bufptr->ptr += readbytes;
-		*(bufptr->ptr) = '\0';
-	} else if (readbytes == -1) status = errno;
-	return status;
+	ssize_t readbytes;
+	struct iovec iov[2];
+	size_t space = get_char_buffer_space (bufptr);
+
+	if (space == 0) return 0;
+	iov[0].iov_base = get_char_buffer_write_span (bufptr, &iov[0].iov_len);
+	iov[1].iov_base = bufptr->memory;
+	iov[1].iov_len = space - iov[0].iov_len;
+
+	readbytes = readv (fd, iov, iov[1].iov_len ? 2 : 1);
+	if (readbytes > 0) commit_char_buffer (bufptr, readbytes);
+	return readbytes;
+}
+
+
+/**********************************************************************
+** write_char_buffer_to_fd ()
+** 
+** Write as much of the content as one writev() accepts, and consume
+** only what was actually written. Whatever the fd did not take stays
+** in place for the next call.
+** 
+** Return values:
+**  >=0  number of bytes written and consumed
+**   -1  writev() failed; errno is set
+*/
+ssize_t
+write_char_buffer_to_fd (char_buffer_t *bufptr, int fd)
+{
+	ssize_t byteswritten;
+	struct iovec iov[2];
+	size_t contlen = get_char_buffer_contlen (bufptr);
+
+	if (contlen == 0) return 0;
+	iov[0].iov_base = get_char_buffer_read_span (bufptr, &iov[0].iov_len);
+	iov[1].iov_base = bufptr->memory;
+	iov[1].iov_len = contlen - iov[0].iov_len;
+
+	byteswritten = writev (fd, iov, iov[1].iov_len ? 2 : 1);
+	if (byteswritten > 0) consume_char_buffer (bufptr, byteswritten);
+	return byteswritten;
+}
+
+
+/**********************************************************************
+** consume_char_buffer ()
+** 
+** Advance the read cursor by n bytes (at most the content length).
+*/
+void
+consume_char_buffer (char_buffer_t *bufptr, size_t n)
+{
+	size_t contlen = get_char_buffer_contlen (bufptr);
+	if (n > contlen) n = contlen;
+	bufptr->read_pos += n;
+}
+
+
+/**********************************************************************
+** commit_char_buffer ()
+** 
+** Advance the write cursor by n bytes after the caller has filled
+** the span returned by get_char_buffer_write_span().
+*/
+void
+commit_char_buffer (char_buffer_t *bufptr, size_t n)
+{
+	size_t space = get_char_buffer_space (bufptr);
+	if (n > space) n = space;
+	bufptr->write_pos += n;
 }
 
 
 /**********************************************************************
 ** clear_char_buffer ()
 ** 
-** If resize_to is not 0, the buffer will be resized to resize_to
-** bytes after clearing.
+** Discard all content. If resize_to is not 0, the buffer will be
+** resized to resize_to bytes (rounded up to a power of two) after
+** clearing.
 ** 
 ** Return values:
 **   0  success
-**   *  errno from realloc failure
+**   *  errno from malloc failure
 */
 int
 clear_char_buffer (char_buffer_t *bufptr, size_t resize_to)
 {
 	int status = 0;
 
-	if (resize_to > 0 && resize_to != bufptr->size)
+	bufptr->read_pos = bufptr->write_pos;
+	if (resize_to > 0)
 	{
-		bufptr->memory = (char *)realloc (bufptr->memory, resize_to);
-		if (bufptr->memory == NULL)
-		{
-			status = errno;
-			goto end;
-		} else {
-			bufptr->size = resize_to;
-		}
+		status = resize_char_buffer (bufptr,
+		 (long)round_up_pow2 (resize_to) - (long)bufptr->size);
 	}
-	*(bufptr->memory) = '\0';
-	bufptr->ptr = bufptr->memory;
-	bufptr->space_remaining = bufptr->size;
-end:
 	return status;
 }
 
@@ -255,7 +377,7 @@ get_char_buffer_size (char_buffer_t *bufptr)
 size_t
 get_char_buffer_space (char_buffer_t *bufptr)
 {
-	return bufptr->space_remaining;
+	return bufptr->size - get_char_buffer_contlen (bufptr);
 }
 
 
@@ -265,19 +387,63 @@ get_char_buffer_space (char_buffer_t *bufptr)
 size_t
 get_char_buffer_contlen (char_buffer_t *bufptr)
 {
-	return bufptr->size - bufptr->space_remaining;
+	return bufptr->write_pos - bufptr->read_pos;
 }
 
 
 /**********************************************************************
-** get_char_buffer_read_ptr ()
+** get_char_buffer_span_at ()
+** 
+** Return a pointer to the content at absolute position pos
+** (read_pos <= pos <= write_pos), and store in *len how many bytes
+** from there are contiguous in memory. *len is 0 if pos is at or
+** beyond the write cursor.
 */
 char *
-get_char_buffer_read_ptr (char_buffer_t *bufptr)
+get_char_buffer_span_at (char_buffer_t *bufptr, size_t pos, size_t *len)
 {
-	return bufptr->memory;
+	size_t offset;
+	size_t avail;
+
+	if (pos < bufptr->read_pos) pos = bufptr->read_pos;
+	offset = pos & bufptr->mask;
+	avail = (pos < bufptr->write_pos) ? bufptr->write_pos - pos : 0;
+	*len = bufptr->size - offset;
+	if (*len > avail) *len = avail;
+	return bufptr->memory + offset;
 }
 
 
-// #endif /* _BUFFER_C_ Brackets this whole file */
+/**********************************************************************
+** get_char_buffer_read_span ()
+** 
+** Return a pointer to the oldest unconsumed byte, and store in *len
+** the number of bytes readable from there without wrapping.
+*/
+char *
+get_char_buffer_read_span (char_buffer_t *bufptr, size_t *len)
+{
+	return get_char_buffer_span_at (bufptr, bufptr->read_pos, len);
+}
+
+
+/**********************************************************************
+** get_char_buffer_write_span ()
+** 
+** Return a pointer to the first free byte, and store in *len the
+** number of bytes writable from there without wrapping. Call
+** commit_char_buffer() after filling it.
+*/
+char *
+get_char_buffer_write_span (char_buffer_t *bufptr, size_t *len)
+{
+	size_t offset = bufptr->write_pos & bufptr->mask;
+	size_t space = get_char_buffer_space (bufptr);
+
+	*len = bufptr->size - offset;
+	if (*len > space) *len = space;
+	return bufptr->memory + offset;
+}
+
 
+// #endif /* _BUFFER_C_ Brackets this whole file */
@@ -35,13 +35,22 @@
 #ifndef _BUFFER_H_ /* Brackets this whole file */
 #define _BUFFER_H_
 
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+** read_pos and write_pos are running totals of the bytes consumed
+** from and appended to the buffer. They are never wrapped; the
+** offset into memory is always (pos & mask).
+*/
 typedef struct
 char_buffer_struct
 {
 	char *memory;
-	size_t size;
-	size_t space_remaining;
-	char *ptr; /* append pointer */
+	size_t size; /* always a power of two */
+	size_t mask; /* size - 1 */
+	size_t read_pos;
+	size_t write_pos;
 }
 char_buffer_t;
 
@@ -49,12 +58,17 @@ extern int create_char_buffer (char_buffer_t*, size_t);
 extern void destroy_char_buffer (char_buffer_t*);
 extern int resize_char_buffer (char_buffer_t*, long);
 extern int append_to_char_buffer (char_buffer_t*, char*);
-extern int read_fd_into_char_buffer (char_buffer_t*, int);
+extern int append_bytes_to_char_buffer (char_buffer_t*, const char*, size_t);
+extern ssize_t read_fd_into_char_buffer (char_buffer_t*, int);
+extern ssize_t write_char_buffer_to_fd (char_buffer_t*, int);
+extern void consume_char_buffer (char_buffer_t*, size_t);
+extern void commit_char_buffer (char_buffer_t*, size_t);
 extern int clear_char_buffer (char_buffer_t*, size_t);
 extern size_t get_char_buffer_size (char_buffer_t*);
 extern size_t get_char_buffer_space (char_buffer_t*);
 extern size_t get_char_buffer_contlen (char_buffer_t*);
-extern char * get_char_buffer_read_ptr (char_buffer_t*);
+extern char * get_char_buffer_read_span (char_buffer_t*, size_t*);
+extern char * get_char_buffer_write_span (char_buffer_t*, size_t*);
+extern char * get_char_buffer_span_at (char_buffer_t*, size_t, size_t*);
 
 #endif /* _BUFFER_H_ Brackets this whole file */
-
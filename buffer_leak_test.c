@@ -38,19 +38,39 @@
 #include "buffer.h"
 
 
+/*
+** The ring content may wrap, so print it span by span.
+*/
+static void
+print_contents (char_buffer_t *buf)
+{
+	char *span;
+	size_t len;
+	size_t pos = buf->read_pos;
+
+	printf ("Buffer contains: ");
+	while ((span = get_char_buffer_span_at (buf, pos, &len)), len > 0)
+	{
+		printf ("%.*s", (int)len, span);
+		pos += len;
+	}
+	printf ("\n");
+}
+
+
 int
 main ()
 {
 	int status;
 	char_buffer_t *buf
-	 = malloc (sizeof (char_buffer_t));
+	 = calloc (1, sizeof (char_buffer_t));
 
 	printf ("==== #010 Creating buffer with size=1024 ====\n");
 	if (create_char_buffer (buf, 1024) != 0)
 	{ err (errno, "ERROR: create_char_buffer"); }
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-	printf ("Space remaining: %zu\n", buf->space_remaining);
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+	print_contents (buf);
 	printf ("\n");
 	
 	while (1)
@@ -59,8 +79,8 @@ main ()
 		if (append_to_char_buffer (buf, "Hello world.") != 0)
 		{ err (errno, "ERROR: append_to_char_buffer"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	
 		printf ("==== #070 Resizing buffer DOWN by 512 ====\n");
@@ -70,16 +90,16 @@ main ()
 		if (status == -1)
 		{ printf ("ABORT: resize would lose data (UNexpected).\n"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	
 		printf ("==== #080 Appending ' Here is yet another sentance.' to buffer  ====\n");
 		if (append_to_char_buffer (buf, " Here is yet another sentance.") != 0)
 		{ err (errno, "ERROR: append_to_char_buffer"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	
 		printf ("==== #090 Resizing buffer UP by 8192 ====\n");
@@ -89,24 +109,24 @@ main ()
 		if (status == -1)
 		{ printf ("ABORT: resize would lose data (UNexpected).\n"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	
 		printf ("==== #100 Appending ' Doodle.' to buffer  ====\n");
 		if (append_to_char_buffer (buf, " Doodle.") != 0)
 		{ err (errno, "ERROR: append_to_char_buffer"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	
 		printf ("==== #110 Clearing the buffer WITH resize to 1024 ====\n");
 		if (clear_char_buffer (buf, 1024) != 0)
 		{ err (errno, "ERROR: clear_char_buffer"); }
 		printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
-		printf ("Space remaining: %zu\n", buf->space_remaining);
-		printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+		printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+		print_contents (buf);
 		printf ("\n");
 	}
 	return 0;
@@ -39,12 +39,32 @@
 #include "buffer.h"
 
 
+/*
+** The ring content may wrap, so print it span by span.
+*/
+static void
+print_contents (char_buffer_t *buf)
+{
+	char *span;
+	size_t len;
+	size_t pos = buf->read_pos;
+
+	printf ("Buffer contains: ");
+	while ((span = get_char_buffer_span_at (buf, pos, &len)), len > 0)
+	{
+		printf ("%.*s", (int)len, span);
+		pos += len;
+	}
+	printf ("\n");
+}
+
+
 int
 main ()
 {
 	int status;
 	char_buffer_t *buf
-	 = malloc (sizeof (char_buffer_t));
+	 = calloc (1, sizeof (char_buffer_t));
 	/* printf ("DEBUG: addr of *buf = %p\n", buf); */
 
 	printf ("==== #010 Creating buffer with size=1024 ====\n");
@@ -53,7 +73,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 	
 	printf ("==== #020 Appending 'Hello world.' to buffer  ====\n");
@@ -62,7 +82,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #030 Appending ' Here is another sentance.' to buffer  ====\n");
@@ -71,7 +91,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #040 Clearing the buffer without resizing ====\n");
@@ -80,7 +100,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #050 Appending 'Hello foobar.' to buffer  ====\n");
@@ -89,7 +109,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #060 Resizing buffer DOWN by 2048 ====\n");
@@ -101,7 +121,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #070 Resizing buffer DOWN by 768 ====\n");
@@ -113,7 +133,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #080 Resizing buffer UP by 2048 ====\n");
@@ -125,7 +145,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #090 Appending ' Here is yet another sentance.' to buffer  ====\n");
@@ -134,7 +154,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #100 Appending ' Doodle.' to buffer  ====\n");
@@ -143,7 +163,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #110 Clearing the buffer WITH resize to 32 ====\n");
@@ -152,7 +172,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #120 Appending 'Start filling the buffer.' to buffer  ====\n");
@@ -161,7 +181,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #130 Appending ' Try to overfill the buffer.' to buffer  ====\n");
@@ -170,7 +190,7 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #140 Appending ' asdfgh' to buffer  ====\n");
@@ -179,7 +199,45 @@ main ()
 	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
 	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
 	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
-	printf ("Buffer contains: %s\n", get_char_buffer_read_ptr (buf));
+	print_contents (buf);
+	printf ("\n");
+
+	printf ("==== #142 Consuming 6 bytes ('Start ') from the buffer ====\n");
+	consume_char_buffer (buf, 6);
+	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
+	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
+	print_contents (buf);
+	printf ("\n");
+
+	printf ("==== #144 Appending ' WRAP' to buffer (wraps around the end) ====\n");
+	if (append_to_char_buffer (buf, " WRAP") != 0)
+	{ err (errno, "ERROR: append_to_char_buffer"); }
+	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
+	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
+	print_contents (buf);
+	printf ("\n");
+
+	printf ("==== #146 Resizing wrapped buffer UP by 32 ====\n");
+	status = resize_char_buffer (buf, 32);
+	if (status != 0)
+	{ err (errno, "ERROR: resize_char_buffer"); }
+	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
+	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
+	print_contents (buf);
+	printf ("\n");
+
+	printf ("==== #148 Writing buffer to stdout, then newline ====\n");
+	fflush (stdout);
+	if (write_char_buffer_to_fd (buf, 1) == -1)
+	{ err (errno, "ERROR: write_char_buffer_to_fd"); }
+	printf ("\n");
+	printf ("Size of buffer: %zu\n", get_char_buffer_size (buf));
+	printf ("Space remaining: %zu\n", get_char_buffer_space (buf));
+	printf ("Content length: %zu\n", get_char_buffer_contlen (buf));
+	print_contents (buf);
 	printf ("\n");
 
 	printf ("==== #150 Destroying the buffer ====\n");
@@ -198,6 +256,9 @@ main ()
 // resize_char_buffer       (char_buffer_t *bufptr, size_t sizedelta) UP
 // clear_char_buffer        (char_buffer_t *bufptr, size_t resize_to) w/ resize
 // get_char_buffer_space    (char_buffer_t *bufptr)
+// consume_char_buffer      (char_buffer_t *bufptr, size_t n)
+// resize_char_buffer       (char_buffer_t *bufptr, long sizedelta) wrapped
+// write_char_buffer_to_fd  (char_buffer_t *bufptr, int fd)
 // get_char_buffer_contlen  (char_buffer_t *bufptr)
 // destroy_char_buffer      (char_buffer_t *bufptr)
 
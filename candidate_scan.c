@@ -0,0 +1,354 @@
+/*
+**
+** Vectorized search for newlines and filter candidates.
+**
+** A candidate is a position where some filter could start: its first
+** byte is there and its last byte is where it should be. Skipping
+** everything that is neither a newline nor a candidate lets the
+** matcher jump over most of a log line 16 or 32 bytes at a time. The
+** SSE2 and AVX2 kernels are picked at run time from what the CPU
+** supports; the scalar kernel is the reference and the fallback.
+**
+** init_candidate_set (candidate_set_t *set)
+** add_candidate_pair (candidate_set_t *set, const char *bytes,
+**                     size_t len)
+** find_candidate     (const candidate_set_t *set, const char *bytes,
+**                     size_t len, int newline)
+** select_scan_kernel (int kernel)
+** scan_kernel_name   ()
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string.h>
+#include <errno.h>
+#include "candidate_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+typedef size_t (*scan_kernel_t) (const candidate_set_t*, const char*,
+ size_t, int);
+
+typedef struct
+{
+	scan_kernel_t find;
+	const char *name;
+}
+scan_kernel_info_t;
+
+static size_t find_candidate_auto (const candidate_set_t*, const char*,
+ size_t, int);
+
+static const scan_kernel_info_t auto_kernel = { find_candidate_auto, "auto" };
+
+/*
+** The I/O threads all scan with this, so the kernel and its name are
+** swapped in together, as one atomic pointer.
+*/
+static const scan_kernel_info_t *scan_kernel = &auto_kernel;
+
+
+/**********************************************************************
+** init_candidate_set ()
+*/
+void
+init_candidate_set (candidate_set_t *set)
+{
+	memset (set, 0, sizeof (*set));
+}
+
+
+/**********************************************************************
+** add_candidate_pair ()
+**
+** Add the first and last byte of a pattern. Once there are more than
+** SCAN_PAIRS_MAX different pairs, the set is given up (npairs is -1)
+** and the caller should not skip ahead with it.
+**
+** Return values:
+**   0       success
+**   ENOSPC  too many pairs
+*/
+int
+add_candidate_pair (candidate_set_t *set, const char *bytes, size_t len)
+{
+	scan_pair_t pair;
+	int k;
+
+	if (set->npairs < 0) return ENOSPC;
+	if (len == 0) return 0;
+	pair.first = (unsigned char)bytes[0];
+	pair.last = (unsigned char)bytes[len - 1];
+	pair.span = len - 1;
+	for (k = 0; k < set->npairs; k++)
+	{
+		if (set->pairs[k].first == pair.first
+		 && set->pairs[k].last == pair.last
+		 && set->pairs[k].span == pair.span) return 0;
+	}
+	if (set->npairs == SCAN_PAIRS_MAX)
+	{
+		set->npairs = -1;
+		return ENOSPC;
+	}
+	set->pairs[set->npairs++] = pair;
+	set->is_first[pair.first] = 1;
+	if (pair.span > set->max_span) set->max_span = pair.span;
+	return 0;
+}
+
+
+/**********************************************************************
+** find_candidate_scalar ()
+**
+** Near the end of the bytes, where a last byte would fall beyond len,
+** the first byte alone makes a candidate; the pattern may finish in
+** the next read.
+*/
+static size_t
+find_candidate_scalar (const candidate_set_t *set, const char *bytes,
+ size_t len, int newline)
+{
+	const unsigned char *p = (const unsigned char *)bytes;
+	const scan_pair_t *pair;
+	size_t i;
+	int k;
+
+	for (i = 0; i < len; i++)
+	{
+		if (newline && p[i] == '\n') return i;
+		if (!set->is_first[p[i]]) continue;
+		for (k = 0; k < set->npairs; k++)
+		{
+			pair = &set->pairs[k];
+			if (p[i] != pair->first) continue;
+			if (i + pair->span >= len) return i;
+			if (p[i + pair->span] == pair->last) return i;
+		}
+	}
+	return len;
+}
+
+
+#ifdef HAVE_X86_KERNELS
+
+/**********************************************************************
+** find_candidate_sse2 ()
+**
+** Compare 16 positions at once. Only blocks whose every last byte is
+** in range are done here; the rest goes to the scalar kernel.
+*/
+__attribute__ ((target ("sse2")))
+static size_t
+find_candidate_sse2 (const candidate_set_t *set, const char *bytes,
+ size_t len, int newline)
+{
+	__m128i nl = _mm_set1_epi8 ('\n');
+	__m128i nl_wanted = _mm_set1_epi8 (newline ? -1 : 0);
+	__m128i first[SCAN_PAIRS_MAX];
+	__m128i last[SCAN_PAIRS_MAX];
+	__m128i block, tail, hits;
+	int npairs = set->npairs;
+	size_t i = 0;
+	int k, mask;
+
+	for (k = 0; k < npairs; k++)
+	{
+		first[k] = _mm_set1_epi8 ((char)set->pairs[k].first);
+		last[k] = _mm_set1_epi8 ((char)set->pairs[k].last);
+	}
+	while (i + 16 + set->max_span <= len)
+	{
+		block = _mm_loadu_si128 ((const __m128i *)(bytes + i));
+		hits = _mm_and_si128 (_mm_cmpeq_epi8 (block, nl), nl_wanted);
+		for (k = 0; k < npairs; k++)
+		{
+			tail = _mm_loadu_si128 ((const __m128i *)
+			 (bytes + i + set->pairs[k].span));
+			hits = _mm_or_si128 (hits, _mm_and_si128 (
+			 _mm_cmpeq_epi8 (block, first[k]),
+			 _mm_cmpeq_epi8 (tail, last[k])));
+		}
+		mask = _mm_movemask_epi8 (hits);
+		if (mask) return i + __builtin_ctz (mask);
+		i += 16;
+	}
+	return i + find_candidate_scalar (set, bytes + i, len - i, newline);
+}
+
+
+/**********************************************************************
+** find_candidate_avx2 ()
+**
+** As find_candidate_sse2(), 32 positions at once.
+*/
+__attribute__ ((target ("avx2")))
+static size_t
+find_candidate_avx2 (const candidate_set_t *set, const char *bytes,
+ size_t len, int newline)
+{
+	__m256i nl = _mm256_set1_epi8 ('\n');
+	__m256i nl_wanted = _mm256_set1_epi8 (newline ? -1 : 0);
+	__m256i first[SCAN_PAIRS_MAX];
+	__m256i last[SCAN_PAIRS_MAX];
+	__m256i block, tail, hits;
+	int npairs = set->npairs;
+	size_t i = 0;
+	int k;
+	unsigned int mask;
+
+	for (k = 0; k < npairs; k++)
+	{
+		first[k] = _mm256_set1_epi8 ((char)set->pairs[k].first);
+		last[k] = _mm256_set1_epi8 ((char)set->pairs[k].last);
+	}
+	while (i + 32 + set->max_span <= len)
+	{
+		block = _mm256_loadu_si256 ((const __m256i *)(bytes + i));
+		hits = _mm256_and_si256 (_mm256_cmpeq_epi8 (block, nl),
+		 nl_wanted);
+		for (k = 0; k < npairs; k++)
+		{
+			tail = _mm256_loadu_si256 ((const __m256i *)
+			 (bytes + i + set->pairs[k].span));
+			hits = _mm256_or_si256 (hits, _mm256_and_si256 (
+			 _mm256_cmpeq_epi8 (block, first[k]),
+			 _mm256_cmpeq_epi8 (tail, last[k])));
+		}
+		mask = (unsigned int)_mm256_movemask_epi8 (hits);
+		if (mask) return i + __builtin_ctz (mask);
+		i += 32;
+	}
+	return i + find_candidate_sse2 (set, bytes + i, len - i, newline);
+}
+
+static const scan_kernel_info_t sse2_kernel = { find_candidate_sse2, "sse2" };
+static const scan_kernel_info_t avx2_kernel = { find_candidate_avx2, "avx2" };
+
+#endif /* HAVE_X86_KERNELS */
+
+static const scan_kernel_info_t scalar_kernel =
+ { find_candidate_scalar, "scalar" };
+
+
+/**********************************************************************
+** select_scan_kernel ()
+**
+** Choose the kernel used by find_candidate(). SCAN_KERNEL_AUTO picks
+** the widest one this CPU supports. Until this is called, the first
+** find_candidate() makes that choice itself; it is safe to do from
+** any thread, but it is better done once at startup.
+**
+** Return values:
+**   0        success
+**   ENOTSUP  the kernel is not available on this CPU or build
+*/
+int
+select_scan_kernel (int kernel)
+{
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init ();
+	if (kernel == SCAN_KERNEL_AUTO)
+	{
+		if (__builtin_cpu_supports ("avx2")) kernel = SCAN_KERNEL_AVX2;
+		else if (__builtin_cpu_supports ("sse2")) kernel = SCAN_KERNEL_SSE2;
+		else kernel = SCAN_KERNEL_SCALAR;
+	}
+	if (kernel == SCAN_KERNEL_AVX2 && __builtin_cpu_supports ("avx2"))
+	{
+		__atomic_store_n (&scan_kernel, &avx2_kernel, __ATOMIC_RELEASE);
+		return 0;
+	}
+	if (kernel == SCAN_KERNEL_SSE2 && __builtin_cpu_supports ("sse2"))
+	{
+		__atomic_store_n (&scan_kernel, &sse2_kernel, __ATOMIC_RELEASE);
+		return 0;
+	}
+#else
+	if (kernel == SCAN_KERNEL_AUTO) kernel = SCAN_KERNEL_SCALAR;
+#endif
+	if (kernel == SCAN_KERNEL_SCALAR)
+	{
+		__atomic_store_n (&scan_kernel, &scalar_kernel, __ATOMIC_RELEASE);
+		return 0;
+	}
+	return ENOTSUP;
+}
+
+
+/**********************************************************************
+** scan_kernel_name ()
+*/
+const char *
+scan_kernel_name (void)
+{
+	if (__atomic_load_n (&scan_kernel, __ATOMIC_ACQUIRE) == &auto_kernel)
+	{
+		select_scan_kernel (SCAN_KERNEL_AUTO);
+	}
+	return __atomic_load_n (&scan_kernel, __ATOMIC_ACQUIRE)->name;
+}
+
+
+/**********************************************************************
+** find_candidate_auto ()
+**
+** The kernel until one is selected: select the best, then use it.
+** Threads that get here at once all pick the same one.
+*/
+static size_t
+find_candidate_auto (const candidate_set_t *set, const char *bytes,
+ size_t len, int newline)
+{
+	select_scan_kernel (SCAN_KERNEL_AUTO);
+	return __atomic_load_n (&scan_kernel, __ATOMIC_ACQUIRE)->find (set,
+	 bytes, len, newline);
+}
+
+
+/**********************************************************************
+** find_candidate ()
+**
+** Return value: the offset of the first candidate in bytes (or of
+** the first newline, if newline is set), or len if there is none.
+*/
+size_t
+find_candidate (const candidate_set_t *set, const char *bytes, size_t len,
+ int newline)
+{
+	return __atomic_load_n (&scan_kernel, __ATOMIC_ACQUIRE)->find (set,
+	 bytes, len, newline);
+}
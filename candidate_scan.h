@@ -0,0 +1,79 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _CANDIDATE_SCAN_H_ /* Brackets this whole file */
+#define _CANDIDATE_SCAN_H_
+
+#include <stddef.h>
+
+/* more distinct pairs than this are not worth vectorizing */
+#define SCAN_PAIRS_MAX 8
+
+/* kernels for select_scan_kernel() */
+#define SCAN_KERNEL_AUTO   0
+#define SCAN_KERNEL_SCALAR 1
+#define SCAN_KERNEL_SSE2   2
+#define SCAN_KERNEL_AVX2   3
+
+/*
+** A pattern of span + 1 bytes can only start where its first byte
+** is, with its last byte span bytes further on.
+*/
+typedef struct
+scan_pair_struct
+{
+	unsigned char first;
+	unsigned char last;
+	size_t span;
+}
+scan_pair_t;
+
+typedef struct
+candidate_set_struct
+{
+	int npairs;             /* -1 when there were too many to keep */
+	scan_pair_t pairs[SCAN_PAIRS_MAX];
+	size_t max_span;
+	unsigned char is_first[256];
+}
+candidate_set_t;
+
+extern void init_candidate_set (candidate_set_t*);
+extern int add_candidate_pair (candidate_set_t*, const char*, size_t);
+extern size_t find_candidate (const candidate_set_t*, const char*, size_t,
+ int);
+extern int select_scan_kernel (int);
+extern const char *scan_kernel_name (void);
+
+#endif /* _CANDIDATE_SCAN_H_ Brackets this whole file */
@@ -0,0 +1,464 @@
+/*
+**
+** Service configuration: a config file, or the older config directory
+** with one file per arg, read once into a config_t.
+**
+** load_config (config_t *cfg, const char *path)
+** free_config (config_t *cfg)
+**
+** A config file has one setting per line: a keyword and its values,
+** separated by blanks. Values may be quoted, with '...' taken as is
+** and "..." allowing \" and \\; outside quotes a backslash takes the
+** next character as is. A # at the start of a word begins a comment.
+**
+**     app      /usr/local/bin/myapp --port 8080
+**     log      /usr/local/bin/hm-logger.sh /var/log/myapp
+**     fifo     /var/run/myapp/access.fifo
+**     socket   8080
+**     include  HEARTBEAT
+**     exclude  "DEBUG HEARTBEAT"
+**     warn     5
+**     restart  15
+**
+** app, log, fifo and socket append all their values to their list, so
+** a long command line may be split over several lines. The rest are
+** heartmon options: include (-i), exclude (-e), regex (-E), warn (-w),
+** crit (-c), restart (-r), backoff (-b), standby (-s), grace (-g) and
+** zero-copy (-z).
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "config.h"
+
+/* which list a string goes to; stored in text before each string */
+#define LIST_APP 1
+#define LIST_LOG 2
+#define LIST_FIFO 3
+#define LIST_SOCKETS 4
+#define LIST_OPTS 5
+#define NLISTS 5
+
+static const struct
+{
+	const char *keyword;
+	int list;
+	const char *option;          /* for LIST_OPTS */
+	int nvalues;                 /* -1 for one or more */
+}
+keywords[] =
+{
+	{ "app", LIST_APP, NULL, -1 },
+	{ "log", LIST_LOG, NULL, -1 },
+	{ "fifo", LIST_FIFO, NULL, -1 },
+	{ "socket", LIST_SOCKETS, NULL, -1 },
+	{ "include", LIST_OPTS, "-i", 1 },
+	{ "exclude", LIST_OPTS, "-e", 1 },
+	{ "regex", LIST_OPTS, "-E", 0 },
+	{ "warn", LIST_OPTS, "-w", 1 },
+	{ "crit", LIST_OPTS, "-c", 1 },
+	{ "restart", LIST_OPTS, "-r", 1 },
+	{ "backoff", LIST_OPTS, "-b", 1 },
+	{ "standby", LIST_OPTS, "-s", 1 },
+	{ "grace", LIST_OPTS, "-g", 1 },
+	{ "zero-copy", LIST_OPTS, "-z", 0 },
+	{ NULL, 0, NULL, 0 }
+};
+
+
+/**********************************************************************
+** list_of ()
+*/
+static config_list_t *
+list_of (config_t *cfg, int list)
+{
+	switch (list)
+	{
+		case LIST_APP: return &cfg->app;
+		case LIST_LOG: return &cfg->log;
+		case LIST_FIFO: return &cfg->fifo;
+		case LIST_SOCKETS: return &cfg->sockets;
+		default: return &cfg->opts;
+	}
+}
+
+
+/**********************************************************************
+** add_string ()
+**
+** Append a string of len bytes to a list, growing text as needed.
+**
+** Returns 0 on success, or the value of `errno' on failure.
+*/
+static int
+add_string (config_t *cfg, int list, const char *str, size_t len)
+{
+	size_t size;
+	char *text;
+
+	if (cfg->len + len + 2 > cfg->size)
+	{
+		size = cfg->size ? cfg->size : 256;
+		while (cfg->len + len + 2 > size) size *= 2;
+		if ((text = realloc (cfg->text, size)) == NULL) return errno;
+		cfg->text = text;
+		cfg->size = size;
+	}
+	cfg->text[cfg->len++] = list;
+	memcpy (cfg->text + cfg->len, str, len);
+	cfg->len += len;
+	cfg->text[cfg->len++] = '\0';
+	list_of (cfg, list)->count++;
+	return 0;
+}
+
+
+/**********************************************************************
+** finish_config ()
+**
+** Point the lists into text, now that it will not move any more.
+**
+** Returns 0 on success, or the value of `errno' on failure.
+*/
+static int
+finish_config (config_t *cfg)
+{
+	config_list_t *list;
+	char **next[NLISTS + 1];
+	char *p;
+	int total = 0;
+	int i;
+
+	for (i = 1; i <= NLISTS; i++) total += list_of (cfg, i)->count + 1;
+	cfg->items = malloc (total * sizeof (char*));
+	if (cfg->items == NULL) return errno;
+	total = 0;
+	for (i = 1; i <= NLISTS; i++)
+	{
+		list = list_of (cfg, i);
+		list->items = next[i] = cfg->items + total;
+		total += list->count + 1;
+	}
+	for (p = cfg->text; p < cfg->text + cfg->len; p += strlen (p) + 1)
+	{
+		i = *p++;
+		*next[i]++ = p;
+	}
+	for (i = 1; i <= NLISTS; i++) *next[i] = NULL;
+	return 0;
+}
+
+
+/**********************************************************************
+** read_file ()
+**
+** Read the whole of a file into a new NUL-terminated buffer.
+**
+** Returns 0 on success, or the value of `errno' on failure.
+*/
+static int
+read_file (const char *path, char **content, size_t *len)
+{
+	FILE *fh;
+	char *buf = NULL;
+	char *grown;
+	size_t size = 0;
+	size_t n = 0;
+	int status = 0;
+
+	if ((fh = fopen (path, "r")) == NULL) return errno;
+	do
+	{
+		if (n + 1 >= size)
+		{
+			size = size ? size * 2 : 4096;
+			if ((grown = realloc (buf, size)) == NULL)
+			{
+				status = errno;
+				break;
+			}
+			buf = grown;
+		}
+		n += fread (buf + n, 1, size - n - 1, fh);
+	}
+	while (!feof (fh) && !ferror (fh));
+	if (status == 0 && ferror (fh)) status = EIO;
+	fclose (fh);
+	if (status != 0)
+	{
+		free (buf);
+		return status;
+	}
+	buf[n] = '\0';
+	*content = buf;
+	*len = n;
+	return 0;
+}
+
+
+/**********************************************************************
+** load_config_dir ()
+**
+** Read a config directory: app/, log/, opts/, fifo/ and sockets/, each
+** holding files named 0, 1, 2 and so on, one arg per file. A list ends
+** at the first number with no file. One trailing newline is dropped.
+**
+** Returns 0 on success, or the value of `errno' on failure.
+*/
+static int
+load_config_dir (config_t *cfg, const char *root)
+{
+	static const char *subs[NLISTS + 1] =
+	 { NULL, "app", "log", "fifo", "sockets", "opts" };
+	char *path;
+	char *content;
+	size_t len;
+	int status = 0;
+	int list;
+	int i;
+
+	path = malloc (strlen (root) + 32);
+	if (path == NULL) return errno;
+	for (list = 1; list <= NLISTS && status == 0; list++)
+	{
+		for (i = 0; status == 0; i++)
+		{
+			sprintf (path, "%s/%s/%d", root, subs[list], i);
+			if (read_file (path, &content, &len) != 0) break;
+			/* get rid of the newline, and a carriage return if there is one */
+			if (len > 0 && content[len - 1] == '\n') len--;
+			if (len > 0 && content[len - 1] == '\r') len--;
+			status = add_string (cfg, list, content, len);
+			free (content);
+		}
+	}
+	free (path);
+	return status;
+}
+
+
+/**********************************************************************
+** next_word ()
+**
+** Take the next word off a line, at *pos, unquoting it in place.
+**
+** Return values:
+**   1  *word is the word, NUL-terminated; *pos is past it
+**   0  no more words on the line
+**  -1  a quote is not closed
+*/
+static int
+next_word (char **pos, char **word)
+{
+	char *r = *pos;
+	char *w;
+	char quote = 0;
+
+	while (*r == ' ' || *r == '\t' || *r == '\r') r++;
+	if (*r == '\0' || *r == '#') return 0;
+	*word = w = r;
+	for (; *r != '\0'; r++)
+	{
+		if (quote)
+		{
+			if (*r == quote) quote = 0;
+			else if (quote == '"' && *r == '\\' && r[1] != '\0') *w++ = *++r;
+			else *w++ = *r;
+		}
+		else if (*r == '\'' || *r == '"') quote = *r;
+		else if (*r == ' ' || *r == '\t' || *r == '\r') break;
+		else if (*r == '\\' && r[1] != '\0') *w++ = *++r;
+		else *w++ = *r;
+	}
+	if (quote) return -1;
+	*pos = (*r != '\0') ? r + 1 : r;
+	*w = '\0';
+	return 1;
+}
+
+
+/**********************************************************************
+** parse_line ()
+**
+** Add the setting on one NUL-terminated line of a config file.
+**
+** Returns 0 on success, EINVAL with cfg->error set for a bad line, or
+** the value of `errno' on failure.
+*/
+static int
+parse_line (config_t *cfg, char *line)
+{
+	char *keyword;
+	char *values[2];
+	char *word;
+	int nvalues = 0;
+	int status;
+	int k;
+
+	if ((status = next_word (&line, &keyword)) <= 0)
+	{
+		if (status == 0) return 0;
+		cfg->error = "unterminated quote";
+		return EINVAL;
+	}
+	for (k = 0; keywords[k].keyword != NULL; k++)
+	{
+		if (strcmp (keywords[k].keyword, keyword) == 0) break;
+	}
+	if (keywords[k].keyword == NULL)
+	{
+		cfg->error = "unknown setting";
+		return EINVAL;
+	}
+	if (keywords[k].option != NULL)
+	{
+		status = add_string (cfg, LIST_OPTS, keywords[k].option,
+		 strlen (keywords[k].option));
+		if (status != 0) return status;
+	}
+	while ((status = next_word (&line, &word)) == 1)
+	{
+		if (keywords[k].nvalues == -1)
+		{
+			status = add_string (cfg, keywords[k].list, word, strlen (word));
+			if (status != 0) return status;
+		}
+		else if (nvalues < 2) values[nvalues] = word;
+		nvalues++;
+	}
+	if (status == -1)
+	{
+		cfg->error = "unterminated quote";
+		return EINVAL;
+	}
+	if (keywords[k].nvalues == -1 && nvalues == 0)
+	{
+		cfg->error = "missing value";
+		return EINVAL;
+	}
+	if (keywords[k].nvalues != -1 && nvalues != keywords[k].nvalues)
+	{
+		cfg->error = keywords[k].nvalues ? "takes one value" : "takes no value";
+		return EINVAL;
+	}
+	if (nvalues == 1 && keywords[k].nvalues == 1)
+	{
+		return add_string (cfg, LIST_OPTS, values[0], strlen (values[0]));
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** load_config_file ()
+**
+** Read and parse a config file, as described at the top of this file.
+**
+** Returns 0 on success, EINVAL with cfg->error and cfg->error_line set
+** for a syntax error, or the value of `errno' on failure.
+*/
+static int
+load_config_file (config_t *cfg, const char *path)
+{
+	char *content;
+	char *line;
+	char *eol;
+	size_t len;
+	int status;
+
+	if ((status = read_file (path, &content, &len)) != 0) return status;
+	for (line = content; status == 0 && line < content + len; line = eol + 1)
+	{
+		cfg->error_line++;
+		if ((eol = memchr (line, '\n', content + len - line)) == NULL)
+		{ eol = content + len; }
+		*eol = '\0';
+		if (strlen (line) != (size_t) (eol - line))
+		{
+			cfg->error = "NUL byte in line";
+			status = EINVAL;
+		}
+		else status = parse_line (cfg, line);
+	}
+	free (content);
+	if (status == 0) cfg->error_line = 0;
+	return status;
+}
+
+
+/**********************************************************************
+** load_config ()
+**
+** Read the config at path, a config file or a config directory, into
+** cfg. On failure nothing is left allocated, though cfg->error and
+** cfg->error_line may be set.
+**
+** Returns 0 on success, EINVAL for a syntax error in a config file, or
+** the value of `errno' on failure.
+*/
+int
+load_config (config_t *cfg, const char *path)
+{
+	struct stat st;
+	int status;
+
+	memset (cfg, 0, sizeof (*cfg));
+	if (stat (path, &st) == -1) return errno;
+	if (S_ISDIR (st.st_mode)) status = load_config_dir (cfg, path);
+	else status = load_config_file (cfg, path);
+	if (status == 0) status = finish_config (cfg);
+	if (status != 0)
+	{
+		free (cfg->text);
+		cfg->text = NULL;
+		cfg->len = cfg->size = 0;
+	}
+	return status;
+}
+
+
+/**********************************************************************
+** free_config ()
+*/
+void
+free_config (config_t *cfg)
+{
+	free (cfg->text);
+	free (cfg->items);
+	memset (cfg, 0, sizeof (*cfg));
+}
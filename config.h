@@ -0,0 +1,80 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _CONFIG_H_ /* Brackets this whole file */
+#define _CONFIG_H_
+
+#include <stddef.h>
+
+/* a list of strings from a config, NULL-terminated like argv */
+typedef struct
+config_list_struct
+{
+	char **items;
+	int count;
+}
+config_list_t;
+
+/*
+** One service's configuration, read from a config file or a config
+** directory. All of its strings are kept NUL-terminated, one after
+** another, in the single block text, and the lists point into it
+** through a single block of pointers, items. Args may be of any
+** length and number.
+**
+** opts holds heartmon options in command-line form ("-w", "5"), ready
+** for getopt(). After a syntax error in a config file, error_line is
+** the line it is on and error says what is wrong.
+*/
+typedef struct
+config_struct
+{
+	char *text;                  /* each string is preceded by its list */
+	size_t len;
+	size_t size;
+	char **items;                /* behind every list */
+	config_list_t app;
+	config_list_t log;
+	config_list_t fifo;
+	config_list_t sockets;
+	config_list_t opts;
+	int error_line;
+	const char *error;
+}
+config_t;
+
+extern int load_config (config_t*, const char*);
+extern void free_config (config_t*);
+
+#endif /* _CONFIG_H_ Brackets this whole file */
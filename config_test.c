@@ -0,0 +1,199 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "config.h"
+
+
+static char dir[] = "/tmp/config_test.XXXXXX";
+static char path[256];
+
+
+/*
+** Write text to name in the test's directory and leave its path in
+** path. len is for text with NUL bytes; -1 takes strlen().
+*/
+static void
+write_file (const char *name, const char *text, int len)
+{
+	FILE *fh;
+
+	snprintf (path, sizeof (path), "%s/%s", dir, name);
+	if ((fh = fopen (path, "w")) == NULL) err (errno, "ERROR: %s", path);
+	fwrite (text, 1, len < 0 ? strlen (text) : (size_t)len, fh);
+	fclose (fh);
+}
+
+
+static void
+print_list (const char *name, config_list_t *list)
+{
+	int i;
+
+	printf ("%s (%d):", name, list->count);
+	for (i = 0; i < list->count; i++) printf (" [%s]", list->items[i]);
+	printf ("\n");
+}
+
+
+/*
+** Load the config at path and print its lists, or what went wrong.
+*/
+static void
+load (void)
+{
+	config_t cfg;
+	int status = load_config (&cfg, path);
+
+	if (status != 0)
+	{
+		printf ("%s, line %d: %s\n", strerror (status), cfg.error_line,
+		 cfg.error ? cfg.error : "-");
+		return;
+	}
+	print_list ("app", &cfg.app);
+	print_list ("log", &cfg.log);
+	print_list ("fifo", &cfg.fifo);
+	print_list ("sockets", &cfg.sockets);
+	print_list ("opts", &cfg.opts);
+	free_config (&cfg);
+}
+
+
+int
+main ()
+{
+	char longarg[301];
+	char text[512];
+	char sub[300];
+
+	if (mkdtemp (dir) == NULL) err (errno, "ERROR: mkdtemp");
+	memset (longarg, 'a', 300);
+	longarg[299] = 'z';
+	longarg[300] = '\0';
+
+	printf ("==== #010 Quotes and escapes (expect [it's] [a \"b\"] [c\\d] [e f] [g\"]) ====\n");
+	write_file ("quotes.conf",
+	 "app /bin/echo 'it'\"'\"'s' \"a \\\"b\\\"\" \"c\\\\d\" e\\ f 'g\"'\n"
+	 "log /bin/cat\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #020 Comments and blank lines (expect app [/bin/true], include [a#b]) ====\n");
+	write_file ("comments.conf",
+	 "# a comment\n"
+	 "\n"
+	 "   \t\n"
+	 "app /bin/true # trailing comment\n"
+	 "include a#b\n"
+	 "log /bin/cat\n"
+	 "# warn 5\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #030 app over several lines, with options (expect 6 app args) ====\n");
+	write_file ("multi.conf",
+	 "app  /usr/bin/myapp --port\r\n"
+	 "app  8080\n"
+	 "log  /bin/cat\n"
+	 "app  --name \"my app\" -v\n"
+	 "fifo /tmp/a.fifo /tmp/b.fifo\n"
+	 "socket 8080\n"
+	 "warn 5\n"
+	 "regex\n"
+	 "exclude \"DEBUG HEARTBEAT\"\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #040 Unterminated quote (expect line 2) ====\n");
+	write_file ("quote.conf", "app /bin/true\nlog /bin/cat \"x\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #042 Unknown setting (expect line 3) ====\n");
+	write_file ("unknown.conf", "app /bin/true\n\nlogger /bin/cat\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #044 Wrong number of values (expect lines 1, 2 and 1) ====\n");
+	write_file ("values.conf", "warn 5 6\n", -1);
+	load ();
+	write_file ("values.conf", "app /bin/true\nregex yes\n", -1);
+	load ();
+	write_file ("values.conf", "app\n", -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #046 NUL byte in a line (expect line 2) ====\n");
+	write_file ("nul.conf", "app /bin/true\nlog /bin/c\0at\n", 28);
+	load ();
+	printf ("\n");
+
+	printf ("==== #048 No such file (expect ENOENT) ====\n");
+	snprintf (path, sizeof (path), "%s/missing.conf", dir);
+	load ();
+	printf ("\n");
+
+	printf ("==== #050 A 300-byte arg in a config file (expect it whole) ====\n");
+	snprintf (text, sizeof (text), "app /bin/echo %s\nlog /bin/cat\n", longarg);
+	write_file ("long.conf", text, -1);
+	load ();
+	printf ("\n");
+
+	printf ("==== #060 Config directory, 300-byte arg and CRLF (expect it whole) ====\n");
+	snprintf (sub, sizeof (sub), "%s/d", dir);
+	mkdir (sub, 0755);
+	snprintf (sub, sizeof (sub), "%s/d/app", dir);
+	mkdir (sub, 0755);
+	snprintf (sub, sizeof (sub), "%s/d/opts", dir);
+	mkdir (sub, 0755);
+	write_file ("d/app/0", "/bin/echo\n", -1);
+	write_file ("d/app/1", longarg, -1);
+	write_file ("d/app/3", "not reached: there is no 2\n", -1);
+	write_file ("d/opts/0", "-w\r\n", -1);
+	write_file ("d/opts/1", "5\n", -1);
+	snprintf (path, sizeof (path), "%s/d", dir);
+	load ();
+	printf ("\n");
+
+	snprintf (text, sizeof (text), "rm -rf %s", dir);
+	if (system (text) != 0) warnx ("could not remove %s", dir);
+	return 0;
+}
@@ -0,0 +1,451 @@
+/*
+**
+** An epoll event loop with persistent registrations.
+**
+** Each watched fd is registered once and stays registered until it
+** is unwatched, so a pass through the loop costs one epoll_wait()
+** no matter how many fds there are, and there is no FD_SETSIZE cap.
+**
+** create_event_loop   (event_loop_t *loop)
+** destroy_event_loop  (event_loop_t *loop)
+** init_event_watch    (event_watch_t *watch)
+** watch_fd            (event_loop_t *loop, event_watch_t *watch, int fd,
+**                      unsigned int events, event_handler_t handler,
+**                      void *data)
+** rewatch_fd          (event_loop_t *loop, event_watch_t *watch,
+**                      unsigned int events)
+** rearm_watch         (event_loop_t *loop, event_watch_t *watch)
+** unwatch_fd          (event_loop_t *loop, event_watch_t *watch)
+** park_watch          (event_loop_t *loop, event_watch_t *watch)
+** unpark_watch        (event_loop_t *loop, event_watch_t *watch)
+** run_event_loop_once (event_loop_t *loop, int timeout_ms)
+** set_nonblocking     (int fd)
+** open_signal_fd      (int signo)
+** open_timer_fd       (void)
+** arm_timer_fd        (int fd, long long deadline_ms)
+** monotonic_ms        (void)
+** monotonic_ns        (void)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "event_loop.h"
+
+
+/**********************************************************************
+** create_event_loop ()
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_create1()
+*/
+int
+create_event_loop (event_loop_t *loop)
+{
+	loop->epfd = epoll_create1 (EPOLL_CLOEXEC);
+	loop->batches = loop->busy_ns = loop->max_ns = 0;
+	loop->latency = NULL;
+	if (loop->epfd == -1) return errno;
+	return 0;
+}
+
+
+/**********************************************************************
+** destroy_event_loop ()
+*/
+void
+destroy_event_loop (event_loop_t *loop)
+{
+	if (loop != NULL && loop->epfd != -1)
+	{
+		close (loop->epfd);
+		loop->epfd = -1;
+	}
+}
+
+
+/**********************************************************************
+** init_event_watch ()
+**
+** Mark a watch as not registered.
+*/
+void
+init_event_watch (event_watch_t *watch)
+{
+	watch->fd = -1;
+	watch->parked_fd = -1;
+	watch->generation = 0;
+	watch->events = 0;
+	watch->handler = NULL;
+	watch->data = NULL;
+}
+
+
+/**********************************************************************
+** watch_fd ()
+**
+** Register fd with the loop. When any of the requested events occur,
+** handler (loop, fd, events, data) is called from
+** run_event_loop_once(). The watch must not already be registered.
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_ctl()
+*/
+int
+watch_fd (event_loop_t *loop, event_watch_t *watch, int fd,
+ unsigned int events, event_handler_t handler, void *data)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = watch;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) return errno;
+	watch->fd = fd;
+	watch->generation++;
+	watch->events = events;
+	watch->handler = handler;
+	watch->data = data;
+	return 0;
+}
+
+
+/**********************************************************************
+** rewatch_fd ()
+**
+** Change the set of events a registered watch is interested in,
+** e.g. to add EPOLLOUT only while there is output pending. Asking
+** for the set already registered costs nothing.
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_ctl()
+*/
+int
+rewatch_fd (event_loop_t *loop, event_watch_t *watch, unsigned int events)
+{
+	struct epoll_event ev;
+
+	if (watch->fd == -1) return errno = EBADF;
+	if (watch->events == events) return 0;
+	ev.events = events;
+	ev.data.ptr = watch;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_MOD, watch->fd, &ev) == -1)
+	{ return errno; }
+	watch->events = events;
+	return 0;
+}
+
+
+/**********************************************************************
+** rearm_watch ()
+**
+** Have the loop report a watch's events again if they are still
+** pending, after those already queued. This lets an edge-triggered
+** handler stop before EAGAIN and take the rest on a later pass.
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_ctl()
+*/
+int
+rearm_watch (event_loop_t *loop, event_watch_t *watch)
+{
+	struct epoll_event ev;
+
+	if (watch->fd == -1) return errno = EBADF;
+	ev.events = watch->events;
+	ev.data.ptr = watch;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_MOD, watch->fd, &ev) == -1)
+	{ return errno; }
+	return 0;
+}
+
+
+/**********************************************************************
+** unwatch_fd ()
+**
+** Remove a registration. The fd itself is left open. Events for this
+** watch that are still queued in the current batch are dropped.
+**
+** The loop still looks at the watch to drop them, so a watch's
+** storage must outlive the batch in which it was unwatched: a handler
+** that unwatches some other watch may not free it (or what it is
+** embedded in) before the batch is over. A handler may free its own
+** watch, as epoll reports each registration at most once per batch.
+**
+** Return values:
+**   0  success (also when the watch was not registered)
+**   *  errno from epoll_ctl()
+*/
+int
+unwatch_fd (event_loop_t *loop, event_watch_t *watch)
+{
+	int status = 0;
+
+	if (watch->fd == -1) return 0;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_DEL, watch->fd, NULL) == -1)
+	{ status = errno; }
+	watch->fd = -1;
+	watch->events = 0;
+	return status;
+}
+
+
+/**********************************************************************
+** park_watch ()
+**
+** Remove a registration but remember it, so unpark_watch() can
+** register it again, on this loop or another one, with the same
+** events and handler. Until then the watch looks unwatched, and
+** events for it still queued in the current batch are dropped.
+**
+** Return values:
+**   0  success (also when the watch was not registered)
+**   *  errno from epoll_ctl()
+*/
+int
+park_watch (event_loop_t *loop, event_watch_t *watch)
+{
+	int status = 0;
+
+	if (watch->fd == -1) return 0;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_DEL, watch->fd, NULL) == -1)
+	{ status = errno; }
+	watch->parked_fd = watch->fd;
+	watch->fd = -1;
+	return status;
+}
+
+
+/**********************************************************************
+** unpark_watch ()
+**
+** Register a parked watch with loop. An fd that is already ready
+** reports it right away, edge-triggered or not, so nothing that
+** happened while it was parked is missed.
+**
+** Return values:
+**   0  success (also when the watch was not parked)
+**   *  errno from epoll_ctl()
+*/
+int
+unpark_watch (event_loop_t *loop, event_watch_t *watch)
+{
+	int fd = watch->parked_fd;
+
+	if (fd == -1) return 0;
+	watch->parked_fd = -1;
+	return watch_fd (loop, watch, fd, watch->events, watch->handler,
+	 watch->data);
+}
+
+
+/**********************************************************************
+** run_event_loop_once ()
+**
+** Wait up to timeout_ms milliseconds (-1 waits forever) for events,
+** then call the handler of every watch that has some. The time the
+** handlers take is added to the loop's counts.
+**
+** An earlier handler in the batch may unwatch a watch, or unwatch it
+** and watch it again, maybe with another fd, before its event comes
+** up. epoll_wait() only returns events of live registrations, so the
+** generation of each watch is noted before any handler runs, and an
+** event whose watch has moved on since is dropped. This reads the
+** watch, so it only holds while its storage does (see unwatch_fd()).
+**
+** Return values:
+**  >=0  number of events dispatched (0 on timeout or EINTR)
+**   -1  epoll_wait() failed; errno is set
+*/
+int
+run_event_loop_once (event_loop_t *loop, int timeout_ms)
+{
+	struct epoll_event events[EVENT_LOOP_BATCH];
+	unsigned int generations[EVENT_LOOP_BATCH];
+	event_watch_t *watch;
+	int i, readycount;
+	unsigned long long started, took;
+
+	readycount = epoll_wait (loop->epfd, events, EVENT_LOOP_BATCH,
+	 timeout_ms);
+	if (readycount == -1)
+	{
+		if (errno == EINTR) return 0;
+		return -1;
+	}
+	if (readycount == 0) return 0;
+	started = monotonic_ns ();
+	for (i = 0; i < readycount; i++)
+	{
+		watch = events[i].data.ptr;
+		generations[i] = watch->generation;
+	}
+	for (i = 0; i < readycount; i++)
+	{
+		watch = events[i].data.ptr;
+		if (watch->fd == -1 || watch->generation != generations[i])
+		{ continue; }
+		watch->handler (loop, watch->fd, events[i].events, watch->data);
+	}
+	took = monotonic_ns () - started;
+	__atomic_store_n (&loop->batches, loop->batches + 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&loop->busy_ns, loop->busy_ns + took, __ATOMIC_RELAXED);
+	if (took > loop->max_ns)
+	{ __atomic_store_n (&loop->max_ns, took, __ATOMIC_RELAXED); }
+	if (loop->latency) record_latency (loop->latency, took);
+	return readycount;
+}
+
+
+/**********************************************************************
+** set_nonblocking ()
+**
+** Return value:
+**   0 if successful
+**  -1 upon failure. An error code is stored in errno.
+*/
+int
+set_nonblocking (int fd)
+{
+	int flags = fcntl (fd, F_GETFL);
+
+	if (flags == -1) return -1;
+	if (flags & O_NONBLOCK) return 0;
+	return fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+/**********************************************************************
+** open_signal_fd ()
+**
+** Block signo and return a non-blocking signalfd that becomes
+** readable when it is pending, so the signal can be handled as an
+** event by the loop. Children inherit the blocked mask across exec,
+** so spawn_process() clears it again.
+**
+** Return value:
+**   -1 upon failure. An error code is stored in errno.
+**    * file descriptor number if successful
+*/
+int
+open_signal_fd (int signo)
+{
+	sigset_t mask;
+
+	sigemptyset (&mask);
+	sigaddset (&mask, signo);
+	if (sigprocmask (SIG_BLOCK, &mask, NULL) == -1) return -1;
+	return signalfd (-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+
+/**********************************************************************
+** open_timer_fd ()
+**
+** Return a non-blocking timerfd on CLOCK_MONOTONIC, so deadlines are
+** not moved by changes to the wall clock. It is disarmed until
+** arm_timer_fd() is called.
+**
+** Return value:
+**   -1 upon failure. An error code is stored in errno.
+**    * file descriptor number if successful
+*/
+int
+open_timer_fd (void)
+{
+	return timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+
+/**********************************************************************
+** arm_timer_fd ()
+**
+** Make the timer fire once at deadline_ms, an absolute time as
+** returned by monotonic_ms(). A deadline already in the past fires
+** right away. A deadline of 0 disarms the timer.
+**
+** Return value:
+**   0 if successful
+**  -1 upon failure. An error code is stored in errno.
+*/
+int
+arm_timer_fd (int fd, long long deadline_ms)
+{
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = deadline_ms / 1000;
+	its.it_value.tv_nsec = (deadline_ms % 1000) * 1000000;
+	return timerfd_settime (fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+/**********************************************************************
+** monotonic_ms ()
+**
+** Milliseconds on CLOCK_MONOTONIC.
+*/
+long long
+monotonic_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**********************************************************************
+** monotonic_ns ()
+**
+** Nanoseconds on CLOCK_MONOTONIC.
+*/
+unsigned long long
+monotonic_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
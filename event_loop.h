@@ -0,0 +1,100 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _EVENT_LOOP_H_ /* Brackets this whole file */
+#define _EVENT_LOOP_H_
+
+#include <sys/epoll.h>
+#include "latency_hist.h"
+
+#define EVENT_LOOP_BATCH 64
+
+struct event_loop_struct;
+
+typedef void (*event_handler_t) (struct event_loop_struct*, int,
+ unsigned int, void*);
+
+/*
+** One registration. The caller owns the struct (usually embedded in
+** its own state) and it must stay put while the fd is watched, and
+** until the end of the batch it was unwatched in; epoll hands a
+** pointer to it back with every event. The generation tells one
+** registration of the struct from the next.
+*/
+typedef struct
+event_watch_struct
+{
+	int fd;                 /* -1 when not watched */
+	int parked_fd;          /* fd while parked, else -1 */
+	unsigned int generation; /* bumped by every watch_fd() */
+	unsigned int events;    /* EPOLLIN, EPOLLOUT, EPOLLET, ... */
+	event_handler_t handler;
+	void *data;
+}
+event_watch_t;
+
+/*
+** The loop's thread keeps count of how long its handlers take, for
+** the metrics; other threads may read the counts at any time.
+*/
+typedef struct
+event_loop_struct
+{
+	int epfd;
+	unsigned long long batches;  /* wakeups with events to dispatch */
+	unsigned long long busy_ns;  /* spent in handlers, in total */
+	unsigned long long max_ns;   /* the longest batch */
+	latency_hist_t *latency;     /* every batch, when profiling (-P) */
+}
+event_loop_t;
+
+extern int create_event_loop (event_loop_t*);
+extern void destroy_event_loop (event_loop_t*);
+extern void init_event_watch (event_watch_t*);
+extern int watch_fd (event_loop_t*, event_watch_t*, int, unsigned int,
+ event_handler_t, void*);
+extern int rewatch_fd (event_loop_t*, event_watch_t*, unsigned int);
+extern int rearm_watch (event_loop_t*, event_watch_t*);
+extern int unwatch_fd (event_loop_t*, event_watch_t*);
+extern int park_watch (event_loop_t*, event_watch_t*);
+extern int unpark_watch (event_loop_t*, event_watch_t*);
+extern int run_event_loop_once (event_loop_t*, int);
+extern int set_nonblocking (int);
+extern int open_signal_fd (int);
+extern int open_timer_fd (void);
+extern int arm_timer_fd (int, long long);
+extern long long monotonic_ms (void);
+extern unsigned long long monotonic_ns (void);
+
+#endif /* _EVENT_LOOP_H_ Brackets this whole file */
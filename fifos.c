@@ -86,7 +86,8 @@ make_fifo (const char *fpath)
 /**********************************************************************
 ** open_fifo (const char*)
 ** 
-** Opens the fifo (or file) at *fpath for reading, non-blocking.
+** Opens the fifo (or file) at *fpath for reading, non-blocking and
+** close-on-exec, so spawned processes do not inherit it.
 ** 
 ** Return value:
 **   -1 upon failure
@@ -95,6 +96,6 @@ make_fifo (const char *fpath)
 int
 open_fifo (const char *fpath)
 {
-	return open (fpath, O_RDONLY | O_NONBLOCK);
+	return open (fpath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
 }
 
@@ -0,0 +1,258 @@
+/*
+**
+** The built-in log sink: a file written straight from the log
+** stream's buffer, in place of a log handler process and its pipe.
+**
+** Whole lines are gathered into one writev(), each behind a prefix
+** with the time it was written; the prefix is formatted once a second
+** at most. As the file is opened O_APPEND, the app's and the
+** standby's streams can each have their own without their lines
+** being mixed up. How often the data is synced to disk is up to the
+** caller, with sync_file_sink().
+**
+** open_file_sink  (file_sink_t *fs, const char *path, int sync,
+**                  long long sync_every)
+** write_file_sink (file_sink_t *fs, char_buffer_t *buffer, int all)
+** sync_file_sink  (file_sink_t *fs)
+** close_file_sink (file_sink_t *fs)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _GNU_SOURCE /* memrchr */
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "buffer.h"
+#include "file_sink.h"
+
+
+/* ends a line that is written out unfinished, with `all' */
+static char newline[] = "\n";
+
+
+/**********************************************************************
+** update_stamp ()
+**
+** Format the prefix for lines written in second now.
+*/
+static void
+update_stamp (file_sink_t *fs, time_t now)
+{
+	struct tm tm;
+
+	fs->stamp_len = strftime (fs->stamp, sizeof (fs->stamp),
+	 "%Y-%m-%dT%H:%M:%S%z ", gmtime_r (&now, &tm));
+	fs->stamp_at = now;
+}
+
+
+/**********************************************************************
+** last_line_end ()
+**
+** The position just past the last newline in the buffer, or its read
+** position if there is none.
+*/
+static size_t
+last_line_end (char_buffer_t *buffer)
+{
+	size_t pos = buffer->read_pos;
+	size_t found = pos;
+	size_t len;
+	char *span, *nl;
+
+	while ((span = get_char_buffer_span_at (buffer, pos, &len), len > 0))
+	{
+		nl = memrchr (span, '\n', len);
+		if (nl != NULL) found = pos + (nl - span) + 1;
+		pos += len;
+	}
+	return found;
+}
+
+
+/**********************************************************************
+** open_file_sink ()
+**
+** Open (or create) the file at path for appending, and set how it is
+** to be synced: sync is FILE_SYNC_NONE, FILE_SYNC_DATA or
+** FILE_SYNC_FULL, every sync_every ms or, if that is 0, after every
+** write.
+**
+** Return values:
+**   0  success
+**   *  errno from open()
+*/
+int
+open_file_sink (file_sink_t *fs, const char *path, int sync,
+ long long sync_every)
+{
+	memset (fs, 0, sizeof (*fs));
+	fs->sync = sync;
+	fs->sync_every = sync_every;
+	fs->stamp_at = -1;
+	fs->fd = open (path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC
+	 | O_NOCTTY, 0644);
+	if (fs->fd == -1) return errno;
+	return 0;
+}
+
+
+/**********************************************************************
+** write_file_sink ()
+**
+** Write the whole lines in the buffer, each with its prefix, with a
+** single writev(), and consume what was written. Up to FILE_SINK_IOV
+** / 2 lines go at a time, so it may take a few calls to empty the
+** buffer. A line cut off by the end of the ring takes two iovecs, and
+** its second part no prefix.
+**
+** An unfinished line is left for the next call, unless it has reached
+** FILE_SINK_LINE_MAX, or all is set, in which case it is written out
+** anyway and ended with a newline.
+**
+** Return values:
+**  >=0  bytes of the buffer written and consumed; 0 if there was no
+**       whole line to write
+**   -1  writev() failed; errno is set
+*/
+ssize_t
+write_file_sink (file_sink_t *fs, char_buffer_t *buffer, int all)
+{
+	size_t pos = buffer->read_pos;
+	size_t end = buffer->write_pos;
+	size_t len, taken, consumed = 0;
+	ssize_t written;
+	char *span, *nl;
+	int mid_line = fs->mid_line;
+	int n = 0;
+	int i;
+	time_t now;
+
+	if (!all)
+	{
+		end = last_line_end (buffer);
+		if (end == pos && buffer->write_pos - pos >= FILE_SINK_LINE_MAX)
+		{ end = buffer->write_pos; }
+	}
+	if (pos == end) return 0;
+	now = time (NULL);
+	if (now != fs->stamp_at) update_stamp (fs, now);
+
+	/* two iovecs per pass, and one to spare for a closing newline */
+	while (pos < end && n < FILE_SINK_IOV - 2)
+	{
+		span = get_char_buffer_span_at (buffer, pos, &len);
+		if (len > end - pos) len = end - pos;
+		if (!mid_line)
+		{
+			fs->iov[n].iov_base = fs->stamp;
+			fs->iov[n++].iov_len = fs->stamp_len;
+		}
+		nl = memchr (span, '\n', len);
+		if (nl != NULL) len = nl - span + 1;
+		mid_line = (nl == NULL);
+		fs->iov[n].iov_base = span;
+		fs->iov[n++].iov_len = len;
+		pos += len;
+	}
+	if (all && mid_line && pos == buffer->write_pos)
+	{
+		fs->iov[n].iov_base = newline;
+		fs->iov[n++].iov_len = 1;
+	}
+
+	written = writev (fs->fd, fs->iov, n);
+	if (written == -1) return -1;
+	fs->dirty = 1;
+
+	/*
+	** A short write (the disk is full) may stop anywhere, even within
+	** a prefix; the rest of that line then follows without one.
+	*/
+	for (i = 0; i < n && written > 0; i++)
+	{
+		taken = (size_t)written < fs->iov[i].iov_len ? (size_t)written
+		 : fs->iov[i].iov_len;
+		written -= taken;
+		if (fs->iov[i].iov_base == fs->stamp) fs->mid_line = 1;
+		else if (fs->iov[i].iov_base == newline) fs->mid_line = 0;
+		else
+		{
+			consumed += taken;
+			fs->mid_line =
+			 ((char *)fs->iov[i].iov_base)[taken - 1] != '\n';
+		}
+	}
+	consume_char_buffer (buffer, consumed);
+	return consumed;
+}
+
+
+/**********************************************************************
+** sync_file_sink ()
+**
+** Sync what was written since the last time, the way open_file_sink()
+** was told to.
+**
+** Return values:
+**   0  success, or nothing to do
+**   *  errno from fdatasync() or fsync()
+*/
+int
+sync_file_sink (file_sink_t *fs)
+{
+	int status = 0;
+
+	if (!fs->dirty) return 0;
+	if (fs->sync == FILE_SYNC_DATA) status = fdatasync (fs->fd);
+	else if (fs->sync == FILE_SYNC_FULL) status = fsync (fs->fd);
+	if (status == -1) return errno;
+	fs->dirty = 0;
+	return 0;
+}
+
+
+/**********************************************************************
+** close_file_sink ()
+*/
+void
+close_file_sink (file_sink_t *fs)
+{
+	if (fs->fd == -1) return;
+	close (fs->fd);
+	fs->fd = -1;
+}
@@ -0,0 +1,85 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _FILE_SINK_H_ /* Brackets this whole file */
+#define _FILE_SINK_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include "buffer.h"
+
+/* the log handler arg 0 that picks the built-in sink: "log @file path" */
+#define FILE_SINK_NAME "@file"
+
+/* what sync_file_sink() does */
+#define FILE_SYNC_NONE 0        /* nothing; the kernel writes back */
+#define FILE_SYNC_DATA 1        /* fdatasync() */
+#define FILE_SYNC_FULL 2        /* fsync() */
+
+/* iovecs per writev(), a timestamp and a line each (IOV_MAX is 1024) */
+#define FILE_SINK_IOV 1024
+
+/* an unfinished line this long is written out without waiting for more */
+#define FILE_SINK_LINE_MAX (64 * 1024)
+
+/* "2016-01-02T03:04:05+0000 " and then some */
+#define FILE_SINK_STAMP 32
+
+/*
+** A file opened O_APPEND, written one whole line at a time, each line
+** prefixed with the UTC time it was written, as hm-test-logger.sh
+** does. The prefix is only formatted again when the second changes.
+*/
+typedef struct
+file_sink_struct
+{
+	int fd;
+	int sync;               /* FILE_SYNC_NONE and so on */
+	long long sync_every;   /* ms between syncs; 0 after every write */
+	int dirty;              /* written to since the last sync */
+	int mid_line;           /* the last byte written was not a newline */
+	time_t stamp_at;        /* the second stamp is for */
+	char stamp[FILE_SINK_STAMP];
+	size_t stamp_len;
+	struct iovec iov[FILE_SINK_IOV];
+}
+file_sink_t;
+
+extern int open_file_sink (file_sink_t*, const char*, int, long long);
+extern ssize_t write_file_sink (file_sink_t*, char_buffer_t*, int);
+extern int sync_file_sink (file_sink_t*);
+extern void close_file_sink (file_sink_t*);
+
+#endif /* _FILE_SINK_H_ Brackets this whole file */
@@ -0,0 +1,211 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "buffer.h"
+#include "file_sink.h"
+
+
+static char path[] = "/tmp/file_sink_test.XXXXXX";
+static int reader;              /* the sink's fd is write-only */
+static off_t shown = 0;
+
+
+/*
+** Print what has been added to the file since the last call, with
+** each whole timestamp shown as <T>; new lines are shown as \n.
+*/
+static void
+print_new (file_sink_t *fs)
+{
+	char text[256];
+	ssize_t n;
+	char *p;
+
+	n = pread (reader, text, sizeof (text) - 1, shown);
+	if (n < 0) err (errno, "ERROR: pread");
+	text[n] = '\0';
+	shown += n;
+	printf ("File got: ");
+	for (p = text; p < text + n; p++)
+	{
+		if ((size_t)(text + n - p) >= fs->stamp_len
+		 && memcmp (p, fs->stamp, fs->stamp_len) == 0)
+		{
+			printf ("<T>");
+			p += fs->stamp_len - 1;
+		}
+		else if (*p == '\n') printf ("\\n");
+		else putchar (*p);
+	}
+	printf ("\n");
+}
+
+
+static void
+write_sink (file_sink_t *fs, char_buffer_t *buf, int all)
+{
+	ssize_t n = write_file_sink (fs, buf, all);
+
+	printf ("Consumed %zd, left %zu, mid_line %d\n", n,
+	 get_char_buffer_contlen (buf), fs->mid_line);
+}
+
+
+/*
+** Let the file grow only to limit bytes; writes past it come up short.
+*/
+static void
+limit_file (rlim_t limit)
+{
+	struct rlimit rl;
+
+	getrlimit (RLIMIT_FSIZE, &rl);
+	rl.rlim_cur = limit;
+	if (setrlimit (RLIMIT_FSIZE, &rl) != 0) err (errno, "ERROR: setrlimit");
+}
+
+
+int
+main ()
+{
+	file_sink_t *fs = calloc (1, sizeof (file_sink_t));
+	char_buffer_t *buf = calloc (1, sizeof (char_buffer_t));
+	char_buffer_t *big = calloc (1, sizeof (char_buffer_t));
+	struct rlimit rl;
+	char *longline;
+	int fd;
+
+	if ((fd = mkstemp (path)) == -1) err (errno, "ERROR: mkstemp");
+	close (fd);
+	if ((reader = open (path, O_RDONLY)) == -1) err (errno, "ERROR: open");
+	signal (SIGXFSZ, SIG_IGN);
+	getrlimit (RLIMIT_FSIZE, &rl);
+
+	printf ("==== #010 Opening the sink ====\n");
+	if (open_file_sink (fs, path, FILE_SYNC_DATA, 0) != 0)
+	{ err (errno, "ERROR: open_file_sink"); }
+	if (create_char_buffer (buf, 32) != 0)
+	{ err (errno, "ERROR: create_char_buffer"); }
+	printf ("Ring size: %zu\n", get_char_buffer_size (buf));
+	printf ("\n");
+
+	printf ("==== #020 Nothing buffered (expect 0) ====\n");
+	write_sink (fs, buf, 0);
+	printf ("\n");
+
+	printf ("==== #030 Two lines and a partial one (expect <T>a\\n<T>bb\\n, cc left) ====\n");
+	append_to_char_buffer (buf, "a\nbb\ncc");
+	write_sink (fs, buf, 0);
+	print_new (fs);
+	printf ("\n");
+
+	printf ("==== #040 Partial line finished (expect <T>cc-wrapped-around-the-end\\n) ====\n");
+	append_to_char_buffer (buf, "-wrapped-around-the-end\nnext");
+	write_sink (fs, buf, 0);
+	print_new (fs);
+	printf ("Sync: %d\n", sync_file_sink (fs));
+	printf ("Dirty after: %d\n", fs->dirty);
+	printf ("\n");
+
+	printf ("==== #050 Line across the ring's end, cut short (expect <T>nextli, then ne\\n without <T>) ====\n");
+	append_to_char_buffer (buf, "line\n");
+	limit_file (shown + fs->stamp_len + 6);
+	write_sink (fs, buf, 0);
+	print_new (fs);
+	limit_file (rl.rlim_cur);
+	write_sink (fs, buf, 0);
+	print_new (fs);
+	printf ("\n");
+
+	printf ("==== #060 Short write within the stamp (expect 5 bytes, then x\\n without <T>) ====\n");
+	append_to_char_buffer (buf, "x\n");
+	limit_file (shown + 5);
+	write_sink (fs, buf, 0);
+	printf ("File got %lld bytes\n",
+	 (long long)(lseek (reader, 0, SEEK_END) - shown));
+	shown += 5;
+	limit_file (rl.rlim_cur);
+	write_sink (fs, buf, 0);
+	print_new (fs);
+	printf ("\n");
+
+	printf ("==== #070 Unfinished line with all (expect <T>tail\\n, mid_line 0) ====\n");
+	append_to_char_buffer (buf, "tail");
+	write_sink (fs, buf, 0);
+	write_sink (fs, buf, 1);
+	print_new (fs);
+	printf ("\n");
+
+	printf ("==== #080 Line of FILE_SINK_LINE_MAX bytes (expect it written without \\n, mid_line 1) ====\n");
+	if (create_char_buffer (big, 2 * FILE_SINK_LINE_MAX) != 0)
+	{ err (errno, "ERROR: create_char_buffer"); }
+	longline = malloc (FILE_SINK_LINE_MAX);
+	memset (longline, 'y', FILE_SINK_LINE_MAX);
+	append_bytes_to_char_buffer (big, longline, FILE_SINK_LINE_MAX - 1);
+	write_sink (fs, big, 0);
+	append_bytes_to_char_buffer (big, longline, 1);
+	write_sink (fs, big, 0);
+	printf ("File got %lld bytes\n",
+	 (long long)(lseek (reader, 0, SEEK_END) - shown));
+	shown = lseek (reader, 0, SEEK_END);
+	printf ("\n");
+
+	printf ("==== #090 The rest of that line (expect end\\n without <T>) ====\n");
+	append_to_char_buffer (big, "end\n");
+	write_sink (fs, big, 0);
+	print_new (fs);
+	printf ("\n");
+
+	printf ("==== #100 Closing the sink ====\n");
+	close_file_sink (fs);
+	printf ("fd: %d\n", fs->fd);
+	close (reader);
+	destroy_char_buffer (buf);
+	destroy_char_buffer (big);
+	free (longline);
+	free (buf);
+	free (big);
+	free (fs);
+	unlink (path);
+	return 0;
+}
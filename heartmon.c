@@ -29,6 +29,95 @@
 **            - added fifo handling
 **            - added signal handling for SIGTERM
 **            - added killing of app and log hander in shutdown_handler()
+** 2026-10-17
+**            - log stream buffer is a ring buffer now; partial writes
+**              consume only what was written and nothing is resent
+**            - heartbeat search is incremental (line_scanner.c); only
+**              newly read bytes are examined, by length not strlen
+**            - io_select.c replaced by an epoll event loop
+**              (event_loop.c); sources are drained as soon as they
+**              are readable and the logger pipe is only watched for
+**              EPOLLOUT while output is pending
+**            - child exits arrive through a signalfd for SIGCHLD;
+**              every exited child is reaped and the app or logger
+**              is re-spawned in the same wakeup
+**            - thresholds are milliseconds on CLOCK_MONOTONIC and
+**              are enforced by a timerfd armed for the next deadline,
+**              instead of comparing time(NULL) once per loop pass
+**            - log stream I/O moved to log_stream.c; optional
+**              zero-copy forwarding (-z) with splice() and tee()
+**            - -i and -e may be given many times; all filters are
+**              compiled into one Aho-Corasick automaton (ac_matcher.c)
+**            - the filter scan skips to the next newline or filter
+**              candidate 16 or 32 bytes at a time with SSE2 or AVX2,
+**              picked at run time (candidate_scan.c); scan_bench
+**              measures it
+**            - -E makes the filters extended regular expressions,
+**              compiled once into a DFA (regex_dfa.c)
+**            - -m supervises every service directory under one parent
+**              from a single event loop; each has its own log stream,
+**              filters, thresholds and timer, and may override the
+**              command-line options in an opts/ directory
+**            - -t spreads the services over worker threads, each with
+**              its own event loop (worker_pool.c); a saturated worker
+**              hands its quieter services to the least busy one
+**            - a source is drained DRAIN_BUDGET bytes at a time, so a
+**              log flood cannot starve the rest of its event loop
+**            - log forwarding runs on I/O threads and supervision
+**              (spawning, killing, reaping, timers, syslog) on the main
+**              thread; heartbeats reach it through a lock-free
+**              single-producer/single-consumer ring (spsc_ring.c)
+**            - children are started with posix_spawn() instead of
+**              fork(); a failed exec is reported to the caller, and all
+**              pipes and fifos are close-on-exec so a child inherits
+**              only its own stdin, stdout and stderr
+**            - a child that keeps exiting is re-spawned after an
+**              exponential backoff with jitter, on a timerfd, and is
+**              reported as crash-looping (restart_policy.c); -b tunes
+**              the policy
+**            - -s keeps a warm standby instance of the app, ready once
+**              its log shows the ready filter; a restart promotes it
+**              instead of waiting for a cold start
+**            - listening sockets in a sockets/ config are opened once
+**              and passed to every app instance on fds 3 and up with
+**              LISTEN_FDS and LISTEN_PID (listen_socket.c); children
+**              are started with vfork(), which lets LISTEN_PID be set
+**            - children are stopped with SIGTERM and SIGCONT to their
+**              process group, then SIGKILL after a grace period (-g),
+**              on timers; a re-spawn waits until the old one is reaped,
+**              and on SIGTERM heartmon waits for all of them, giving
+**              each log handler EOF first, before it exits
+**            - a service may be configured by a single config file
+**              instead of a directory (config.c), options included;
+**              either is read once into one block, with no limit on
+**              the length or number of args
+**            - configs are reloaded on SIGHUP or when edited (inotify);
+**              filters, thresholds and options change in place, fifos
+**              are opened or closed as listed, and the app or log
+**              handler is only re-spawned if its command line changed
+**            - -M serves counters in the Prometheus text format on a
+**              socket (text_server.c), rendered on the supervisor loop;
+**              the I/O threads keep theirs in the log streams, and each
+**              event loop times its handlers
+**            - -P profiles wakeups, supervisor phases and stream phases
+**              into log-linear histograms (latency_hist.c), dumped to
+**              syslog every -P seconds and on SIGUSR1
+**            - USDT probes (probes.h) on source reads, log handler
+**              writes, heartbeats, spawns and thresholds, when built
+**              with <sys/sdt.h>
+**            - -C takes commands on a control socket (text_server.c):
+**              status, restart, thresholds, pause/resume of threshold
+**              enforcement and flush, carried out on the supervisor
+**              loop
+**            - heartmon's own messages go through a preallocated ring
+**              (self_log.c): they are injected into the service's log
+**              stream at a line boundary, and copied to syslog by a
+**              background thread (-q keeps only startup and critical
+**              ones), so syslog can never block the supervisor
+**            - built-in file sink (log @file, file_sink.c) in place
+**              of a log handler: line-framed writev() batches with a
+**              cached per-second timestamp prefix, O_APPEND, and
+**              fdatasync/fsync after each write or every so often
 ** 
 ** Copyright (c) 2016, Kris Feldmann
 ** All rights reserved.
@@ -70,27 +159,252 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
 #include <time.h>
 //#include <malloc/malloc.h>
 #include <malloc.h>
 #include <signal.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
 #include "fifos.h"
-#include "io_select.h"
+#include "event_loop.h"
 #include "buffer.h"
+#include "candidate_scan.h"
 #include "spawn_process.h"
+#include "line_scanner.h"
+#include "log_stream.h"
+#include "worker_pool.h"
+#include "restart_policy.h"
+#include "listen_socket.h"
+#include "config.h"
+#include "text_server.h"
+#include "latency_hist.h"
+#include "probes.h"
+#include "self_log.h"
+#include "file_sink.h"
 
 #define MAXSTRLEN 128
-#define MAXARGS 64
-#define MAXFDS 32
-#define BUFFERSIZE 8192
+#define MAXFILTERS 256
+#define MAXTHREADS 256
 
-#define SELECT_TIMEOUT_SEC 1
+/*
+** I/O thread rebalancing (-t): once a second, a thread that was busy
+** for SATURATED_PCT of the time and has more than one service hands
+** its quietest one to the least busy thread, if that one is under
+** IDLE_PCT. A log flood ends up with a thread to itself.
+*/
+#define REBALANCE_MS 1000
+#define SATURATED_PCT 80
+#define IDLE_PCT 50
+
+/* config edits arriving within this long are applied together */
+#define RELOAD_DELAY_MS 200
+
+/* inotify watches per service: a config file's directory, or a config
+   directory and its app/, log/, opts/, fifo/ and sockets/ */
+#define MAXCONFWATCHES 6
 
 #define SYSLOG_IDENT "heartmon"
 
+/* what an I/O thread reports, in place of a heartbeat time, once it
+   has closed a service's log file (log @file) at shutdown */
+#define LOG_FILE_CLOSED -1
+
+/* control socket (-C) commands, and words in a request, command included */
+#define CONTROL_COMMANDS 7
+#define CONTROL_WORDS 8
+
+/* what the supervisor spends its time on, when profiling (-P) */
+#define SV_REAP 0                /* reaping and re-spawning children */
+#define SV_TIMERS 1              /* thresholds, stop stages, re-spawns */
+#define SV_HEARTBEATS 2          /* taking them from the I/O threads */
+#define SV_SPAWN 3               /* spawn_process(), within the others */
+#define SV_PHASES 4
+
+/*
+** Command-line options. In multi-service mode (-m) they are the
+** defaults for every service, and each service's opts/ directory can
+** override them.
+*/
+typedef struct
+options_struct
+{
+	char *in_filters[MAXFILTERS];
+	char *ex_filters[MAXFILTERS];
+	int in_count;
+	int ex_count;
+	int use_regex;
+	int zero_copy;
+	long long warn_thresh;       /* thresholds in milliseconds */
+	long long crit_thresh;
+	long long restart_thresh;
+	restart_policy_t restart;    /* when to re-spawn an exited child */
+	char *ready_filter;          /* keep a warm standby (-s) */
+	long long stop_grace;        /* from SIGTERM to SIGKILL (-g) */
+}
+options_t;
+
+/*
+** Stopping a child, DJB style: SIGTERM and SIGCONT to its process
+** group, so a stopped process gets the TERM too; SIGKILL if it is
+** still there after the grace period. A log handler is first only
+** sent EOF, so it can write out the last of the logs, and gets the
+** same treatment a grace period later.
+*/
+#define STOP_NONE 0
+#define STOP_EOF 1                /* stdin closed */
+#define STOP_TERM 2               /* SIGTERM + SIGCONT sent */
+#define STOP_KILL 3               /* SIGKILL sent */
+
+typedef struct
+child_stop_struct
+{
+	int stage;
+	long long next_at;           /* monotonic ms of the next stage, or 0 */
+}
+child_stop_t;
+
+/*
+** One supervised app and its log handler: what the child handler
+** needs to re-spawn either of them in the same wakeup as their exit,
+** and the heartbeat state it resets when it does. Every service has
+** its own log stream, filters, thresholds and timer. The log stream
+** is a unit of one I/O thread and only ever touched there; the rest
+** belongs to the supervisor thread.
+*/
+typedef struct
+supervisor_struct
+{
+	char *name;                  /* service name, or "" */
+	char *confdir;               /* config directory or file */
+	config_t config;             /* argv, fifos, sockets, opts */
+	options_t opts;
+	char *fifo_paths[MAXSOURCES]; /* open in ls.fifos[i], or NULL */
+	int config_wds[MAXCONFWATCHES]; /* inotify watches on the config */
+	int nconfig_wds;
+	int config_is_dir;
+	int reload_pending;          /* config changed; see on_reload_event() */
+	int listen_fds[MAXLISTEN];   /* passed to every app instance */
+	int nlisten;
+	pid_t apppid;
+	pid_t logpid;
+	int log_file_open;           /* the built-in sink is in use, not logpid */
+	log_stream_t ls;
+	int app_killed;              /* re-spawn when it has been reaped */
+	int app_replaced;            /* ... at once: its config changed */
+	int log_killed;              /* the same, for the other two */
+	int standby_killed;
+	int app_status;              /* wait status of the last app exit */
+	int log_status;              /* wait status of the last logger exit */
+	event_watch_t timer_watch;   /* timerfd for the next deadline */
+	long long armed_deadline;    /* what the timerfd is set to, or 0 */
+	long long min_thresh;
+	long long last_heartbeat;    /* CLOCK_MONOTONIC milliseconds */
+	int warn_has_been_triggered;
+	int crit_has_been_triggered;
+	int paused;                  /* thresholds not enforced (-C pause) */
+	int thresholds_set;          /* changed over -C, until reset/reload */
+	long long config_thresh[3];  /* warn, crit and restart before that */
+	restart_backoff_t app_backoff;
+	restart_backoff_t log_backoff;
+	restart_backoff_t standby_backoff;
+	long long app_restart_at;    /* monotonic ms, or 0 if not waiting */
+	long long log_restart_at;
+	long long standby_restart_at;
+	child_stop_t app_stop;
+	child_stop_t retired_stop;
+	child_stop_t standby_stop;
+	child_stop_t log_stop;
+	event_watch_t restart_watch; /* timerfd for the next re-spawn/stop */
+	pid_t standbypid;            /* warm standby app (-s), or -1 */
+	pid_t retiredpid;            /* app replaced by it, until reaped */
+	int standby_ready;           /* its ready line has been seen */
+	int standby_generation;      /* counts standbys spawned */
+	int standby_ls_generation;   /* the one standby_ls reads from */
+	log_stream_t standby_ls;     /* standby output, to the logger too */
+	worker_unit_t unit;          /* the I/O thread running both streams */
+	unsigned long long bytes_sampled; /* ls.bytes_in at last rebalance */
+	unsigned long long warn_triggers;  /* counts for the metrics (-M) */
+	unsigned long long crit_triggers;
+	unsigned long long restart_triggers;
+	unsigned long long app_starts;
+	unsigned long long log_starts;
+	unsigned long long promotions;
+}
+supervisor_t;
+
 /* globals */
-pid_t apppid = -1;
-pid_t logpid = -1;
+supervisor_t **services = NULL;
+int nservices = 0;
+event_watch_t child_watch;       /* signalfd for SIGCHLD */
+event_watch_t term_watch;        /* signalfd for SIGTERM */
+int shutting_down = 0;           /* stopping everything, then exit */
+options_t default_opts;          /* from the command line */
+event_watch_t hup_watch;         /* signalfd for SIGHUP */
+event_watch_t inotify_watch;     /* config edits */
+event_watch_t reload_watch;      /* timerfd for on_reload_event() */
+worker_t *workers = NULL;        /* I/O threads */
+int nworkers = 0;
+event_watch_t rebalance_watch;   /* timerfd for rebalance_workers() */
+text_server_t metrics_server;    /* -M */
+text_server_t control_server;    /* -C */
+latency_hist_t *supervisor_profile = NULL; /* SV_PHASES of them, with -P */
+long long profile_every = 0;     /* ms between profile dumps, or 0 */
+event_watch_t usr1_watch;        /* signalfd for SIGUSR1 */
+event_watch_t profile_watch;     /* timerfd for on_profile_event() */
+event_watch_t *self_log_watches = NULL; /* per I/O thread; see main() */
+
+/* new pipe ends for the I/O thread to swap into a log stream */
+typedef struct
+pipe_handoff_struct
+{
+	supervisor_t *sv;
+	int fd[2];
+	pid_t pid;                   /* the child at the other end */
+	int generation;              /* sv->standby_generation when sent */
+}
+pipe_handoff_t;
+
+/* new log files for the I/O thread to swap in, for both streams */
+typedef struct
+file_handoff_struct
+{
+	supervisor_t *sv;
+	file_sink_t *files[2];       /* the app's, then the standby's */
+}
+file_handoff_t;
+
+/* a fifo for the I/O thread to start or stop reading, in ls.fifos[] */
+typedef struct
+fifo_handoff_struct
+{
+	supervisor_t *sv;
+	int slot;
+	int fd;                      /* -1 to stop reading it */
+}
+fifo_handoff_t;
+
+/* reloaded settings for the I/O thread to take up */
+typedef struct
+stream_settings_struct
+{
+	supervisor_t *sv;
+	line_scanner_t *scanner;     /* new heartbeat filters, or NULL */
+	int ready_changed;
+	line_scanner_t *ready_scanner; /* new ready filter, or NULL for none */
+	int scanning;
+	long long scan_window;
+}
+stream_settings_t;
 
 
 /**********************************************************************
@@ -106,220 +420,3419 @@ void
 usage (char *appname)
 {
 	fprintf (stderr,
-	 "Usage: %s -d heartmon_config_directory \\\n", appname);
+	 "Usage: %s -d heartmon_config [-M metrics_socket] [-P seconds] \\\n",
+	 appname);
+	fprintf (stderr,
+	 "       [-C control_socket] [-q] [-i include_filter] [-e exclude_filter]"
+	 " \\\n");
+	fprintf (stderr,
+	 "       [-E] [-w warn_seconds] [-c crit_seconds] [-r restart_seconds]"
+	 " \\\n");
+	fprintf (stderr,
+	 "       [-b backoff] [-s ready_filter] [-g grace_seconds] [-z]\n");
 	fprintf (stderr,
-	 "       [-i include_filter] [-e exclude_filter] \\\n");
+	 "   or: %s -m services_directory [-t threads] [options as above]\n",
+	 appname);
 	fprintf (stderr,
-	 "       [-w warn_seconds] [-c crit_seconds] [-r restart_seconds]\n");
+	 "Thresholds may be fractional (2.5) or in milliseconds (250ms).\n");
+	fprintf (stderr,
+	 "With -E, filters are extended regular expressions.\n");
+	fprintf (stderr,
+	 "backoff is a list of initial=,max=,multiplier=,jitter=,stable=,loop=\n"
+	 "(e.g. initial=0.1,max=30,multiplier=2,jitter=10,stable=10,loop=5/60).\n");
 	exit (EXIT_FAILURE);
 }
 
 
 /**********************************************************************
-** set_str_optarg ()
-** 
-** Copy value of global variable `optarg' into string `var'.
-** The `var_name' string is used in the error messaging.
+** service_syslog ()
+**
+** self_log() on behalf of one service: into its own log stream, and
+** to syslog prefixed with the service's name in multi-service mode.
+** %m works as usual.
+*/
+void
+service_syslog (supervisor_t *sv, int priority, const char *format, ...)
+{
+	char message[1024];
+	va_list ap;
+
+	va_start (ap, format);
+	vsnprintf (message, sizeof (message), format, ap);
+	va_end (ap);
+	self_log_for (sv, sv->name, priority, "%s", message);
+}
+
+
+/**********************************************************************
+** set_str_optarg ()
+** 
+** Copy value of global variable `optarg' into string `var'.
+** The `var_name' string is used in the error messaging.
+** 
+** Returns -1, after logging why, if `optarg' contains a string
+** longer than MAXSTRLEN; 0 otherwise.
+*/
+int
+set_str_optarg (char *var, const char *var_name)
+{
+	/* char *optarg - a global from unistd.h */
+	/* MAXSTRLEN - a global constant defined in the top of this file */
+
+	if (strlen (optarg) < MAXSTRLEN) strcpy (var, optarg);
+	else
+	{
+		self_log (LOG_ALERT, "%s length cannot be longer than %d bytes.",
+		 var_name, MAXSTRLEN - 1 );
+		return -1;
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** add_filter_optarg ()
+** 
+** Append the global variable `optarg' to a list of filters. The
+** string itself is not copied; it lives in argv.
+** 
+** Returns -1, after logging why, if there are already MAXFILTERS
+** filters in the list; 0 otherwise.
+*/
+int
+add_filter_optarg (char **filters, int *count, const char *var_name)
+{
+	/* char *optarg - a global from unistd.h */
+	/* MAXFILTERS - a global constant defined in the top of this file */
+
+	if (*count < MAXFILTERS) filters[(*count)++] = optarg;
+	else
+	{
+		self_log (LOG_ALERT, "No more than %d %ss may be given.",
+		 MAXFILTERS, var_name);
+		return -1;
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** parse_millis ()
+** 
+** Parse a duration given in seconds into milliseconds. Accepts whole
+** seconds ("3"), fractional seconds down to the millisecond ("2.5",
+** "0.250"), or milliseconds with an "ms" suffix ("250ms").
+** 
+** Return values:
+**   0  success; *ms holds the duration
+**  -1  not a duration
+*/
+int
+parse_millis (const char *str, long long *ms)
+{
+	char *end;
+	long long whole, frac = 0;
+	int digits = 0;
+
+	if (*str < '0' || *str > '9') return -1;
+	whole = strtoll (str, &end, 10);
+	if (strcmp (end, "ms") == 0)
+	{
+		*ms = whole;
+		return 0;
+	}
+	if (*end == '.')
+	{
+		for (end++; *end >= '0' && *end <= '9'; end++)
+		{
+			if (digits++ < 3) frac = frac * 10 + (*end - '0');
+		}
+		for (; digits < 3; digits++) frac *= 10;
+	}
+	if (*end != '\0') return -1;
+	*ms = whole * 1000 + frac;
+	return 0;
+}
+
+
+/**********************************************************************
+** set_millis_optarg ()
+** 
+** Parse the duration in global variable `optarg' into `var'.
+** The `var_name' string is used in the error messaging.
+** 
+** Returns -1, after logging why, if `optarg' is not a duration;
+** 0 otherwise.
+*/
+int
+set_millis_optarg (long long *var, const char *var_name)
+{
+	/* char *optarg - a global from unistd.h */
+
+	if (parse_millis (optarg, var) != 0)
+	{
+		self_log (LOG_ALERT,
+		 "%s must be seconds (e.g. 3 or 2.5) or milliseconds (e.g. 250ms).",
+		 var_name);
+		return -1;
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** set_backoff_optarg ()
+** 
+** Parse the restart policy in global variable `optarg' into policy:
+** a comma-separated list of key=value, where initial, max and stable
+** are durations, multiplier a number of at least 1, jitter a
+** percentage and loop restarts/window (e.g. 5/60). Keys left out keep
+** their value.
+** 
+** Returns -1, after logging why, on a bad policy; 0 otherwise.
+*/
+int
+set_backoff_optarg (restart_policy_t *policy)
+{
+	/* char *optarg - a global from unistd.h */
+	char spec[MAXSTRLEN];
+	char *item, *value, *end;
+	char *save = NULL;
+	int ok;
+
+	if (set_str_optarg (spec, "backoff") != 0) return -1;
+	for (item = strtok_r (spec, ",", &save); item != NULL;
+	 item = strtok_r (NULL, ",", &save))
+	{
+		ok = 0;
+		if ((value = strchr (item, '=')) != NULL)
+		{
+			*value++ = '\0';
+			if (strcmp (item, "initial") == 0)
+			{ ok = parse_millis (value, &policy->initial_ms) == 0; }
+			else if (strcmp (item, "max") == 0)
+			{ ok = parse_millis (value, &policy->max_ms) == 0; }
+			else if (strcmp (item, "stable") == 0)
+			{ ok = parse_millis (value, &policy->stable_ms) == 0; }
+			else if (strcmp (item, "multiplier") == 0)
+			{
+				policy->multiplier = strtod (value, &end);
+				ok = (*end == '\0' && policy->multiplier >= 1.0);
+			}
+			else if (strcmp (item, "jitter") == 0)
+			{
+				policy->jitter_pct = strtol (value, &end, 10);
+				ok = (*end == '\0' && policy->jitter_pct >= 0
+				 && policy->jitter_pct <= 100);
+			}
+			else if (strcmp (item, "loop") == 0)
+			{
+				policy->loop_restarts = strtol (value, &end, 10);
+				ok = (*end == '/' && policy->loop_restarts >= 0
+				 && policy->loop_restarts <= MAX_LOOP_RESTARTS
+				 && parse_millis (end + 1, &policy->loop_window_ms) == 0);
+			}
+		}
+		if (!ok)
+		{
+			self_log (LOG_ALERT, "Bad backoff setting [%s]; see usage.", item);
+			return -1;
+		}
+	}
+	if (policy->max_ms < policy->initial_ms)
+	{
+		policy->max_ms = policy->initial_ms;
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** uses_log_file ()
+** 
+** Whether a config has the log go to the built-in sink (log @file)
+** rather than to a log handler.
+*/
+int
+uses_log_file (config_t *cfg)
+{
+	return strcmp (cfg->log.items[0], FILE_SINK_NAME) == 0;
+}
+
+
+/**********************************************************************
+** parse_log_file ()
+** 
+** Take the built-in sink's settings from its log config: @file, the
+** path of the file, and then, if given, sync=none|data|full and
+** every=duration (0, the default, syncs after every write).
+** 
+** Returns -1, after logging why, on a bad setting; 0 otherwise.
+*/
+int
+parse_log_file (supervisor_t *sv, char **args, const char **path,
+ int *sync, long long *every)
+{
+	/* in the order of FILE_SYNC_NONE, FILE_SYNC_DATA and FILE_SYNC_FULL */
+	static const char *syncs[] = { "none", "data", "full" };
+	int i, j;
+
+	*sync = FILE_SYNC_NONE;
+	*every = 0;
+	if ((*path = args[1]) == NULL)
+	{
+		service_syslog (sv, LOG_ERR, "%s must be followed by a path.",
+		 FILE_SINK_NAME);
+		return -1;
+	}
+	for (i = 2; args[i] != NULL; i++)
+	{
+		if (strncmp (args[i], "sync=", 5) == 0)
+		{
+			for (j = 0; j < 3 && strcmp (args[i] + 5, syncs[j]) != 0; j++)
+			{ ; }
+			if (j < 3)
+			{
+				*sync = j;
+				continue;
+			}
+		}
+		else if (strncmp (args[i], "every=", 6) == 0
+		 && parse_millis (args[i] + 6, every) == 0)
+		{ continue; }
+		service_syslog (sv, LOG_ERR,
+		 "Bad log file setting [%s]; use sync=none|data|full or every=seconds.",
+		 args[i]);
+		return -1;
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** parse_options ()
+** 
+** Parse heartmon options from argv into opts. -d, -m, -t, -M, -P, -C
+** and -q are only accepted where confdir, servicesdir, threads,
+** metrics, profile, control and quiet are given (the command line).
+** The first -i or -e seen replaces any filters already in opts, so a
+** service can override the command line's.
+** 
+** Returns -1, after logging why, on a bad option; 0 otherwise. opts
+** may have been changed either way.
+*/
+int
+parse_options (options_t *opts, int argc, char **argv,
+ char *confdir, char *servicesdir, int *threads, char *metrics,
+ long long *profile, char *control, int *quiet)
+{
+	char *end;
+	char opt;
+	int in_given = 0;
+	int ex_given = 0;
+	int status = 0;
+
+	optind = 1;
+	while (status == 0
+	 && (opt = getopt (argc, argv, "i:e:Ew:c:r:d:m:t:M:P:C:qb:s:g:z")) != -1)
+	{
+		if ((opt == 'd' && confdir == NULL)
+		 || (opt == 'm' && servicesdir == NULL)
+		 || (opt == 't' && threads == NULL)
+		 || (opt == 'M' && metrics == NULL)
+		 || (opt == 'P' && profile == NULL)
+		 || (opt == 'C' && control == NULL)
+		 || (opt == 'q' && quiet == NULL))
+		{
+			self_log (LOG_ALERT, "-%c is only accepted on the command line.",
+			 opt);
+			status = -1;
+			break;
+		}
+		switch (opt)
+		{
+			case 'i':
+				if (!in_given++) opts->in_count = 0;
+				status = add_filter_optarg (opts->in_filters,
+				 &opts->in_count, "include filter");
+				break;
+			case 'e':
+				if (!ex_given++) opts->ex_count = 0;
+				status = add_filter_optarg (opts->ex_filters,
+				 &opts->ex_count, "exclude filter");
+				break;
+			case 'E':
+				opts->use_regex = 1;
+				break;
+			case 'd':
+				status = set_str_optarg (confdir, "heartmon config");
+				break;
+			case 'm':
+				status = set_str_optarg (servicesdir, "services directory");
+				break;
+			case 't':
+				*threads = strtol (optarg, &end, 10);
+				if (*end != '\0' || *threads < 1 || *threads > MAXTHREADS)
+				{
+					self_log (LOG_ALERT,
+					 "Threads must be a number from 1 to %d.", MAXTHREADS);
+					status = -1;
+				}
+				break;
+			case 'M':
+				status = set_str_optarg (metrics, "metrics socket");
+				if (status == 0 && *metrics != '/')
+				{
+					self_log (LOG_ALERT,
+					 "The metrics socket must be an absolute path.");
+					status = -1;
+				}
+				break;
+			case 'P':
+				status = set_millis_optarg (profile, "profile interval");
+				break;
+			case 'C':
+				status = set_str_optarg (control, "control socket");
+				if (status == 0 && *control != '/')
+				{
+					self_log (LOG_ALERT,
+					 "The control socket must be an absolute path.");
+					status = -1;
+				}
+				break;
+			case 'q':
+				*quiet = 1;
+				break;
+			case 'w':
+				status = set_millis_optarg (&opts->warn_thresh,
+				 "warn threshold");
+				break;
+			case 'c':
+				status = set_millis_optarg (&opts->crit_thresh,
+				 "crit threshold");
+				break;
+			case 'r':
+				status = set_millis_optarg (&opts->restart_thresh,
+				 "restart threshold");
+				break;
+			case 'b':
+				status = set_backoff_optarg (&opts->restart);
+				break;
+			case 's':
+				opts->ready_filter = optarg;
+				break;
+			case 'g':
+				status = set_millis_optarg (&opts->stop_grace,
+				 "grace period");
+				break;
+			case 'z':
+				opts->zero_copy = 1;
+				break;
+			default: /* '?' */
+				status = -1;
+		}
+	}
+	return status;
+}
+
+
+/**********************************************************************
+** min_non0_of3 ()
+*/ 
+long long
+min_non0_of3 (long long a, long long b, long long c)
+{
+	long long m;
+	if (a == 0 && b == 0 && c == 0) return 0;
+	if (a != 0) m = a;
+	else if (b != 0) m = b;
+	else if (c != 0) m = c;
+	if (a != 0 && a < m) m = a;
+	if (b != 0 && b < m) m = b;
+	if (c != 0 && c < m) m = c;
+	return m;
+}
+
+
+/**********************************************************************
+** profile_start ()
+**
+** When a supervisor phase begins, with -P; without it, this and
+** profile_end() cost one test.
+*/
+unsigned long long
+profile_start (void)
+{
+	return supervisor_profile ? monotonic_ns () : 0;
+}
+
+
+/**********************************************************************
+** profile_end ()
+*/
+void
+profile_end (int phase, unsigned long long started)
+{
+	if (supervisor_profile == NULL) return;
+	record_latency (&supervisor_profile[phase], monotonic_ns () - started);
+}
+
+
+/**********************************************************************
+** signal_group ()
+** 
+** Send signo to the process group of a child (each is the leader of
+** its own). One that is gone already is not an error.
+*/
+void
+signal_group (supervisor_t *sv, pid_t pid, int signo)
+{
+	if (pid > 0 && kill (-pid, signo) != 0 && errno != ESRCH)
+	{
+		service_syslog (sv, LOG_WARNING, "kill(-%d,%s) failed: %m",
+		 pid, strsignal (signo));
+	}
+}
+
+
+/**********************************************************************
+** shutdown_handler ()
+** 
+** atexit() handler. A normal stop has waited for every child already;
+** when heartmon exits on an error, they are sent SIGTERM (and SIGCONT)
+** and left to it.
+*/ 
+void
+shutdown_handler ()
+{
+	supervisor_t *sv;
+	pid_t *pids[4];
+	int i, j;
+
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		pids[0] = &sv->apppid;
+		pids[1] = &sv->standbypid;
+		pids[2] = &sv->retiredpid;
+		pids[3] = &sv->logpid;
+		for (j = 0; j < 4; j++)
+		{
+			if (*pids[j] == -1) continue;
+			signal_group (sv, *pids[j], SIGTERM);
+			signal_group (sv, *pids[j], SIGCONT);
+			service_syslog (sv, LOG_INFO, "Stopped [%d].", *pids[j]);
+		}
+	}
+	self_log (LOG_INFO, "Stopping heartmon.");
+	return ;
+}
+
+
+/**********************************************************************
+** handoff_pipes ()
+** 
+** Have the I/O thread that runs sv's log stream call job with the
+** pipe ends in fd[], and the pid of the child they lead to.
+** 
+** Causes exit on failure.
+*/
+void
+handoff_pipes (supervisor_t *sv, worker_job_t job, pid_t pid, int fd0,
+ int fd1)
+{
+	pipe_handoff_t *handoff;
+
+	handoff = malloc (sizeof (pipe_handoff_t));
+	if (handoff != NULL)
+	{
+		handoff->sv = sv;
+		handoff->fd[0] = fd0;
+		handoff->fd[1] = fd1;
+		handoff->pid = pid;
+		handoff->generation = sv->standby_generation;
+	}
+	if (handoff == NULL
+	 || post_unit_job (&sv->unit, job, handoff) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+}
+
+
+/**********************************************************************
+** swap_app_pipes ()
+** 
+** worker_job_t, on the I/O thread. Collect what the old instance of
+** the app left in its pipes, then watch the new instance's.
+** 
+** Causes exit on failure.
+*/
+void
+swap_app_pipes (worker_t *w, void *arg)
+{
+	pipe_handoff_t *handoff = arg;
+	supervisor_t *sv = handoff->sv;
+	log_stream_t *ls = &sv->ls;
+
+	detach_source (&ls->app_stdout);
+	detach_source (&ls->app_stderr);
+	flush_log_stream (ls);
+	if (attach_source (ls, &ls->app_stdout, handoff->fd[0], 0) != 0
+	 || attach_source (ls, &ls->app_stderr, handoff->fd[1], 0) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to watch application pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	ls->app_stdout.pid = ls->app_stderr.pid = handoff->pid;
+	free (handoff);
+}
+
+
+/**********************************************************************
+** swap_logger_pipe ()
+** 
+** worker_job_t, on the I/O thread. Close the pipe to the previous log
+** handler, or the log files, and send whatever is buffered to the new
+** one, from both the app and the standby. The standby's stream gets
+** its own fd for the pipe even while there is no standby, as a reload
+** may start one.
+** 
+** Causes exit on failure.
+*/
+void
+swap_logger_pipe (worker_t *w, void *arg)
+{
+	pipe_handoff_t *handoff = arg;
+	supervisor_t *sv = handoff->sv;
+
+	int fd;
+
+	detach_file_sink (&sv->ls, 0);
+	detach_file_sink (&sv->standby_ls, 0);
+	detach_sink (&sv->ls);
+	if (attach_sink (&sv->ls, handoff->fd[0]) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to watch log handler pipe: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	detach_sink (&sv->standby_ls);
+	fd = fcntl (handoff->fd[0], F_DUPFD_CLOEXEC, 0);
+	if (fd == -1 || attach_sink (&sv->standby_ls, fd) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to watch log handler pipe for standby: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	sv->ls.sink_pid = sv->standby_ls.sink_pid = handoff->pid;
+	free (handoff);
+}
+
+
+/**********************************************************************
+** swap_log_file ()
+** 
+** worker_job_t, on the I/O thread. Close the pipe to the log handler,
+** or the previous log files, and write whatever is buffered to the new
+** files, from both the app and the standby.
+** 
+** Causes exit on failure.
+*/
+void
+swap_log_file (worker_t *w, void *arg)
+{
+	file_handoff_t *handoff = arg;
+	supervisor_t *sv = handoff->sv;
+
+	detach_sink (&sv->ls);
+	detach_sink (&sv->standby_ls);
+	detach_file_sink (&sv->ls, 0);
+	detach_file_sink (&sv->standby_ls, 0);
+	if (attach_file_sink (&sv->ls, handoff->files[0]) != 0
+	 || attach_file_sink (&sv->standby_ls, handoff->files[1]) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to set up log file: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	sv->ls.sink_pid = sv->standby_ls.sink_pid = 0;
+	free (handoff);
+}
+
+
+/**********************************************************************
+** swap_standby_pipes ()
+** 
+** worker_job_t, on the I/O thread. Collect what a previous standby
+** left in its pipes, then watch the new standby's and scan them for
+** its ready line.
+** 
+** Causes exit on failure.
+*/
+void
+swap_standby_pipes (worker_t *w, void *arg)
+{
+	pipe_handoff_t *handoff = arg;
+	supervisor_t *sv = handoff->sv;
+	log_stream_t *ls = &sv->standby_ls;
+
+	detach_source (&ls->app_stdout);
+	detach_source (&ls->app_stderr);
+	flush_log_stream (ls);
+	sv->standby_ls_generation = handoff->generation;
+	if (ls->scanner != NULL)
+	{
+		reset_line_scanner (ls->scanner);
+		ls->scanning = 1;
+	}
+	if (attach_source (ls, &ls->app_stdout, handoff->fd[0], 0) != 0
+	 || attach_source (ls, &ls->app_stderr, handoff->fd[1], 0) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to watch standby pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	ls->app_stdout.pid = ls->app_stderr.pid = handoff->pid;
+	free (handoff);
+}
+
+
+/**********************************************************************
+** move_standby_pipes ()
+** 
+** worker_job_t, on the I/O thread, when the standby is promoted: its
+** pipes move from standby_ls to the app's log stream, and what the
+** app it replaces left in the old ones is collected.
+** 
+** Causes exit on failure.
+*/
+void
+move_standby_pipes (worker_t *w, void *arg)
+{
+	supervisor_t *sv = arg;
+	log_stream_t *ls = &sv->ls;
+	int fd[2];
+
+	fd[0] = release_source (&sv->standby_ls.app_stdout);
+	fd[1] = release_source (&sv->standby_ls.app_stderr);
+	sv->standby_ls.scanning = 0;
+	flush_log_stream (&sv->standby_ls);
+	detach_source (&ls->app_stdout);
+	detach_source (&ls->app_stderr);
+	flush_log_stream (ls);
+	if ((fd[0] != -1 && attach_source (ls, &ls->app_stdout, fd[0], 0) != 0)
+	 || (fd[1] != -1 && attach_source (ls, &ls->app_stderr, fd[1], 0) != 0))
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to watch application pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	ls->app_stdout.pid = ls->app_stderr.pid = sv->standby_ls.app_stdout.pid;
+}
+
+
+/**********************************************************************
+** start_app ()
+** 
+** Spawn the application. Its pipes go to the I/O thread, which first
+** collects what a previous instance left in the old ones.
+** 
+** Causes exit on failure.
+*/
+void
+start_app (supervisor_t *sv)
+{
+	int app_stdout[2];
+	int app_stderr[2];
+	unsigned long long started = profile_start ();
+
+	sv->apppid = spawn_process (NULL, app_stdout, app_stderr,
+	 sv->listen_fds, sv->nlisten, sv->config.app.items);
+	profile_end (SV_SPAWN, started);
+	if (sv->apppid == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to start application: %m");
+		exit (errno);
+	}
+	service_syslog (sv, LOG_NOTICE, "Started application [%d]: %s",
+	 sv->apppid, sv->config.app.items[0]);
+	sv->app_starts++;
+	note_process_start (&sv->app_backoff, monotonic_ms ());
+	handoff_pipes (sv, swap_app_pipes, sv->apppid, app_stdout[READ_END],
+	 app_stderr[READ_END]);
+}
+
+
+/**********************************************************************
+** start_standby ()
+** 
+** Spawn a warm standby instance of the application. Its pipes go to
+** the I/O thread, which scans them for the ready line; until then
+** it is not eligible for promotion.
+** 
+** Causes exit on failure.
+*/
+void
+start_standby (supervisor_t *sv)
+{
+	int app_stdout[2];
+	int app_stderr[2];
+	unsigned long long started = profile_start ();
+
+	sv->standbypid = spawn_process (NULL, app_stdout, app_stderr,
+	 sv->listen_fds, sv->nlisten, sv->config.app.items);
+	profile_end (SV_SPAWN, started);
+	if (sv->standbypid == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to start standby: %m");
+		exit (errno);
+	}
+	sv->standby_ready = 0;
+	sv->standby_generation++;
+	service_syslog (sv, LOG_NOTICE, "Started standby [%d]: %s",
+	 sv->standbypid, sv->config.app.items[0]);
+	note_process_start (&sv->standby_backoff, monotonic_ms ());
+	handoff_pipes (sv, swap_standby_pipes, sv->standbypid,
+	 app_stdout[READ_END],
+	 app_stderr[READ_END]);
+}
+
+
+/**********************************************************************
+** arm_heartbeat_timer ()
+** 
+** Set the timerfd to the earliest threshold that has not been acted
+** on yet, or disarm it if there is none or the app is waiting to be
+** re-spawned.
+** 
+** A heartbeat only moves the deadlines later, so it does not re-arm
+** the timer; when the timer fires early, check_heartbeat_deadlines()
+** finds nothing due and calls this to move it along.
+*/
+void
+arm_heartbeat_timer (supervisor_t *sv)
+{
+	long long deadline = 0;
+	long long d;
+
+	if (!(sv->warn_has_been_triggered) && sv->opts.warn_thresh != 0)
+	{
+		d = sv->last_heartbeat + sv->opts.warn_thresh;
+		if (deadline == 0 || d < deadline) deadline = d;
+	}
+	if (!(sv->crit_has_been_triggered) && sv->opts.crit_thresh != 0)
+	{
+		d = sv->last_heartbeat + sv->opts.crit_thresh;
+		if (deadline == 0 || d < deadline) deadline = d;
+	}
+	if (!(sv->app_killed) && sv->opts.restart_thresh != 0)
+	{
+		d = sv->last_heartbeat + sv->opts.restart_thresh;
+		if (deadline == 0 || d < deadline) deadline = d;
+	}
+	if (sv->apppid == -1) deadline = 0; /* waiting to re-spawn it */
+	if (sv->paused) deadline = 0;
+	if (deadline == sv->armed_deadline) return;
+	if (arm_timer_fd (sv->timer_watch.fd, deadline) == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to arm heartbeat timer: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	sv->armed_deadline = deadline;
+}
+
+
+/**********************************************************************
+** reset_heartbeat_timers ()
+** 
+** Start a new grace period of min_thresh, e.g. after a re-spawn.
+*/
+void
+reset_heartbeat_timers (supervisor_t *sv)
+{
+	sv->last_heartbeat = monotonic_ms () + sv->min_thresh;
+	sv->warn_has_been_triggered = 0;
+	sv->crit_has_been_triggered = 0;
+	arm_heartbeat_timer (sv);
+}
+
+
+/**********************************************************************
+** promote_standby ()
+** 
+** Make the ready standby the application, in place of one that is
+** gone or being killed, and start the next standby. The new app gets
+** the usual grace period, but no startup time.
+** 
+** Causes exit on failure.
+*/
+void
+promote_standby (supervisor_t *sv)
+{
+	service_syslog (sv, LOG_NOTICE, "Promoting standby [%d] to application.",
+	 sv->standbypid);
+	sv->apppid = sv->standbypid;
+	sv->standbypid = -1;
+	sv->standby_ready = 0;
+	sv->promotions++;
+	note_process_start (&sv->app_backoff, monotonic_ms ());
+	if (post_unit_job (&sv->unit, move_standby_pipes, sv) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	reset_heartbeat_timers (sv);
+	start_standby (sv);
+}
+
+
+/**********************************************************************
+** standby_ready ()
+** 
+** The I/O thread saw the ready line of the standby it calls
+** generation. One that has since died or been replaced is ignored.
+*/
+void
+standby_ready (supervisor_t *sv, long long generation)
+{
+	if (sv->standbypid == -1 || generation != sv->standby_generation)
+	{ return; }
+	sv->standby_ready = 1;
+	service_syslog (sv, LOG_NOTICE, "Standby [%d] is ready.",
+	 sv->standbypid);
+}
+
+
+/**********************************************************************
+** record_heartbeat ()
+** 
+** A heartbeat line went by at monotonic time when. If a warning was
+** already given, the deadlines may move earlier than the one armed,
+** so re-arm.
+*/
+void
+record_heartbeat (supervisor_t *sv, long long when)
+{
+	int was_triggered = sv->warn_has_been_triggered
+	 || sv->crit_has_been_triggered;
+
+	// syslog (LOG_DEBUG, "found healthcheck");
+	if (was_triggered)
+	{
+		service_syslog (sv, LOG_NOTICE,
+		 "Heartbeat detected. Resetting timers.");
+	}
+	sv->last_heartbeat = when;
+	sv->warn_has_been_triggered = 0;
+	sv->crit_has_been_triggered = 0;
+	if (was_triggered) arm_heartbeat_timer (sv);
+}
+
+
+/**********************************************************************
+** arm_restart_timer ()
+** 
+** Set the restart timerfd to the earliest of the pending re-spawns and
+** stop stages, or disarm it if there is none.
+** 
+** Causes exit on failure.
+*/
+void
+arm_restart_timer (supervisor_t *sv)
+{
+	long long deadline = sv->app_restart_at;
+	child_stop_t *stops[4];
+	int i;
+
+	if (sv->log_restart_at != 0
+	 && (deadline == 0 || sv->log_restart_at < deadline))
+	{ deadline = sv->log_restart_at; }
+	if (sv->standby_restart_at != 0
+	 && (deadline == 0 || sv->standby_restart_at < deadline))
+	{ deadline = sv->standby_restart_at; }
+	stops[0] = &sv->app_stop;
+	stops[1] = &sv->retired_stop;
+	stops[2] = &sv->standby_stop;
+	stops[3] = &sv->log_stop;
+	for (i = 0; i < 4; i++)
+	{
+		if (stops[i]->next_at != 0
+		 && (deadline == 0 || stops[i]->next_at < deadline))
+		{ deadline = stops[i]->next_at; }
+	}
+	if (arm_timer_fd (sv->restart_watch.fd, deadline) == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to arm restart timer: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+}
+
+
+/**********************************************************************
+** advance_stop ()
+** 
+** Take a child's stop sequence to its next stage: from EOF (or from
+** nothing) to SIGTERM + SIGCONT, and from there to SIGKILL once the
+** grace period is up. With no grace period, SIGKILL comes right away.
+** The child is re-spawned, or not, when it has been reaped.
+*/
+void
+advance_stop (supervisor_t *sv, child_stop_t *stop, pid_t pid,
+ const char *what)
+{
+	long long grace = sv->opts.stop_grace;
+
+	if (pid <= 0) return;
+	if (stop->stage < STOP_TERM && grace > 0)
+	{
+		service_syslog (sv, LOG_INFO, "Stopping %s [%d].", what, pid);
+		signal_group (sv, pid, SIGTERM);
+		signal_group (sv, pid, SIGCONT);
+		stop->stage = STOP_TERM;
+		stop->next_at = monotonic_ms () + grace;
+	}
+	else if (stop->stage < STOP_KILL)
+	{
+		if (stop->stage != STOP_NONE)
+		{
+			service_syslog (sv, LOG_WARNING,
+			 "The %s [%d] did not stop within %lld ms; killing it.",
+			 what, pid, grace);
+		}
+		signal_group (sv, pid, SIGKILL);
+		stop->stage = STOP_KILL;
+		stop->next_at = 0;
+	}
+	arm_restart_timer (sv);
+}
+
+
+/**********************************************************************
+** stopped ()
+** 
+** A child was reaped. If heartmon was stopping it, SIGKILL whatever is
+** left of its process group, so nothing of the old instance holds on
+** to ports or memory when the next one starts.
+*/
+void
+stopped (supervisor_t *sv, child_stop_t *stop, pid_t pid)
+{
+	if (stop->stage != STOP_NONE) signal_group (sv, pid, SIGKILL);
+	stop->stage = STOP_NONE;
+	stop->next_at = 0;
+}
+
+
+/**********************************************************************
+** restart_app ()
+** 
+** Replace the app: with the standby, if one is ready, or with a new
+** instance once this one has been stopped and reaped. With at_once,
+** the new instance does not wait out the restart backoff.
+*/
+void
+restart_app (supervisor_t *sv, int at_once)
+{
+	if (sv->standby_ready && sv->retiredpid == -1)
+	{
+		/* reaped by on_child_event(), not re-spawned */
+		sv->retiredpid = sv->apppid;
+		sv->retired_stop = sv->app_stop;
+		sv->app_stop.stage = STOP_NONE;
+		sv->app_stop.next_at = 0;
+		advance_stop (sv, &sv->retired_stop, sv->retiredpid,
+		 "replaced application");
+		promote_standby (sv);
+	} else {
+		/* re-spawned by on_child_event() once it is reaped */
+		sv->app_killed = 1;
+		sv->app_replaced = at_once;
+		advance_stop (sv, &sv->app_stop, sv->apppid, "application");
+	}
+}
+
+
+/**********************************************************************
+** check_heartbeat_deadlines ()
+** 
+** Take the action for every threshold that has been reached since
+** the last heartbeat, then arm the timer for the next one. Nothing is
+** done while enforcement is paused.
+*/
+void
+check_heartbeat_deadlines (supervisor_t *sv)
+{
+	long long since = monotonic_ms () - sv->last_heartbeat;
+
+	if (sv->apppid == -1) return; /* waiting to re-spawn it */
+	if (sv->paused) return;
+	// syslog (LOG_DEBUG, "found NO healthcheck. delta t = %lld ms", since);
+	if (!(sv->warn_has_been_triggered) && sv->opts.warn_thresh != 0
+	  && since >= sv->opts.warn_thresh)
+	{
+		service_syslog (sv, LOG_WARNING,
+		 "Heartbeat warning threshold reached for %s",
+		 sv->config.app.items[0]);
+		sv->warn_has_been_triggered = 1;
+		sv->warn_triggers++;
+		PROBE (threshold, -1, since, sv->apppid, "warn");
+	}
+	if (!(sv->crit_has_been_triggered) && sv->opts.crit_thresh != 0
+	  && since >= sv->opts.crit_thresh)
+	{
+		service_syslog (sv, LOG_ERR,
+		 "Heartbeat critical threshold reached for %s",
+		 sv->config.app.items[0]);
+		sv->crit_has_been_triggered = 1;
+		sv->crit_triggers++;
+		PROBE (threshold, -1, since, sv->apppid, "crit");
+	}
+	if (!(sv->app_killed) && sv->opts.restart_thresh != 0
+	 && since >= sv->opts.restart_thresh)
+	{
+		service_syslog (sv, LOG_ERR,
+		 "KILLING APP: Heartbeat restart threshold reached for %s.",
+		 sv->config.app.items[0]);
+		sv->restart_triggers++;
+		PROBE (threshold, -1, since, sv->apppid, "restart");
+		restart_app (sv, 0);
+	}
+	arm_heartbeat_timer (sv);
+}
+
+
+/**********************************************************************
+** on_timer_event ()
+** 
+** event_handler_t for the heartbeat timerfd.
+*/
+void
+on_timer_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	supervisor_t *sv = data;
+	unsigned long long expirations;
+	unsigned long long started;
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	started = profile_start ();
+	sv->armed_deadline = 0;
+	check_heartbeat_deadlines (sv);
+	profile_end (SV_TIMERS, started);
+}
+
+
+/**********************************************************************
+** log_child_exit ()
+** 
+** Syslog how a child ended, from its wait status.
+*/
+void
+log_child_exit (supervisor_t *sv, int priority, const char *what,
+ pid_t pid, int statusinfo)
+{
+	if (WIFEXITED (statusinfo))
+	{
+		service_syslog (sv, priority, "%s [%d] exited with status %d.",
+		 what, pid, WEXITSTATUS (statusinfo));
+	}
+	else if (WIFSIGNALED (statusinfo))
+	{
+		service_syslog (sv, priority,
+		 "%s [%d] was terminated by signal %d (%s).",
+		 what, pid, WTERMSIG (statusinfo),
+		 strsignal (WTERMSIG (statusinfo)));
+	}
+}
+
+
+/**********************************************************************
+** restart_delay ()
+** 
+** A child of sv exited. Ask its restart policy how long to wait
+** before re-spawning it, and syslog when it starts or stops
+** crash-looping.
+*/
+long long
+restart_delay (supervisor_t *sv, restart_backoff_t *backoff,
+ const char *what)
+{
+	const restart_policy_t *policy = &sv->opts.restart;
+	int was_looping = backoff->crash_looping;
+	long long delay;
+
+	delay = next_restart_delay (policy, backoff, monotonic_ms ());
+	if (backoff->crash_looping && !was_looping)
+	{
+		service_syslog (sv, LOG_CRIT,
+		 "%s is crash-looping: %d restarts within %lld ms.",
+		 what, policy->loop_restarts, policy->loop_window_ms);
+	}
+	else if (was_looping && !backoff->crash_looping)
+	{
+		service_syslog (sv, LOG_NOTICE, "%s is no longer crash-looping.",
+		 what);
+	}
+	if (delay > 0)
+	{
+		service_syslog (sv, LOG_NOTICE, "%s will be re-spawned in %lld ms.",
+		 what, delay);
+	}
+	return delay;
+}
+
+
+/**********************************************************************
+** start_log_file ()
+** 
+** Open the built-in sink's log file, once for the app's stream and
+** once for the standby's, and hand them to the I/O thread, which
+** closes what they replace and writes what is buffered to them. A
+** file that cannot be opened is tried again when the restart policy
+** says, as a log handler that exited would be; meanwhile the logs
+** are buffered, or keep going to the files they went to.
+** 
+** Causes exit on failure.
+*/
+void
+start_log_file (supervisor_t *sv)
+{
+	file_handoff_t *handoff;
+	const char *path;
+	int sync;
+	long long every;
+	long long delay;
+	int status = 0;
+	int i;
+
+	/* checked when the config was read */
+	parse_log_file (sv, sv->config.log.items, &path, &sync, &every);
+	if ((handoff = calloc (1, sizeof (file_handoff_t))) == NULL)
+	{
+		service_syslog (sv, LOG_ALERT, "calloc: %m");
+		exit (errno);
+	}
+	handoff->sv = sv;
+	for (i = 0; i < 2 && status == 0; i++)
+	{
+		if ((handoff->files[i] = malloc (sizeof (file_sink_t))) == NULL)
+		{
+			service_syslog (sv, LOG_ALERT, "malloc: %m");
+			exit (errno);
+		}
+		status = open_file_sink (handoff->files[i], path, sync, every);
+	}
+	note_process_start (&sv->log_backoff, monotonic_ms ());
+	if (status != 0)
+	{
+		errno = status;
+		service_syslog (sv, LOG_ERR, "Failed to open log file [%s]: %m",
+		 path);
+		for (i = 0; i < 2; i++)
+		{
+			if (handoff->files[i] == NULL) continue;
+			close_file_sink (handoff->files[i]);
+			free (handoff->files[i]);
+		}
+		free (handoff);
+		delay = restart_delay (sv, &sv->log_backoff, "Log file");
+		sv->log_restart_at = monotonic_ms ()
+		 + (delay > 0 ? delay : FILE_RETRY_MS);
+		arm_restart_timer (sv);
+		return;
+	}
+	service_syslog (sv, LOG_NOTICE, "Writing log to file [%s].", path);
+	sv->log_starts++;
+	sv->log_file_open = 1;
+	if (post_unit_job (&sv->unit, swap_log_file, handoff) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off log file: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+}
+
+
+/**********************************************************************
+** start_logger ()
+** 
+** Spawn the log handler. Its stdin pipe goes to the I/O thread, which
+** closes the pipe of a previous instance and sends whatever is
+** buffered to the new one right away. With the built-in sink (log
+** @file), open the log file instead.
+** 
+** Causes exit on failure.
+*/
+void
+start_logger (supervisor_t *sv)
+{
+	int log_stdin[2];
+	unsigned long long started;
+
+	if (uses_log_file (&sv->config))
+	{
+		start_log_file (sv);
+		return;
+	}
+	started = profile_start ();
+	sv->logpid = spawn_process (log_stdin, NULL, NULL, NULL, 0,
+	 sv->config.log.items);
+	profile_end (SV_SPAWN, started);
+	if (sv->logpid == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to start log handler: %m");
+		exit (errno);
+	}
+	service_syslog (sv, LOG_NOTICE, "Started log handler [%d]: %s",
+	 sv->logpid, sv->config.log.items[0]);
+	sv->log_starts++;
+	sv->log_file_open = 0;
+	note_process_start (&sv->log_backoff, monotonic_ms ());
+	handoff_pipes (sv, swap_logger_pipe, sv->logpid, log_stdin[WRITE_END],
+	 -1);
+}
+
+
+/**********************************************************************
+** finish_sink ()
+** 
+** Write out everything buffered for the log handler and close its
+** pipe, as the pipe takes it (see close_sink()); or to the log file,
+** unfinished line and all, and close that.
+*/
+void
+finish_sink (log_stream_t *ls)
+{
+	if (ls->file != NULL)
+	{
+		detach_file_sink (ls, 1);
+		return;
+	}
+	close_sink (ls);
+}
+
+
+/**********************************************************************
+** report_log_file_closed ()
+** 
+** worker_job_t, on the I/O thread: tell the supervisor that the log
+** files are closed, through the events ring; if that is full, try
+** again once the supervisor has had a chance to empty it.
+** 
+** Causes exit on failure.
+*/
+void
+report_log_file_closed (worker_t *w, void *arg)
+{
+	supervisor_t *sv = arg;
+
+	if (spsc_push (&w->events, &sv->ls, LOG_FILE_CLOSED) != 0
+	 && post_unit_job (&sv->unit, report_log_file_closed, sv) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to post job: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+}
+
+
+/**********************************************************************
+** close_logger_pipe ()
+** 
+** worker_job_t, on the I/O thread, when heartmon is shutting down and
+** the app is gone: collect what it left in its pipes, hand everything
+** to the log handler and close its stdin, so it sees EOF. Log files
+** are written out and closed, and the supervisor is told when.
+*/
+void
+close_logger_pipe (worker_t *w, void *arg)
+{
+	supervisor_t *sv = arg;
+	int to_file = (sv->ls.file != NULL);
+
+	detach_source (&sv->ls.app_stdout);
+	detach_source (&sv->ls.app_stderr);
+	detach_source (&sv->standby_ls.app_stdout);
+	detach_source (&sv->standby_ls.app_stderr);
+	finish_sink (&sv->standby_ls);
+	finish_sink (&sv->ls);
+	if (to_file) report_log_file_closed (w, sv);
+}
+
+
+/**********************************************************************
+** stop_logger ()
+** 
+** Start the log handler's stop sequence with EOF on its stdin; if it
+** has not exited a grace period later, it gets SIGTERM and SIGCONT.
+** Log files are closed by the I/O thread, which says when it is done.
+** 
+** Causes exit on failure.
+*/
+void
+stop_logger (supervisor_t *sv)
+{
+	if ((sv->logpid == -1 && !sv->log_file_open)
+	 || sv->log_stop.stage != STOP_NONE) return;
+	if (post_unit_job (&sv->unit, close_logger_pipe, sv) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off pipes: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	sv->log_stop.stage = STOP_EOF;
+	if (sv->logpid == -1) return;
+	sv->log_stop.next_at = monotonic_ms () + sv->opts.stop_grace;
+	arm_restart_timer (sv);
+}
+
+
+/**********************************************************************
+** begin_shutdown ()
+** 
+** Stop every child of every service, without waiting here: pending
+** re-spawns are called off, and each app and standby gets its stop
+** sequence. on_child_event() takes it from there, and heartmon exits
+** once all of them have been reaped.
+*/
+void
+begin_shutdown (void)
+{
+	supervisor_t *sv;
+	int i;
+
+	if (shutting_down) return;
+	shutting_down = 1;
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		sv->app_restart_at = sv->standby_restart_at = 0;
+		sv->log_restart_at = 0;
+		if (sv->app_stop.stage == STOP_NONE)
+		{ advance_stop (sv, &sv->app_stop, sv->apppid, "application"); }
+		if (sv->standby_stop.stage == STOP_NONE)
+		{ advance_stop (sv, &sv->standby_stop, sv->standbypid, "standby"); }
+		if (sv->apppid == -1 && sv->standbypid == -1
+		 && sv->retiredpid == -1)
+		{ stop_logger (sv); }
+		arm_restart_timer (sv);
+	}
+}
+
+
+/**********************************************************************
+** all_stopped ()
+** 
+** Whether every child of every service has been reaped, and every log
+** file closed.
+*/
+int
+all_stopped (void)
+{
+	supervisor_t *sv;
+	int i;
+
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		if (sv->apppid != -1 || sv->standbypid != -1
+		 || sv->retiredpid != -1 || sv->logpid != -1 || sv->log_file_open)
+		{ return 0; }
+	}
+	return 1;
+}
+
+
+/**********************************************************************
+** reap_service ()
+** 
+** Reap the service's app, standby or log handler if it has exited,
+** record how it ended, and re-spawn it right away or, if it keeps
+** exiting, once its restart policy says so. An app is replaced by a
+** ready standby instead, if there is one. While heartmon is shutting
+** down, nothing is re-spawned, and the log handler is stopped once
+** the app is gone. Runs on the supervisor thread.
+*/
+void
+reap_service (supervisor_t *sv)
+{
+	long long delay;
+	int statusinfo;
+	pid_t pid;
+
+	if (sv->apppid > 0
+	 && (pid = waitpid (sv->apppid, &statusinfo, WNOHANG)) > 0)
+	{
+		sv->app_status = statusinfo;
+		stopped (sv, &sv->app_stop, pid);
+		if (sv->app_killed || shutting_down)
+		{
+			log_child_exit (sv, LOG_INFO, "Application", pid, statusinfo);
+		} else {
+			service_syslog (sv, LOG_ERR,
+			 "Application has terminated unexpectedly.");
+			log_child_exit (sv, LOG_ERR, "Application", pid, statusinfo);
+		}
+		sv->apppid = -1;
+		sv->app_killed = 0;
+		if (!shutting_down)
+		{
+			if (sv->standby_ready) promote_standby (sv);
+			else if (!sv->app_replaced && (delay = restart_delay (sv,
+			 &sv->app_backoff, "Application")) > 0)
+			{
+				sv->app_restart_at = monotonic_ms () + delay;
+				arm_restart_timer (sv);
+				arm_heartbeat_timer (sv);
+			} else {
+				start_app (sv);
+				reset_heartbeat_timers (sv);
+			}
+		}
+		sv->app_replaced = 0;
+	}
+	if (sv->retiredpid > 0
+	 && (pid = waitpid (sv->retiredpid, &statusinfo, WNOHANG)) > 0)
+	{
+		sv->app_status = statusinfo;
+		stopped (sv, &sv->retired_stop, pid);
+		log_child_exit (sv, LOG_INFO, "Replaced application", pid,
+		 statusinfo);
+		sv->retiredpid = -1;
+	}
+	if (sv->standbypid > 0
+	 && (pid = waitpid (sv->standbypid, &statusinfo, WNOHANG)) > 0)
+	{
+		stopped (sv, &sv->standby_stop, pid);
+		sv->standbypid = -1;
+		sv->standby_ready = 0;
+		if (shutting_down || sv->standby_killed)
+		{
+			log_child_exit (sv, LOG_INFO, "Standby", pid, statusinfo);
+			/* replaced after a config change, unless it was dropped */
+			if (!shutting_down && sv->opts.ready_filter != NULL)
+			{ start_standby (sv); }
+			sv->standby_killed = 0;
+		} else {
+			service_syslog (sv, LOG_ERR,
+			 "Standby has terminated unexpectedly.");
+			log_child_exit (sv, LOG_ERR, "Standby", pid, statusinfo);
+			delay = restart_delay (sv, &sv->standby_backoff, "Standby");
+			if (delay > 0)
+			{
+				sv->standby_restart_at = monotonic_ms () + delay;
+				arm_restart_timer (sv);
+			}
+			else start_standby (sv);
+		}
+	}
+	if (sv->logpid > 0
+	 && (pid = waitpid (sv->logpid, &statusinfo, WNOHANG)) > 0)
+	{
+		sv->log_status = statusinfo;
+		stopped (sv, &sv->log_stop, pid);
+		sv->logpid = -1;
+		if (shutting_down)
+		{
+			log_child_exit (sv, LOG_INFO, "Log handler", pid, statusinfo);
+		}
+		else if (sv->log_killed)
+		{
+			/* replaced after a config change */
+			log_child_exit (sv, LOG_INFO, "Log handler", pid, statusinfo);
+			sv->log_killed = 0;
+			start_logger (sv);
+		} else {
+			service_syslog (sv, LOG_ERR,
+			 "Log handler has terminated unexpectedly.");
+			log_child_exit (sv, LOG_ERR, "Log handler", pid, statusinfo);
+			delay = restart_delay (sv, &sv->log_backoff, "Log handler");
+			if (delay > 0)
+			{
+				sv->log_restart_at = monotonic_ms () + delay;
+				arm_restart_timer (sv);
+			}
+			else start_logger (sv);
+		}
+	}
+	if (shutting_down && sv->apppid == -1 && sv->standbypid == -1
+	 && sv->retiredpid == -1)
+	{ stop_logger (sv); }
+}
+
+
+/**********************************************************************
+** on_restart_event ()
+** 
+** event_handler_t for the restart timerfd: re-spawn whatever is due,
+** and take stop sequences that are due to their next stage. The log
+** handler is re-spawned first, so the app has somewhere to log to.
+*/
+void
+on_restart_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	supervisor_t *sv = data;
+	unsigned long long expirations;
+	unsigned long long started;
+	long long now = monotonic_ms ();
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	started = profile_start ();
+	if (sv->app_stop.next_at != 0 && now >= sv->app_stop.next_at)
+	{ advance_stop (sv, &sv->app_stop, sv->apppid, "application"); }
+	if (sv->retired_stop.next_at != 0 && now >= sv->retired_stop.next_at)
+	{
+		advance_stop (sv, &sv->retired_stop, sv->retiredpid,
+		 "replaced application");
+	}
+	if (sv->standby_stop.next_at != 0 && now >= sv->standby_stop.next_at)
+	{ advance_stop (sv, &sv->standby_stop, sv->standbypid, "standby"); }
+	if (sv->log_stop.next_at != 0 && now >= sv->log_stop.next_at)
+	{ advance_stop (sv, &sv->log_stop, sv->logpid, "log handler"); }
+	if (sv->log_restart_at != 0 && now >= sv->log_restart_at)
+	{
+		sv->log_restart_at = 0;
+		start_logger (sv);
+	}
+	if (sv->app_restart_at != 0 && now >= sv->app_restart_at)
+	{
+		sv->app_restart_at = 0;
+		start_app (sv);
+		reset_heartbeat_timers (sv);
+	}
+	if (sv->standby_restart_at != 0 && now >= sv->standby_restart_at)
+	{
+		sv->standby_restart_at = 0;
+		start_standby (sv);
+	}
+	arm_restart_timer (sv);
+	profile_end (SV_TIMERS, started);
+}
+
+
+/**********************************************************************
+** on_child_event ()
+** 
+** event_handler_t for the SIGCHLD signalfd, shared by all services.
+*/
+void
+on_child_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	struct signalfd_siginfo info;
+	unsigned long long started;
+	int i;
+
+	/* SIGCHLD does not queue; the siginfo only says "go look" */
+	while (read (fd, &info, sizeof (info)) == sizeof (info))
+	{ ; }
+
+	started = profile_start ();
+	for (i = 0; i < nservices; i++) reap_service (services[i]);
+	profile_end (SV_REAP, started);
+	if (shutting_down && all_stopped ()) exit (EXIT_SUCCESS);
+}
+
+
+/**********************************************************************
+** on_term_event ()
+** 
+** event_handler_t for the SIGTERM signalfd.
+*/
+void
+on_term_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	struct signalfd_siginfo info;
+
+	while (read (fd, &info, sizeof (info)) == sizeof (info))
+	{ ; }
+	if (shutting_down) return;
+	self_log (LOG_INFO, "Received TERM signal.");
+	begin_shutdown ();
+	if (all_stopped ()) exit (EXIT_SUCCESS);
+}
+
+
+/**********************************************************************
+** park_service ()
+** 
+** worker_unit_t park hook: stop watching the service's log streams on
+** the I/O thread it is leaving.
+*/
+void
+park_service (worker_unit_t *unit)
+{
+	supervisor_t *sv = unit->data;
+
+	park_log_stream (&sv->ls);
+	park_log_stream (&sv->standby_ls);
+}
+
+
+/**********************************************************************
+** unpark_service ()
+** 
+** worker_unit_t unpark hook: watch the service's log streams on the
+** loop of the I/O thread it has moved to.
+*/
+int
+unpark_service (worker_unit_t *unit, event_loop_t *loop)
+{
+	supervisor_t *sv = unit->data;
+	int status;
+
+	if ((status = unpark_log_stream (&sv->ls, loop)) != 0
+	 || (status = unpark_log_stream (&sv->standby_ls, loop)) != 0)
+	{ return status; }
+	flush_log_stream (&sv->ls);
+	flush_log_stream (&sv->standby_ls);
+	inject_self_log (&sv->ls);
+	return 0;
+}
+
+
+/**********************************************************************
+** rebalance_workers ()
+** 
+** Measure how busy each worker was over the last elapsed ms, and
+** move one service off each saturated worker that has more than one.
+** The quietest service moves, so the others get away from a flooding
+** one, which stays put.
+*/
+void
+rebalance_workers (long long elapsed)
+{
+	static long long *cpu_sampled = NULL;
+	unsigned long long traffic[nservices];
+	unsigned long long bytes_in;
+	long long busy[nworkers];
+	long long cpu;
+	int loudest, quietest;
+	int idlest = 0;
+	int i, w;
+
+	if (cpu_sampled == NULL)
+	{
+		/* the first pass only takes the samples to measure from */
+		cpu_sampled = calloc (nworkers, sizeof (long long));
+		if (cpu_sampled == NULL) return;
+		elapsed = 0;
+	}
+	for (w = 0; w < nworkers; w++)
+	{
+		cpu = worker_cpu_ms (&workers[w]);
+		busy[w] = elapsed ? (cpu - cpu_sampled[w]) * 100 / elapsed : 0;
+		cpu_sampled[w] = cpu;
+		if (busy[w] < busy[idlest]) idlest = w;
+	}
+	for (i = 0; i < nservices; i++)
+	{
+		bytes_in = __atomic_load_n (&services[i]->ls.bytes_in,
+		 __ATOMIC_RELAXED);
+		traffic[i] = bytes_in - services[i]->bytes_sampled;
+		services[i]->bytes_sampled = bytes_in;
+	}
+	if (elapsed == 0 || busy[idlest] >= IDLE_PCT) return;
+
+	for (w = 0; w < nworkers; w++)
+	{
+		if (w == idlest || busy[w] < SATURATED_PCT) continue;
+		loudest = quietest = -1;
+		for (i = 0; i < nservices; i++)
+		{
+			if (worker_unit_owner (&services[i]->unit) != &workers[w])
+			{ continue; }
+			if (loudest == -1 || traffic[i] > traffic[loudest])
+			{
+				if (quietest == -1) quietest = loudest;
+				loudest = i;
+			}
+			else if (quietest == -1 || traffic[i] < traffic[quietest])
+			{ quietest = i; }
+		}
+		if (quietest == -1) continue;
+		service_syslog (services[quietest], LOG_NOTICE,
+		 "Worker %d is %lld%% busy; moving to worker %d.",
+		 w, busy[w], idlest);
+		if (move_worker_unit (&services[quietest]->unit,
+		 &workers[idlest]) != 0)
+		{
+			service_syslog (services[quietest], LOG_ERR,
+			 "move_worker_unit: %m");
+		}
+	}
+}
+
+
+/**********************************************************************
+** on_rebalance_event ()
+** 
+** event_handler_t for the rebalance timerfd; re-arms it.
+*/
+void
+on_rebalance_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	static long long last = 0;
+	long long now = monotonic_ms ();
+	unsigned long long expirations;
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	if (last != 0 && now > last) rebalance_workers (now - last);
+	last = now;
+	if (arm_timer_fd (fd, now + REBALANCE_MS) == -1)
+	{
+		self_log (LOG_ERR, "Failed to arm rebalance timer: %m");
+	}
+}
+
+
+/**********************************************************************
+** on_heartbeat ()
+** 
+** heartbeat_handler_t for a service's log streams, on its I/O thread.
+** Pass the time of a heartbeat along to the supervisor thread, without
+** waiting. On the standby's stream, the "heartbeat" is its ready line
+** and what is passed is which standby it came from; it is only news
+** once, unless the ring was full.
+*/
+void
+on_heartbeat (log_stream_t *ls, void *data)
+{
+	supervisor_t *sv = data;
+	worker_t *w = current_worker ();
+
+	if (ls == &sv->standby_ls)
+	{
+		if (spsc_push (&w->events, ls, sv->standby_ls_generation) == 0)
+		{ ls->scanning = 0; }
+	}
+	else spsc_push (&w->events, ls, monotonic_ms ());
+}
+
+
+/**********************************************************************
+** on_self_log_event ()
+** 
+** event_handler_t for an I/O thread's self_log eventfd: inject the
+** messages that came in into the streams of the services it runs,
+** from its own list of them, without taking the unit lock. A service
+** on its way to another thread catches up when it gets there.
+*/
+void
+on_self_log_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	worker_t *w = data;
+	worker_unit_t *unit;
+	supervisor_t *sv;
+	unsigned long long count;
+
+	if (read (fd, &count, sizeof (count)) == -1 && errno == EAGAIN) return;
+	for (unit = w->units; unit != NULL; unit = unit->next_owned)
+	{
+		sv = unit->data;
+		inject_self_log (&sv->ls);
+	}
+}
+
+
+/**********************************************************************
+** on_worker_events ()
+** 
+** event_handler_t for an I/O thread's events ring, on the supervisor
+** thread. Each item names the log stream it came from. LOG_FILE_CLOSED
+** on the app's stream means its log files have been closed, at
+** shutdown.
+*/
+void
+on_worker_events (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	worker_t *w = data;
+	spsc_item_t item;
+	log_stream_t *ls;
+	supervisor_t *sv;
+	unsigned long long count;
+	unsigned long long started;
+	unsigned long dropped;
+
+	if (read (fd, &count, sizeof (count)) == -1 && errno == EAGAIN) return;
+	started = profile_start ();
+	while (spsc_pop (&w->events, &item))
+	{
+		ls = item.ptr;
+		sv = ls->heartbeat_data;   /* set before the threads started */
+		if (ls == &sv->standby_ls) standby_ready (sv, item.value);
+		else if (item.value == LOG_FILE_CLOSED)
+		{
+			sv->log_file_open = 0;
+			sv->log_stop.stage = STOP_NONE;
+		}
+		else record_heartbeat (sv, item.value);
+	}
+	profile_end (SV_HEARTBEATS, started);
+	if ((dropped = spsc_take_dropped (&w->events)) != 0)
+	{
+		self_log (LOG_WARNING,
+		 "I/O thread %d dropped %lu heartbeat(s): supervisor too slow.",
+		 w->index, dropped);
+	}
+	if (shutting_down && all_stopped ()) exit (EXIT_SUCCESS);
+}
+
+
+/**********************************************************************
+** load_count ()
+**
+** Read one of the counts an I/O thread keeps in a log stream.
+*/
+unsigned long long
+load_count (unsigned long long *count)
+{
+	return __atomic_load_n (count, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************
+** print_metric_help ()
+*/
+void
+print_metric_help (text_out_t *out, const char *name, const char *type,
+ const char *help)
+{
+	text_printf (out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name,
+	 type);
+}
+
+
+/**********************************************************************
+** print_label_value ()
+**
+** Print str with the escapes the Prometheus text format asks for in
+** label values: backslash, double quote and newline.
+*/
+void
+print_label_value (text_out_t *out, const char *str)
+{
+	size_t n;
+
+	while (*str != '\0')
+	{
+		n = strcspn (str, "\\\"\n");
+		text_printf (out, "%.*s", (int)n, str);
+		str += n;
+		if (*str == '\0') break;
+		text_printf (out, "\\%c", *str == '\n' ? 'n' : *str);
+		str++;
+	}
+}
+
+
+/**********************************************************************
+** print_metric_name ()
+**
+** Start a sample: the metric's name and labels, service="..." if sv is
+** given, then key="value" if key is.
+*/
+void
+print_metric_name (text_out_t *out, const char *name, supervisor_t *sv,
+ const char *key, const char *value)
+{
+	text_printf (out, "%s{", name);
+	if (sv != NULL)
+	{
+		text_printf (out, "service=\"");
+		print_label_value (out, sv->name);
+		text_printf (out, "\"%s", key != NULL ? "," : "");
+	}
+	if (key != NULL)
+	{
+		text_printf (out, "%s=\"", key);
+		print_label_value (out, value);
+		text_printf (out, "\"");
+	}
+	text_printf (out, "} ");
+}
+
+
+/**********************************************************************
+** print_service_count ()
+**
+** Print a sample of a count for every service.
+*/
+void
+print_service_count (text_out_t *out, const char *name, const char *type,
+ const char *help, size_t offset, int in_stream)
+{
+	supervisor_t *sv;
+	char *base;
+	int i;
+
+	print_metric_help (out, name, type, help);
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		base = in_stream ? (char *)&sv->ls : (char *)sv;
+		print_metric_name (out, name, sv, NULL, NULL);
+		text_printf (out, "%llu\n",
+		 load_count ((unsigned long long *)(base + offset)));
+	}
+}
+
+
+/**********************************************************************
+** print_source_counts ()
+**
+** Print a sample of bytes_in or lines_in for every source of every
+** service: its stdout, its stderr and each of its fifos.
+*/
+void
+print_source_counts (text_out_t *out, const char *name, const char *help,
+ int lines)
+{
+	supervisor_t *sv;
+	log_source_t *src;
+	const char *label;
+	int i, j;
+
+	print_metric_help (out, name, "counter", help);
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		for (j = -2; j < MAXSOURCES; j++)
+		{
+			if (j == -2)
+			{
+				src = &sv->ls.app_stdout;
+				label = "stdout";
+			}
+			else if (j == -1)
+			{
+				src = &sv->ls.app_stderr;
+				label = "stderr";
+			}
+			else if (sv->fifo_paths[j] == NULL) continue;
+			else
+			{
+				src = &sv->ls.fifos[j];
+				label = sv->fifo_paths[j];
+			}
+			print_metric_name (out, name, sv, "source", label);
+			text_printf (out, "%llu\n",
+			 load_count (lines ? &src->lines_in : &src->bytes_in));
+		}
+	}
+}
+
+
+/**********************************************************************
+** print_loop_counts ()
+**
+** Print a sample of one of the counts every event loop keeps: the
+** supervisor's (main_loop) and each I/O thread's. Counts in
+** nanoseconds are printed in seconds.
+*/
+void
+print_loop_counts (text_out_t *out, event_loop_t *main_loop,
+ const char *name, const char *type, const char *help, size_t offset,
+ int in_ns)
+{
+	event_loop_t *loop;
+	unsigned long long count;
+	char label[32];
+	int i;
+
+	print_metric_help (out, name, type, help);
+	for (i = -1; i < nworkers; i++)
+	{
+		loop = (i == -1) ? main_loop : &workers[i].loop;
+		if (i == -1) strcpy (label, "supervisor");
+		else snprintf (label, sizeof (label), "io%d", i);
+		count = load_count ((unsigned long long *)((char *)loop + offset));
+		print_metric_name (out, name, NULL, "loop", label);
+		if (in_ns) text_printf (out, "%.6f\n", count / 1e9);
+		else text_printf (out, "%llu\n", count);
+	}
+}
+
+
+/**********************************************************************
+** render_metrics ()
+**
+** text_render_t for the metrics socket (-M): every service's counts in
+** the Prometheus text format. data is the supervisor's event loop.
+*/
+void
+render_metrics (text_out_t *out, const char *request, void *data)
+{
+	const char *levels[3] = {"warn", "crit", "restart"};
+	const char *children[2] = {"app", "log_handler"};
+	unsigned long long count;
+	supervisor_t *sv;
+	long long now = monotonic_ms ();
+	long long age;
+	int i, j;
+
+	print_source_counts (out, "heartmon_source_bytes_total",
+	 "Bytes read from the app's stdout or stderr or from a fifo.", 0);
+	print_source_counts (out, "heartmon_source_lines_total",
+	 "Lines read from a source, not counting what -z splices unseen.", 1);
+	print_service_count (out, "heartmon_logger_bytes_total", "counter",
+	 "Bytes written to the log handler.",
+	 offsetof (log_stream_t, bytes_out), 1);
+	print_service_count (out, "heartmon_logger_partial_writes_total",
+	 "counter", "Writes to the log handler that it took only part of.",
+	 offsetof (log_stream_t, partial_writes), 1);
+	print_service_count (out, "heartmon_buffer_size_bytes", "gauge",
+	 "Size of the log buffer.", offsetof (log_stream_t, buffer_size), 1);
+	print_service_count (out, "heartmon_buffer_high_water_bytes", "gauge",
+	 "Most the log buffer has held.",
+	 offsetof (log_stream_t, buffer_hwm), 1);
+	print_service_count (out, "heartmon_heartbeats_total", "counter",
+	 "Heartbeat lines matched.", offsetof (log_stream_t, heartbeats), 1);
+
+	print_metric_help (out, "heartmon_heartbeat_age_seconds", "gauge",
+	 "Time since the last heartbeat, or the end of the startup grace.");
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		age = now - sv->last_heartbeat;
+		print_metric_name (out, "heartmon_heartbeat_age_seconds", sv, NULL,
+		 NULL);
+		text_printf (out, "%.3f\n", age > 0 ? age / 1000.0 : 0.0);
+	}
+
+	print_metric_help (out, "heartmon_triggers_total", "counter",
+	 "Heartbeat thresholds reached.");
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		for (j = 0; j < 3; j++)
+		{
+			if (j == 0) count = sv->warn_triggers;
+			else if (j == 1) count = sv->crit_triggers;
+			else count = sv->restart_triggers;
+			print_metric_name (out, "heartmon_triggers_total", sv, "level",
+			 levels[j]);
+			text_printf (out, "%llu\n", count);
+		}
+	}
+
+	print_metric_help (out, "heartmon_respawns_total", "counter",
+	 "Times the app or log handler was started again.");
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		for (j = 0; j < 2; j++)
+		{
+			count = j == 0 ? sv->app_starts : sv->log_starts;
+			print_metric_name (out, "heartmon_respawns_total", sv, "child",
+			 children[j]);
+			text_printf (out, "%llu\n", count > 0 ? count - 1 : 0);
+		}
+	}
+	print_service_count (out, "heartmon_standby_promotions_total",
+	 "counter", "Times a warm standby took over as the app.",
+	 offsetof (supervisor_t, promotions), 0);
+
+	print_loop_counts (out, data, "heartmon_loop_batches_total", "counter",
+	 "Wakeups of an event loop with events to handle.",
+	 offsetof (event_loop_t, batches), 0);
+	print_loop_counts (out, data, "heartmon_loop_busy_seconds_total",
+	 "counter", "Time an event loop spent in its handlers.",
+	 offsetof (event_loop_t, busy_ns), 1);
+	print_loop_counts (out, data, "heartmon_loop_batch_max_seconds",
+	 "gauge", "Longest an event loop took over one wakeup's events.",
+	 offsetof (event_loop_t, max_ns), 1);
+}
+
+
+/**********************************************************************
+** dump_profile ()
+**
+** Syslog how long each event loop's wakeups, each supervisor phase
+** and each service's stream phases took since the last dump (-P).
+** Ones with nothing to show are left out. loop is the supervisor's.
+*/
+void
+dump_profile (event_loop_t *loop)
+{
+	const char *sv_phases[SV_PHASES] = {"reap", "timers", "heartbeats",
+	 "spawn"};
+	const char *stream_phases[STREAM_PHASES] = {"read", "scan", "write",
+	 "splice"};
+	char text[256];
+	supervisor_t *sv;
+	int i, j;
+
+	if (supervisor_profile == NULL)
+	{
+		self_log (LOG_NOTICE, "Profiling is off; start heartmon with -P.");
+		return;
+	}
+	if (summarize_latency (loop->latency, text, sizeof (text)))
+	{ self_log (LOG_INFO, "Profile of supervisor wakeups: %s", text); }
+	for (i = 0; i < SV_PHASES; i++)
+	{
+		if (summarize_latency (&supervisor_profile[i], text, sizeof (text)))
+		{ self_log (LOG_INFO, "Profile of %s: %s", sv_phases[i], text); }
+	}
+	for (i = 0; i < nworkers; i++)
+	{
+		if (summarize_latency (workers[i].loop.latency, text,
+		 sizeof (text)))
+		{ self_log (LOG_INFO, "Profile of I/O thread %d wakeups: %s", i, text); }
+	}
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		for (j = 0; j < STREAM_PHASES; j++)
+		{
+			if (summarize_latency (&sv->ls.profile[j], text, sizeof (text)))
+			{
+				service_syslog (sv, LOG_INFO, "Profile of log %s: %s",
+				 stream_phases[j], text);
+			}
+		}
+	}
+}
+
+
+/**********************************************************************
+** on_usr1_event ()
+**
+** event_handler_t for the SIGUSR1 signalfd: dump the profile now.
+*/
+void
+on_usr1_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	struct signalfd_siginfo info;
+
+	if (read (fd, &info, sizeof (info)) != sizeof (info)) return;
+	dump_profile (loop);
+}
+
+
+/**********************************************************************
+** on_profile_event ()
+**
+** event_handler_t for the timerfd of -P: dump the profile, and do it
+** again in profile_every ms.
+*/
+void
+on_profile_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	unsigned long long expirations;
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	dump_profile (loop);
+	if (arm_timer_fd (fd, monotonic_ms () + profile_every) == -1)
+	{ self_log (LOG_ERR, "Failed to re-arm the profile timer: %m"); }
+}
+
+
+/**********************************************************************
+** find_services ()
+** 
+** List the services under root, in alphabetical order: every
+** subdirectory with an app/ config in it, and every config file named
+** <service_name>.conf. Each one's name goes in *names and the path to
+** its config in *paths. Anything else is skipped, with a warning for
+** directories.
+** 
+** Returns the number of services found. Causes exit on failure.
+*/
+int
+find_services (const char *root, char ***names, char ***paths)
+{
+	struct dirent **entries;
+	struct stat st;
+	char path[PATH_MAX];
+	char *name;
+	size_t len;
+	int nentries;
+	int count = 0;
+	int i;
+
+	nentries = scandir (root, &entries, NULL, alphasort);
+	if (nentries == -1)
+	{
+		self_log (LOG_ALERT, "Failed to read services directory [%s]: %m",
+		 root);
+		exit (errno);
+	}
+	*names = malloc ((nentries + 1) * sizeof (char*));
+	*paths = malloc ((nentries + 1) * sizeof (char*));
+	if (*names == NULL || *paths == NULL)
+	{
+		self_log (LOG_ALERT, "malloc: %m");
+		exit (errno);
+	}
+	for (i = 0; i < nentries; i++)
+	{
+		name = entries[i]->d_name;
+		len = strlen (name);
+		snprintf (path, sizeof (path), "%s/%s", root, name);
+		if (name[0] == '.' || stat (path, &st) != 0)
+		{
+			free (entries[i]);
+			continue;
+		}
+		if (S_ISDIR (st.st_mode))
+		{
+			snprintf (path, sizeof (path), "%s/%s/app", root, name);
+			if (stat (path, &st) == 0 && S_ISDIR (st.st_mode))
+			{
+				(*names)[count] = strdup (name);
+				snprintf (path, sizeof (path), "%s/%s", root, name);
+				(*paths)[count++] = strdup (path);
+			}
+			else self_log (LOG_WARNING,
+			 "Skipping [%s]: no app config directory.", name);
+		}
+		else if (S_ISREG (st.st_mode) && len > 5
+		 && strcmp (name + len - 5, ".conf") == 0)
+		{
+			(*names)[count] = strndup (name, len - 5);
+			(*paths)[count++] = strdup (path);
+		}
+		free (entries[i]);
+	}
+	free (entries);
+	return count;
+}
+
+
+/**********************************************************************
+** read_service_config ()
+** 
+** Read a service's config into cfg and its options into opts, which
+** start out as the command line's and are overridden by the service's
+** own (opts/, or settings in a config file). Filters and the like
+** point into cfg, so it must live as long as opts.
+** 
+** Returns -1, after logging why, if the config cannot be read or is
+** not valid; 0 otherwise.
+*/
+int
+read_service_config (supervisor_t *sv, config_t *cfg, options_t *opts)
+{
+	char **opt_argv;
+	const char *path;
+	int sync;
+	long long every;
+	int status;
+
+	status = load_config (cfg, sv->confdir);
+	if (status == EINVAL)
+	{
+		service_syslog (sv, LOG_ERR, "Config [%s] line %d: %s.",
+		 sv->confdir, cfg->error_line, cfg->error);
+		return -1;
+	}
+	if (status != 0)
+	{
+		errno = status;
+		service_syslog (sv, LOG_ALERT, "Failed to read config [%s]: %m",
+		 sv->confdir);
+		return -1;
+	}
+	status = -1;
+	if (cfg->app.count == 0)
+	{
+		service_syslog (sv, LOG_ERR,
+		 "Application config must have at least arg 0 defined.");
+	}
+	else if (cfg->log.count == 0)
+	{
+		service_syslog (sv, LOG_ERR,
+		 "Log handler config must have at least arg 0 defined.");
+	}
+	else if (uses_log_file (cfg)
+	 && parse_log_file (sv, cfg->log.items, &path, &sync, &every) != 0)
+	{
+		/* parse_log_file() has said what is wrong */
+	}
+	else if (cfg->fifo.count > MAXSOURCES)
+	{
+		service_syslog (sv, LOG_ERR, "No more than %d fifos may be given.",
+		 MAXSOURCES);
+	}
+	else if (cfg->sockets.count > MAXLISTEN)
+	{
+		service_syslog (sv, LOG_ERR, "No more than %d sockets may be given.",
+		 MAXLISTEN);
+	}
+	else if ((opt_argv = malloc ((cfg->opts.count + 2) * sizeof (char*)))
+	 == NULL)
+	{
+		service_syslog (sv, LOG_ALERT, "malloc: %m");
+	} else {
+		/* parsed like the command line */
+		*opts = default_opts;
+		opt_argv[0] = sv->name;
+		memcpy (opt_argv + 1, cfg->opts.items,
+		 (cfg->opts.count + 1) * sizeof (char*));
+		status = parse_options (opts, cfg->opts.count + 1, opt_argv,
+		 NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+		free (opt_argv);
+		if (status != 0)
+		{
+			service_syslog (sv, LOG_ERR, "Bad options in config [%s].",
+			 sv->confdir);
+		}
+	}
+	if (status != 0) free_config (cfg);
+	return status;
+}
+
+
+/**********************************************************************
+** new_scanner ()
+** 
+** Compile filters into a new line scanner; what names them in
+** messages.
+** 
+** Returns NULL, after logging why, on failure.
+*/
+line_scanner_t *
+new_scanner (supervisor_t *sv, char **in_filters, int in_count,
+ char **ex_filters, int ex_count, int use_regex, const char *what)
+{
+	line_scanner_t *scanner;
+	int status;
+
+	if ((scanner = malloc (sizeof (line_scanner_t))) == NULL)
+	{
+		service_syslog (sv, LOG_ALERT, "malloc: %m");
+		return NULL;
+	}
+	status = create_line_scanner (scanner, in_filters, in_count,
+	 ex_filters, ex_count, use_regex);
+	if (status == 0) return scanner;
+	if (status == EINVAL)
+	{
+		service_syslog (sv, LOG_ERR, "Invalid %s regex: %s", what,
+		 scanner->regex.error);
+	} else {
+		errno = status;
+		service_syslog (sv, LOG_ALERT, "create_line_scanner: %m");
+	}
+	destroy_line_scanner (scanner);
+	free (scanner);
+	return NULL;
+}
+
+
+/**********************************************************************
+** open_service_fifo ()
+** 
+** Create a fifo for the service, unless it exists already, and open
+** it.
+** 
+** Returns the fd, or -1, after logging why, on failure.
+*/
+int
+open_service_fifo (supervisor_t *sv, const char *path)
+{
+	int io_status;
+	int fd;
+
+	/* Check for existing file at fifo location */
+	io_status = is_fifo (path);
+	if (io_status == 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Please move existing log file out of the way: %s", path);
+		return -1;
+	}
+	else if (io_status == -1) /* no existing file */
+	{
+		if (make_fifo (path))
+		{
+			service_syslog (sv, LOG_ALERT, "Failed to create fifo [%s]: %m",
+			 path);
+			return -1;
+		}
+	}
+	/* now we should have an existing or new fifo */
+	fd = open_fifo (path);
+	if (fd == -1)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to open fifo [%s]: %m", path);
+	}
+	return fd;
+}
+
+
+/**********************************************************************
+** setup_service ()
+** 
+** Read a service's config and get everything ready for its first
+** spawn: argument lists, options, heartbeat scanner, log stream and
+** fifos on the I/O thread w, and the heartbeat timer on the
+** supervisor's loop.
+** 
+** Causes exit on failure.
+*/
+void
+setup_service (supervisor_t *sv, event_loop_t *loop, worker_t *w)
+{
+	config_t *cfg = &sv->config;
+	options_t *opts = &sv->opts;
+	line_scanner_t *scanner;
+	line_scanner_t *ready_scanner = NULL;
+	int fifo_fd;
+	int timer_fd;
+	int i;
+
+	sv->apppid = sv->logpid = sv->standbypid = sv->retiredpid = -1;
+	init_event_watch (&sv->timer_watch);
+	init_event_watch (&sv->restart_watch);
+
+	if (read_service_config (sv, cfg, opts) != 0) exit (EXIT_FAILURE);
+
+	scanner = new_scanner (sv, opts->in_filters, opts->in_count,
+	 opts->ex_filters, opts->ex_count, opts->use_regex, "filter");
+	if (scanner == NULL) exit (EXIT_FAILURE);
+	if (create_log_stream (&sv->ls, &w->loop, scanner) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "create_log_stream: %m");
+		exit (errno);
+	}
+	sv->ls.scanning = (opts->warn_thresh != 0 || opts->crit_thresh != 0
+	 || opts->restart_thresh != 0);
+	sv->ls.on_heartbeat = on_heartbeat;
+	sv->ls.heartbeat_data = sv;
+	sv->ls.self_log_tag = sv;
+	if (supervisor_profile != NULL && profile_log_stream (&sv->ls) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "profile_log_stream: %m");
+		exit (errno);
+	}
+
+	/* warm standby: its own stream, scanned for the ready line only */
+	if (opts->ready_filter != NULL)
+	{
+		ready_scanner = new_scanner (sv, &opts->ready_filter, 1, NULL, 0,
+		 opts->use_regex, "ready");
+		if (ready_scanner == NULL) exit (EXIT_FAILURE);
+	}
+	if (create_log_stream (&sv->standby_ls, &w->loop, ready_scanner) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "create_log_stream: %m");
+		exit (errno);
+	}
+	sv->standby_ls.on_heartbeat = on_heartbeat;
+	sv->standby_ls.heartbeat_data = sv;
+	init_worker_unit (&sv->unit, w, park_service, unpark_service, sv);
+
+	/* process list of fifos, create and open. */
+	for (i = 0; i < cfg->fifo.count; i++)
+	{
+		fifo_fd = open_service_fifo (sv, cfg->fifo.items[i]);
+		if (fifo_fd == -1) exit (errno || EXIT_FAILURE);
+		if (attach_source (&sv->ls, &sv->ls.fifos[i], fifo_fd, 1) != 0)
+		{
+			service_syslog (sv, LOG_ALERT,
+			 "Failed to watch fifo [%s]: %m",
+			 cfg->fifo.items[i]);
+			exit (errno);
+		}
+		sv->fifo_paths[i] = cfg->fifo.items[i];
+	}
+
+	/*
+	** Listening sockets are made once and passed to every instance of
+	** the app, so connections queue up in the backlog while it is
+	** being re-spawned instead of being refused.
+	*/
+	for (i = 0; i < cfg->sockets.count; i++)
+	{
+		sv->listen_fds[i] = open_listen_socket (cfg->sockets.items[i]);
+		if (sv->listen_fds[i] == -1)
+		{
+			service_syslog (sv, LOG_ALERT, "Failed to listen on [%s]: %m",
+			 cfg->sockets.items[i]);
+			exit (errno || EXIT_FAILURE);
+		}
+	}
+	sv->nlisten = cfg->sockets.count;
+
+	/* heartbeat deadlines; armed by reset_heartbeat_timers() */
+	timer_fd = open_timer_fd ();
+	if (timer_fd == -1
+	 || watch_fd (loop, &sv->timer_watch, timer_fd, EPOLLIN,
+	 on_timer_event, sv) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to create heartbeat timer: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+
+	/* re-spawns held back by the restart policy */
+	timer_fd = open_timer_fd ();
+	if (timer_fd == -1
+	 || watch_fd (loop, &sv->restart_watch, timer_fd, EPOLLIN,
+	 on_restart_event, sv) != 0)
+	{
+		service_syslog (sv, LOG_ALERT,
+		 "Failed to create restart timer: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	/* different seeds, so services that fail together spread out */
+	init_restart_backoff (&sv->app_backoff, getpid () ^ (uintptr_t) sv);
+	init_restart_backoff (&sv->log_backoff,
+	 getpid () ^ (uintptr_t) &sv->log_backoff);
+	init_restart_backoff (&sv->standby_backoff,
+	 getpid () ^ (uintptr_t) &sv->standby_backoff);
+
+	sv->min_thresh = min_non0_of3 (opts->warn_thresh, opts->crit_thresh,
+	 opts->restart_thresh);
+
+	/*
+	** In zero-copy mode, stop peeking for a while after each
+	** heartbeat; a tenth of the shortest threshold keeps the error
+	** in last_heartbeat small next to the thresholds.
+	*/
+	if (opts->zero_copy
+	 && enable_zero_copy (&sv->ls, sv->min_thresh / 10) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "enable_zero_copy: %m");
+		exit (errno);
+	}
+}
+
+
+/**********************************************************************
+** apply_stream_settings ()
+** 
+** worker_job_t, on the I/O thread: take up reloaded filters and scan
+** settings. A new scanner starts at the end of what is buffered, at
+** the start of a line as far as it knows. The old one is freed here,
+** as nothing else uses it.
+*/
+void
+apply_stream_settings (worker_t *w, void *arg)
+{
+	stream_settings_t *set = arg;
+	supervisor_t *sv = set->sv;
+	line_scanner_t *old;
+
+	if (set->scanner != NULL)
+	{
+		old = sv->ls.scanner;
+		mark_char_buffer_scanned (set->scanner, sv->ls.buffer);
+		sv->ls.scanner = set->scanner;
+		destroy_line_scanner (old);
+		free (old);
+	}
+	if (set->ready_changed)
+	{
+		old = sv->standby_ls.scanner;
+		if (set->ready_scanner != NULL)
+		{ mark_char_buffer_scanned (set->ready_scanner, sv->standby_ls.buffer); }
+		else sv->standby_ls.scanning = 0;
+		sv->standby_ls.scanner = set->ready_scanner;
+		destroy_line_scanner (old);
+		free (old);
+	}
+	sv->ls.scanning = set->scanning;
+	sv->ls.scan_window = set->scan_window;
+	free (set);
+}
+
+
+/**********************************************************************
+** swap_fifo ()
+** 
+** worker_job_t, on the I/O thread: stop reading the fifo in one slot
+** of ls.fifos[], after collecting what is in it, and start reading
+** the one handed over, if any.
+*/
+void
+swap_fifo (worker_t *w, void *arg)
+{
+	fifo_handoff_t *handoff = arg;
+	supervisor_t *sv = handoff->sv;
+	log_source_t *src = &sv->ls.fifos[handoff->slot];
+
+	detach_source (src);
+	flush_log_stream (&sv->ls);
+	if (handoff->fd != -1
+	 && attach_source (&sv->ls, src, handoff->fd, 1) != 0)
+	{
+		service_syslog (sv, LOG_ERR, "Failed to watch fifo: %m");
+		close (handoff->fd);
+	}
+	free (handoff);
+}
+
+
+/**********************************************************************
+** handoff_fifo ()
+** 
+** Send swap_fifo() a fifo fd for slot, or -1 to close the slot.
+** 
+** Causes exit on failure.
+*/
+void
+handoff_fifo (supervisor_t *sv, int slot, int fd)
+{
+	fifo_handoff_t *handoff = malloc (sizeof (fifo_handoff_t));
+
+	if (handoff != NULL)
+	{
+		handoff->sv = sv;
+		handoff->slot = slot;
+		handoff->fd = fd;
+	}
+	if (handoff == NULL
+	 || post_unit_job (&sv->unit, swap_fifo, handoff) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off fifo: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+}
+
+
+/**********************************************************************
+** same_strings ()
+** 
+** Whether two lists of strings are the same, in the same order.
+*/
+int
+same_strings (char **a, int acount, char **b, int bcount)
+{
+	int i;
+
+	if (acount != bcount) return 0;
+	for (i = 0; i < acount; i++)
+	{
+		if (strcmp (a[i], b[i]) != 0) return 0;
+	}
+	return 1;
+}
+
+
+/**********************************************************************
+** reload_fifos ()
+** 
+** Bring the open fifos in line with cfg: keep the ones still listed,
+** close the ones that are not, and open new ones in free slots. A new
+** fifo that cannot be opened is skipped, and tried again on the next
+** reload.
+*/
+void
+reload_fifos (supervisor_t *sv, config_t *cfg)
+{
+	char listed[MAXSOURCES];
+	int slot, i, fd;
+
+	memset (listed, 0, sizeof (listed));
+	for (slot = 0; slot < MAXSOURCES; slot++)
+	{
+		if (sv->fifo_paths[slot] == NULL) continue;
+		for (i = 0; i < cfg->fifo.count; i++)
+		{
+			if (!listed[i]
+			 && strcmp (cfg->fifo.items[i], sv->fifo_paths[slot]) == 0)
+			{ break; }
+		}
+		if (i < cfg->fifo.count)
+		{
+			listed[i] = 1;
+			sv->fifo_paths[slot] = cfg->fifo.items[i];
+			continue;
+		}
+		service_syslog (sv, LOG_NOTICE, "Closing fifo [%s].",
+		 sv->fifo_paths[slot]);
+		handoff_fifo (sv, slot, -1);
+		sv->fifo_paths[slot] = NULL;
+	}
+	for (i = 0; i < cfg->fifo.count; i++)
+	{
+		if (listed[i]) continue;
+		for (slot = 0; sv->fifo_paths[slot] != NULL; slot++) ;
+		if ((fd = open_service_fifo (sv, cfg->fifo.items[i])) == -1)
+		{ continue; }
+		service_syslog (sv, LOG_NOTICE, "Opened fifo [%s].",
+		 cfg->fifo.items[i]);
+		handoff_fifo (sv, slot, fd);
+		sv->fifo_paths[slot] = cfg->fifo.items[i];
+	}
+}
+
+
+/**********************************************************************
+** retune_thresholds ()
+** 
+** Take up the thresholds now in sv->opts: hand the scan settings, in
+** set along with anything else for the I/O thread, to the stream, and
+** re-arm the heartbeat timer. A warning already given is given again
+** if it now comes later; if there were no thresholds before, the
+** timers start with a grace period.
+** 
+** Causes exit on failure.
+*/
+void
+retune_thresholds (supervisor_t *sv, stream_settings_t *set,
+ int was_scanning)
+{
+	options_t *opts = &sv->opts;
+	long long since;
+	int scanning;
+
+	sv->min_thresh = min_non0_of3 (opts->warn_thresh, opts->crit_thresh,
+	 opts->restart_thresh);
+	scanning = (opts->warn_thresh != 0 || opts->crit_thresh != 0
+	 || opts->restart_thresh != 0);
+	set->scanning = scanning;
+	set->scan_window = sv->min_thresh / 10;
+	if (post_unit_job (&sv->unit, apply_stream_settings, set) != 0)
+	{
+		service_syslog (sv, LOG_ALERT, "Failed to hand off settings: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+
+	since = monotonic_ms () - sv->last_heartbeat;
+	if (opts->warn_thresh == 0 || since < opts->warn_thresh)
+	{ sv->warn_has_been_triggered = 0; }
+	if (opts->crit_thresh == 0 || since < opts->crit_thresh)
+	{ sv->crit_has_been_triggered = 0; }
+	if (scanning && !was_scanning) reset_heartbeat_timers (sv);
+	else arm_heartbeat_timer (sv);
+}
+
+
+/**********************************************************************
+** reload_service ()
+** 
+** Read the service's config again and apply what changed, while its
+** logs keep flowing: filters, thresholds and other options take effect
+** at once, only the fifos added or removed are opened or closed, and
+** the app (with its standby) or the log handler is only re-spawned if
+** its command line changed. A config that cannot be read or is not
+** valid is ignored, and the service keeps running as it was. Sockets
+** and -z are only set up at startup; changes to them are ignored with
+** a warning.
+*/
+void
+reload_service (supervisor_t *sv)
+{
+	config_t cfg;
+	options_t opts;
+	options_t *old = &sv->opts;
+	stream_settings_t *set;
+	int filters_changed, ready_changed;
+	int app_changed, log_changed;
+	int was_scanning;
+
+	if (read_service_config (sv, &cfg, &opts) != 0)
+	{
+		service_syslog (sv, LOG_ERR, "Config not reloaded.");
+		return;
+	}
+	if ((set = calloc (1, sizeof (stream_settings_t))) == NULL)
+	{
+		service_syslog (sv, LOG_ALERT, "calloc: %m");
+		free_config (&cfg);
+		return;
+	}
+	set->sv = sv;
+
+	filters_changed = opts.use_regex != old->use_regex
+	 || !same_strings (opts.in_filters, opts.in_count,
+	 old->in_filters, old->in_count)
+	 || !same_strings (opts.ex_filters, opts.ex_count,
+	 old->ex_filters, old->ex_count);
+	ready_changed = (opts.ready_filter == NULL)
+	 != (old->ready_filter == NULL)
+	 || (opts.ready_filter != NULL
+	 && (opts.use_regex != old->use_regex
+	 || strcmp (opts.ready_filter, old->ready_filter) != 0));
+	if ((filters_changed
+	 && (set->scanner = new_scanner (sv, opts.in_filters, opts.in_count,
+	 opts.ex_filters, opts.ex_count, opts.use_regex, "filter")) == NULL)
+	 || (ready_changed && opts.ready_filter != NULL
+	 && (set->ready_scanner = new_scanner (sv, &opts.ready_filter, 1,
+	 NULL, 0, opts.use_regex, "ready")) == NULL))
+	{
+		if (set->scanner != NULL)
+		{
+			destroy_line_scanner (set->scanner);
+			free (set->scanner);
+		}
+		free (set);
+		free_config (&cfg);
+		service_syslog (sv, LOG_ERR, "Config not reloaded.");
+		return;
+	}
+	set->ready_changed = ready_changed;
+
+	if (!same_strings (cfg.sockets.items, cfg.sockets.count,
+	 sv->config.sockets.items, sv->config.sockets.count))
+	{
+		service_syslog (sv, LOG_WARNING,
+		 "Sockets only change when heartmon is restarted.");
+	}
+	if (opts.zero_copy != old->zero_copy)
+	{
+		service_syslog (sv, LOG_WARNING,
+		 "Zero-copy (-z) only changes when heartmon is restarted.");
+		opts.zero_copy = old->zero_copy;
+	}
+	app_changed = !same_strings (cfg.app.items, cfg.app.count,
+	 sv->config.app.items, sv->config.app.count);
+	log_changed = !same_strings (cfg.log.items, cfg.log.count,
+	 sv->config.log.items, sv->config.log.count);
+	reload_fifos (sv, &cfg);
+
+	/* from here on, opts and the argv lists point into the new config */
+	was_scanning = (old->warn_thresh != 0 || old->crit_thresh != 0
+	 || old->restart_thresh != 0);
+	free_config (&sv->config);
+	sv->config = cfg;
+	sv->opts = opts;
+	if (sv->thresholds_set)
+	{
+		service_syslog (sv, LOG_NOTICE,
+		 "Thresholds set over the control socket give way to the config's.");
+		sv->thresholds_set = 0;
+	}
+	retune_thresholds (sv, set, was_scanning);
+
+	if (log_changed && sv->logpid != -1 && sv->log_stop.stage == STOP_NONE)
+	{
+		service_syslog (sv, LOG_NOTICE,
+		 "Log handler command line changed; re-spawning it.");
+		sv->log_killed = 1;
+		advance_stop (sv, &sv->log_stop, sv->logpid, "log handler");
+	}
+	else if (log_changed && sv->log_stop.stage == STOP_NONE
+	 && (sv->log_file_open || sv->log_restart_at != 0))
+	{
+		/* what is buffered goes to the new sink from here on */
+		service_syslog (sv, LOG_NOTICE, "Log config changed; switching.");
+		sv->log_restart_at = 0;
+		start_logger (sv);
+	}
+	if (app_changed && sv->apppid != -1 && !sv->app_killed)
+	{
+		service_syslog (sv, LOG_NOTICE,
+		 "Application command line changed; re-spawning it.");
+		sv->app_killed = sv->app_replaced = 1;
+		advance_stop (sv, &sv->app_stop, sv->apppid, "application");
+	}
+	if ((app_changed || opts.ready_filter == NULL) && sv->standbypid != -1
+	 && !sv->standby_killed)
+	{
+		/* not promoted; replaced once reaped, if still wanted */
+		sv->standby_killed = 1;
+		sv->standby_ready = 0;
+		advance_stop (sv, &sv->standby_stop, sv->standbypid, "standby");
+	}
+	if (opts.ready_filter == NULL) sv->standby_restart_at = 0;
+	else if (sv->standbypid == -1 && sv->standby_restart_at == 0)
+	{ start_standby (sv); }
+	arm_restart_timer (sv);
+	service_syslog (sv, LOG_NOTICE, "Reloaded config [%s].", sv->confdir);
+}
+
+
+/**********************************************************************
+** watch_config ()
+** 
+** Watch a service's config for changes with inotify: a config
+** directory and the lists in it, or the directory a config file is
+** in, as editors often replace the file rather than write to it.
+** Watching a directory twice is harmless, so this is done again after
+** each reload, to pick up lists that were added.
+*/
+void
+watch_config (supervisor_t *sv)
+{
+	static const char *subs[] = { "app", "log", "opts", "fifo", "sockets" };
+	uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM
+	 | IN_CREATE | IN_DELETE;
+	char path[PATH_MAX];
+	struct stat st;
+	int wd;
+	int i;
+
+	if (inotify_watch.fd == -1 || stat (sv->confdir, &st) != 0) return;
+	sv->nconfig_wds = 0;
+	sv->config_is_dir = S_ISDIR (st.st_mode);
+	if (!sv->config_is_dir)
+	{
+		snprintf (path, sizeof (path), "%s", sv->confdir);
+		wd = inotify_add_watch (inotify_watch.fd, dirname (path), mask);
+		if (wd != -1) sv->config_wds[sv->nconfig_wds++] = wd;
+		return;
+	}
+	wd = inotify_add_watch (inotify_watch.fd, sv->confdir, mask);
+	if (wd != -1) sv->config_wds[sv->nconfig_wds++] = wd;
+	for (i = 0; i < MAXCONFWATCHES - 1; i++)
+	{
+		snprintf (path, sizeof (path), "%s/%s", sv->confdir, subs[i]);
+		wd = inotify_add_watch (inotify_watch.fd, path, mask | IN_ONLYDIR);
+		if (wd != -1) sv->config_wds[sv->nconfig_wds++] = wd;
+	}
+}
+
+
+/**********************************************************************
+** config_event_matches ()
+** 
+** Whether an inotify event is about a service's config. Hidden files,
+** such as an editor's swap files, are not.
+*/
+int
+config_event_matches (supervisor_t *sv, const struct inotify_event *event)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < sv->nconfig_wds; i++)
+	{
+		if (sv->config_wds[i] == event->wd) break;
+	}
+	if (i == sv->nconfig_wds) return 0;
+	if (event->len > 0 && event->name[0] == '.') return 0;
+	if (sv->config_is_dir) return 1;
+	snprintf (path, sizeof (path), "%s", sv->confdir);
+	return event->len > 0 && strcmp (event->name, basename (path)) == 0;
+}
+
+
+/**********************************************************************
+** reload_services ()
+** 
+** Reload every service whose config has changed, or, with all, every
+** service.
+*/
+void
+reload_services (int all)
+{
+	supervisor_t *sv;
+	int i;
+
+	if (shutting_down) return;
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
+		if (!all && !sv->reload_pending) continue;
+		sv->reload_pending = 0;
+		reload_service (sv);
+		watch_config (sv);
+	}
+}
+
+
+/**********************************************************************
+** on_inotify_event ()
+** 
+** event_handler_t for the config watches. The services concerned are
+** reloaded RELOAD_DELAY_MS after the last change, so an edit that
+** comes as several changes is taken up once, whole.
+*/
+void
+on_inotify_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	char buf[4096]
+	 __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	const struct inotify_event *event;
+	ssize_t len;
+	char *p;
+	int changed = 0;
+	int i;
+
+	while ((len = read (fd, buf, sizeof (buf))) > 0)
+	{
+		for (p = buf; p < buf + len; p += sizeof (*event) + event->len)
+		{
+			event = (const struct inotify_event *) p;
+			for (i = 0; i < nservices; i++)
+			{
+				if (!config_event_matches (services[i], event)) continue;
+				services[i]->reload_pending = 1;
+				changed = 1;
+			}
+		}
+	}
+	if (changed
+	 && arm_timer_fd (reload_watch.fd, monotonic_ms () + RELOAD_DELAY_MS)
+	 == -1)
+	{
+		self_log (LOG_ERR, "Failed to arm reload timer: %m");
+	}
+}
+
+
+/**********************************************************************
+** on_reload_event ()
+** 
+** event_handler_t for the reload timerfd.
+*/
+void
+on_reload_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	unsigned long long expirations;
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	reload_services (0);
+}
+
+
+/**********************************************************************
+** on_hup_event ()
+** 
+** event_handler_t for the SIGHUP signalfd: reload every service.
+*/
+void
+on_hup_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	struct signalfd_siginfo info;
+
+	while (read (fd, &info, sizeof (info)) == sizeof (info))
+	{ ; }
+	self_log (LOG_INFO, "Received HUP signal; reloading configs.");
+	reload_services (1);
+}
+
+
+/**********************************************************************
+** find_service ()
 ** 
-** Causes exit if `optarg' contains a string longer than MAXSTRLEN.
+** The service called name, or NULL.
 */
-void
-set_str_optarg (char *var, const char *var_name) /* causes exit on failure */
+supervisor_t *
+find_service (const char *name)
 {
-	/* char *optarg - a global from unistd.h */
-	/* MAXSTRLEN - a global constant defined in the top of this file */
+	int i;
 
-	if (strlen (optarg) < MAXSTRLEN) strcpy (var, optarg);
-	else
+	for (i = 0; i < nservices; i++)
 	{
-		syslog (LOG_ALERT, "%s length cannot be longer than %d bytes.",
-		 var_name, MAXSTRLEN - 1 );
-		exit (EXIT_FAILURE);
+		if (strcmp (services[i]->name, name) == 0) return services[i];
 	}
+	return NULL;
 }
 
 
 /**********************************************************************
-** get_file_contents ()
+** print_control_reply ()
 ** 
-** Open a file and read its entire contents into *content.
-** Intended for reading small files such as those specifying
-** single environment variables, single command arguments, etc.
-** 
-** Returns 0 on success, or the value of `errno' on failure.
+** Start a line of a control reply: "ok" or "error", and the service
+** it is about, in multi-service mode.
 */
-int
-get_file_contents (const char *path, const char *fname, char **content)
+void
+print_control_reply (text_out_t *out, const char *status, supervisor_t *sv)
 {
-	char *fpath;
-	FILE *fh;
-	int status = 0; /* 0 = success */
-	int len = 0;
-	char *buf;
-	/* MAXSTRLEN - a global constant defined in the top of this file */
-
-	fpath = malloc (strlen (path) + strlen (fname) + 1);
-	sprintf (fpath, "%s/%s", path, fname);
-
-	buf = malloc (MAXSTRLEN);
+	if (sv != NULL && *sv->name)
+	{ text_printf (out, "%s %s: ", status, sv->name); }
+	else text_printf (out, "%s: ", status);
+}
 
-	if ((fh = fopen (fpath, "r")) != NULL)
-	{
-		len = fread (buf, sizeof (char), MAXSTRLEN, fh);
-		fclose (fh);
-	} else {
-		status = errno;
-	}
-	if (len > 0)
-	{
-		/* get rid of the newline, and a carriage return if there is one */
-		if (buf[len - 1] == '\n') buf[len - 1]='\0';
-		if (buf[len - 2] == '\r') buf[len - 2]='\0';
 
-		*content = malloc (len);
-		strncpy (*content, buf, len);
-	}
+/**********************************************************************
+** print_control_status ()
+** 
+** One line on a service for the control socket's status command.
+*/
+void
+print_control_status (text_out_t *out, supervisor_t *sv, long long now)
+{
+	long long age = now - sv->last_heartbeat;
+	char triggered[32];
+	char log[16];
 
-	free (fpath);
-	free (buf);
-	return status;
+	if (sv->log_file_open) snprintf (log, sizeof (log), "file");
+	else snprintf (log, sizeof (log), "%d", sv->logpid);
+	text_printf (out, "service=%s app=%d standby=%d ready=%d log=%s",
+	 *sv->name ? sv->name : "-", sv->apppid, sv->standbypid,
+	 sv->standby_ready, log);
+	text_printf (out, " heartbeat_age=%.3f buffer=%llu/%llu",
+	 age > 0 ? age / 1000.0 : 0.0, load_count (&sv->ls.buffer_held),
+	 load_count (&sv->ls.buffer_size));
+	text_printf (out, " warn=%.3f crit=%.3f restart=%.3f thresholds=%s",
+	 sv->opts.warn_thresh / 1000.0, sv->opts.crit_thresh / 1000.0,
+	 sv->opts.restart_thresh / 1000.0,
+	 sv->thresholds_set ? "set" : "config");
+	snprintf (triggered, sizeof (triggered), "%s%s%s",
+	 sv->warn_has_been_triggered ? ",warn" : "",
+	 sv->crit_has_been_triggered ? ",crit" : "",
+	 sv->app_killed ? ",restart" : "");
+	text_printf (out, " triggered=%s enforcement=%s\n",
+	 *triggered ? triggered + 1 : "-", sv->paused ? "paused" : "on");
 }
 
 
 /**********************************************************************
-** get_config ()
+** flush_streams ()
 ** 
-** Read *sub section of configuration directory, populating argv[].
-** Returns the number of args found.
+** worker_job_t, on the I/O thread: write out what the app's and the
+** standby's streams hold, as far as the log handler's pipe allows.
 */
-int
-get_config (const char *root, const char *sub, char *argv[])
+void
+flush_streams (worker_t *w, void *arg)
 {
-	char *path;
-	char fname[3];
-	int i;
-	/* MAXARGS - a global constant defined in the top of this file */
-
-	path = malloc (strlen (root) + strlen (sub) + 1);
-	sprintf (path, "%s/%s", root, sub);
+	supervisor_t *sv = arg;
 
-	for (i = 0; i < MAXARGS; i++)
-	{
-		sprintf (fname, "%d", i);
-		if (get_file_contents (path, fname, &argv[i]) != 0) break;
-	}
-	free (path);
-	return i;
+	flush_log_stream (&sv->ls);
+	flush_log_stream (&sv->standby_ls);
 }
 
 
 /**********************************************************************
-** contains_heartbeat ()
+** control_thresholds ()
 ** 
-** Use in_filter and ex_filter to examine the contents of ls_buffer
-** line by line to see if a heartbeat is found.
-** 
-** Returns 1 if a heartbeat is found or 0 if not.
-*/ 
-int
-contains_heartbeat (char_buffer_t *bufptr,
- const char *in_filter, const char *ex_filter)
+** The thresholds command for one service: take warn=, crit= and
+** restart= durations (0 for none) in place of the config's, until the
+** config is reloaded, or go back to the config's with "reset".
+*/
+void
+control_thresholds (text_out_t *out, supervisor_t *sv, char **args,
+ int nargs)
 {
-	int status = 0;
-	char *line, *content, *to_free;
+	const char *names[3] = {"warn", "crit", "restart"};
+	long long thresh[3];
+	stream_settings_t *set;
+	int was_scanning;
+	char *value;
+	int i, j;
 
-	/* If no filters are specified, then any bytes in
-	   the buffer qualify as a heartbeat. */
-	if (*in_filter == '\0' && *ex_filter == '\0'
-	 && get_char_buffer_contlen (bufptr) > 0)
+	if (nargs == 0)
+	{
+		print_control_reply (out, "error", sv);
+		text_printf (out, "give warn=, crit=, restart= or reset\n");
+		return;
+	}
+	thresh[0] = sv->opts.warn_thresh;
+	thresh[1] = sv->opts.crit_thresh;
+	thresh[2] = sv->opts.restart_thresh;
+	if (nargs == 1 && strcmp (args[0], "reset") == 0)
 	{
-		status = 1;
-		goto end;
+		if (sv->thresholds_set)
+		{ memcpy (thresh, sv->config_thresh, sizeof (thresh)); }
 	}
-	
-	/* Examine each line in the buffer separately. If any line
-	   qualifies as a heartbeat, return true (1). */
-	content = to_free = strdup (get_char_buffer_read_ptr (bufptr));
-	while ((line = strsep (&content, "\n")) != NULL)
+	else for (i = 0; i < nargs; i++)
 	{
-		if (*ex_filter != '\0')
+		value = strchr (args[i], '=');
+		for (j = 0; j < 3 && value != NULL; j++)
 		{
-			if (strstr (line, ex_filter) != NULL)
-			{ continue; }
+			if (strlen (names[j]) == (size_t)(value - args[i])
+			 && strncmp (args[i], names[j], value - args[i]) == 0) break;
 		}
-		if (*in_filter != '\0')
+		if (value == NULL || j == 3 || parse_millis (value + 1, &thresh[j]))
 		{
-			if (strstr (line, in_filter) != NULL)
-			{
-				status = 1;
-				break;
-			}
+			print_control_reply (out, "error", sv);
+			text_printf (out, "bad threshold [%s]\n", args[i]);
+			return;
 		}
 	}
-	if (to_free) free (to_free);
-end:
-	return status;
-}
-
-
-/**********************************************************************
-** min_non0_of3 ()
-*/ 
-int
-min_non0_of3 (int a, int b, int c)
-{
-	int m;
-	if (a == 0 && b == 0 && c == 0) return 0;
-	if (a != 0) m = a;
-	else if (b != 0) m = b;
-	else if (c != 0) m = c;
-	if (a != 0 && a < m) m = a;
-	if (b != 0 && b < m) m = b;
-	if (c != 0 && c < m) m = c;
-	return m;
+	if ((set = calloc (1, sizeof (stream_settings_t))) == NULL)
+	{
+		print_control_reply (out, "error", sv);
+		text_printf (out, "out of memory\n");
+		return;
+	}
+	set->sv = sv;
+	if (strcmp (args[0], "reset") == 0) sv->thresholds_set = 0;
+	else if (!sv->thresholds_set)
+	{
+		sv->config_thresh[0] = sv->opts.warn_thresh;
+		sv->config_thresh[1] = sv->opts.crit_thresh;
+		sv->config_thresh[2] = sv->opts.restart_thresh;
+		sv->thresholds_set = 1;
+	}
+	was_scanning = (sv->opts.warn_thresh != 0 || sv->opts.crit_thresh != 0
+	 || sv->opts.restart_thresh != 0);
+	sv->opts.warn_thresh = thresh[0];
+	sv->opts.crit_thresh = thresh[1];
+	sv->opts.restart_thresh = thresh[2];
+	retune_thresholds (sv, set, was_scanning);
+	service_syslog (sv, LOG_NOTICE,
+	 "Thresholds are now warn %lld ms, crit %lld ms, restart %lld ms%s.",
+	 thresh[0], thresh[1], thresh[2],
+	 sv->thresholds_set ? ", until the config is reloaded" : "");
+	print_control_reply (out, "ok", sv);
+	text_printf (out, "warn=%.3f crit=%.3f restart=%.3f\n",
+	 thresh[0] / 1000.0, thresh[1] / 1000.0, thresh[2] / 1000.0);
 }
 
 
 /**********************************************************************
-** shutdown_handler ()
-*/ 
+** control_service ()
+** 
+** Carry out a control command for one service, and reply with how it
+** went. Only thresholds takes args.
+*/
 void
-shutdown_handler ()
+control_service (text_out_t *out, supervisor_t *sv, const char *command,
+ char **args, int nargs)
 {
-	int result;
-	if (apppid != -1)
+	if (strcmp (command, "thresholds") == 0)
 	{
-		result = kill (apppid, SIGTERM);
-		if (result) syslog (LOG_WARNING,
-		 "Killing application process failed: %m");
-		else syslog (LOG_INFO, "Stopped application [%d].", apppid);
+		control_thresholds (out, sv, args, nargs);
 	}
-	if (logpid != -1)
+	else if (strcmp (command, "pause") == 0)
 	{
-		result = kill (logpid, SIGTERM);
-		if (result) syslog (LOG_WARNING,
-		 "Killing log handler process failed: %m");
-		else syslog (LOG_INFO, "Stopped log handler [%d].", logpid);
+		if (!sv->paused)
+		{
+			sv->paused = 1;
+			arm_heartbeat_timer (sv);
+			service_syslog (sv, LOG_NOTICE,
+			 "Heartbeat thresholds paused over the control socket.");
+		}
+		print_control_reply (out, "ok", sv);
+		text_printf (out, "paused\n");
+	}
+	else if (strcmp (command, "resume") == 0)
+	{
+		if (sv->paused)
+		{
+			/* count from now, as if a heartbeat had just gone by */
+			sv->paused = 0;
+			sv->last_heartbeat = monotonic_ms ();
+			sv->warn_has_been_triggered = 0;
+			sv->crit_has_been_triggered = 0;
+			arm_heartbeat_timer (sv);
+			service_syslog (sv, LOG_NOTICE,
+			 "Heartbeat thresholds resumed over the control socket.");
+		}
+		print_control_reply (out, "ok", sv);
+		text_printf (out, "resumed\n");
+	}
+	else if (strcmp (command, "restart") == 0)
+	{
+		if (sv->app_killed)
+		{
+			print_control_reply (out, "error", sv);
+			text_printf (out, "application [%d] is already being stopped\n",
+			 sv->apppid);
+			return;
+		}
+		service_syslog (sv, LOG_NOTICE,
+		 "Restarting application, as asked over the control socket.");
+		if (sv->apppid == -1)
+		{
+			/* waiting out its backoff; no more */
+			sv->app_restart_at = 0;
+			start_app (sv);
+			reset_heartbeat_timers (sv);
+			arm_restart_timer (sv);
+		}
+		else restart_app (sv, 1);
+		print_control_reply (out, "ok", sv);
+		text_printf (out, "restarting\n");
+	}
+	else if (strcmp (command, "flush") == 0)
+	{
+		if (post_unit_job (&sv->unit, flush_streams, sv) != 0)
+		{
+			print_control_reply (out, "error", sv);
+			text_printf (out, "cannot reach the I/O thread: %s\n",
+			 strerror (errno));
+			return;
+		}
+		print_control_reply (out, "ok", sv);
+		text_printf (out, "flushing %llu bytes\n",
+		 load_count (&sv->ls.buffer_held));
 	}
-	syslog (LOG_INFO, "Stopping heartmon.");
-	return ;
 }
 
 
 /**********************************************************************
-** sigterm_handler ()
-*/ 
+** render_control ()
+** 
+** text_render_t for the control socket (-C): carry out the command in
+** request and reply to it. A command given no service is for every
+** service, except restart, which only has a default with one service.
+*/
 void
-sigterm_handler (int signo)
+render_control (text_out_t *out, const char *request, void *data)
 {
-	if (signo == SIGTERM)
+	const char *commands[CONTROL_COMMANDS] = {"help", "status", "pause",
+	 "resume", "restart", "flush", "thresholds"};
+	char line[TEXT_REQUEST_MAX];
+	char *words[CONTROL_WORDS];
+	char *save;
+	char *word;
+	supervisor_t *sv = NULL;
+	long long now = monotonic_ms ();
+	int nwords = 0;
+	int first = 1;
+	int command;
+	int i;
+
+	snprintf (line, sizeof (line), "%s", request);
+	for (word = strtok_r (line, " \t", &save);
+	 word != NULL && nwords < CONTROL_WORDS;
+	 word = strtok_r (NULL, " \t", &save))
+	{ words[nwords++] = word; }
+	if (nwords == 0)
 	{
-		syslog (LOG_INFO, "Received TERM signal.");
-		exit (EXIT_SUCCESS);
-	} else {
-		syslog (LOG_INFO, "Received signal %d.", signo);
+		text_printf (out, "error: no command; try help\n");
+		return;
+	}
+	for (command = 0; command < CONTROL_COMMANDS
+	 && strcmp (words[0], commands[command]) != 0; command++) ;
+	if (command == CONTROL_COMMANDS)
+	{
+		text_printf (out, "error: unknown command [%s]; try help\n",
+		 words[0]);
+		return;
+	}
+	if (command == 0)
+	{
+		text_printf (out,
+		 "status [service]      pids, heartbeat age, buffer, thresholds\n"
+		 "restart [service]     replace the app now, with no backoff\n"
+		 "thresholds [service] warn=T crit=T restart=T | reset\n"
+		 "                      until reset or the config is reloaded\n"
+		 "pause [service]       stop enforcing thresholds\n"
+		 "resume [service]      enforce them again, from now\n"
+		 "flush [service]       write out the log buffer\n");
+		return;
+	}
+	if (nwords > 1 && (sv = find_service (words[1])) != NULL) first = 2;
+	if (nwords > first && strcmp (words[0], "thresholds") != 0)
+	{
+		text_printf (out, "error: no service [%s]\n", words[first]);
+		return;
+	}
+	if (shutting_down && strcmp (words[0], "status") != 0)
+	{
+		text_printf (out, "error: shutting down\n");
+		return;
+	}
+	if (strcmp (words[0], "restart") == 0 && sv == NULL && nservices > 1)
+	{
+		text_printf (out, "error: restart which service?\n");
+		return;
+	}
+	for (i = 0; i < nservices; i++)
+	{
+		if (sv != NULL && services[i] != sv) continue;
+		if (strcmp (words[0], "status") == 0)
+		{
+			print_control_status (out, services[i], now);
+		}
+		else control_service (out, services[i], words[0], words + first,
+		 nwords - first);
 	}
-	return ;
 }
 
 
@@ -330,58 +3843,37 @@ int
 main (int argc, char *argv[])
 {
 	/* MAXSTRLEN - preproc define at the top of this file */
-	/* MAXARGS - preproc define at the top of this file */
-	/* MAXFDS - preproc define at the top of this file */
-	/* BUFFERSIZE - preproc define at the top of this file */
-	/* SELECT_TIMEOUT_SEC - preproc define at the top of this file */
 	/* SYSLOG_IDENT - preproc define at the top of this file */
 
-	int i, j;
-
-	char opt;
-	/* char *optarg - global from unistd.h */
+	int i;
 
 	char hm_confdir[MAXSTRLEN];
-	char in_filter[MAXSTRLEN];
-	char ex_filter[MAXSTRLEN];
-	int warn_thresh;
-	int crit_thresh;
-	int restart_thresh;
-	int min_thresh;
-
-	time_t now;
-	time_t last_heartbeat;
-	int warn_has_been_triggered;
-	int crit_has_been_triggered;
-
-	char *app_argv[MAXARGS + 1];
-	char *log_argv[MAXARGS + 1];
-	char *fifo_list[MAXARGS + 1];
-	int argcount;
+	char services_dir[MAXSTRLEN];
+	char metrics_path[MAXSTRLEN];
+	char control_path[MAXSTRLEN];
+	char **names;
+	char **paths;
+	supervisor_t *sv;
+	worker_t *worker;
+	int threads = 0;
+	long long profile = -1;
+	int quiet = 0;
 
-	int app_stdout[2];
-	int app_stderr[2];
-	int log_stdin[2];
-	int fifo_fds[MAXFDS - 3];
-	int readbytes;
-
-	// pid_t apppid - global
-	// pid_t logpid - global
-	pid_t result;
-	int statusinfo;
-
-	int readycount;
+	int child_fd;
+	int term_fd;
+	int hup_fd;
+	int usr1_fd;
+	int inotify_fd;
+	int timer_fd;
+	int fd;
 	int io_status;
-	int fds[MAXFDS];
-	fd_set readfds, writefds, errorfds;
-	struct timeval timeout;
+	int status;
 
 	void (*shutdown_hdlr_ptr)(void);
 	shutdown_hdlr_ptr = &shutdown_handler;
 
-	/* log stream buffer */
-	char_buffer_t *ls_buffer = malloc (sizeof (char_buffer_t));
-	int resize_status;
+	/* one event loop for every service's streams, timers and children */
+	event_loop_t loop;
 
 	/* syslog settings */
 	const char *syslog_ident = SYSLOG_IDENT;
@@ -392,359 +3884,323 @@ main (int argc, char *argv[])
 	openlog (syslog_ident, syslog_logopt, syslog_facility);
 
 	/* initialize vars to zero/null */
-	in_filter[0] = '\0';
-	ex_filter[0] = '\0';
 	hm_confdir[0] = '\0';
-	for (i = 0; i < MAXARGS + 1; i++)
+	services_dir[0] = '\0';
+	metrics_path[0] = '\0';
+	control_path[0] = '\0';
+	memset (&default_opts, 0, sizeof (default_opts));
+	default_restart_policy (&default_opts.restart);
+	default_opts.stop_grace = 5000;
+	init_event_watch (&child_watch);
+	init_event_watch (&term_watch);
+	init_event_watch (&hup_watch);
+	init_event_watch (&inotify_watch);
+	init_event_watch (&reload_watch);
+	init_event_watch (&rebalance_watch);
+	init_event_watch (&usr1_watch);
+	init_event_watch (&profile_watch);
+
+	if (parse_options (&default_opts, argc, argv, hm_confdir, services_dir,
+	 &threads, metrics_path, &profile, control_path, &quiet) != 0)
+	{ usage (argv[0]); }
+
+	/* from here on, messages go through self_log; see self_log.c */
+	if ((status = open_self_log (SYSLOG_IDENT, !quiet)) != 0)
 	{
-		app_argv[i] = NULL;
-		log_argv[i] = NULL;
-		fifo_list[i] = NULL;
+		errno = status;
+		self_log (LOG_ALERT, "Failed to start the syslog thread: %m");
+		exit (status);
 	}
-	for (i = 0; i < MAXFDS - 3; i++)
+
+	if ((*hm_confdir == '\0') == (*services_dir == '\0'))
 	{
-		fifo_fds[i] = -1;
+		self_log (LOG_ERR,
+		 "Exactly one of -d (config) or -m (services directory) is required.");
+		usage (argv[0]);
 	}
-	if (create_char_buffer (ls_buffer, BUFFERSIZE) != 0)
+
+	/* one unnamed service for -d, one per service directory for -m */
+	if (*hm_confdir != '\0')
 	{
-		syslog (LOG_ALERT, "create_char_buffer: %m");
-		exit (errno);
+		names = malloc (sizeof (char*));
+		paths = malloc (sizeof (char*));
+		names[0] = "";
+		paths[0] = hm_confdir;
+		nservices = 1;
+	} else {
+		nservices = find_services (services_dir, &names, &paths);
+		if (nservices == 0)
+		{
+			self_log (LOG_ERR, "No services found in [%s].", services_dir);
+			exit (EXIT_FAILURE);
+		}
 	}
-	warn_thresh = crit_thresh = restart_thresh = min_thresh = 0;
-
-	while ((opt = getopt (argc, argv, "i:e:w:c:r:d:")) != -1)
+	services = calloc (nservices, sizeof (supervisor_t*));
+	for (i = 0; i < nservices; i++)
 	{
-		switch (opt)
+		sv = services[i] = calloc (1, sizeof (supervisor_t));
+		if (sv == NULL)
 		{
-			case 'i':
-				set_str_optarg (in_filter, "include filter");
-				break;
-			case 'e':
-				set_str_optarg (ex_filter, "exclude filter");
-				break;
-			case 'd':
-				set_str_optarg (hm_confdir, "heartmon config directory");
-				break;
-			case 'w':
-				warn_thresh = atoi (optarg);
-				break;
-			case 'c':
-				crit_thresh = atoi (optarg);
-				break;
-			case 'r':
-				restart_thresh = atoi (optarg);
-				break;
-			default: /* '?' */
-				usage (argv[0]);
+			self_log (LOG_ALERT, "calloc: %m");
+			exit (errno);
 		}
+		sv->name = names[i];
+		sv->confdir = paths[i];
+		sv->apppid = sv->logpid = sv->standbypid = sv->retiredpid = -1;
 	}
 
-	if (*hm_confdir == '\0')
+	if (create_event_loop (&loop) != 0)
 	{
-		syslog (LOG_ERR, "Heartmon config directory (-d) is required.");
-		usage (argv[0]);
+		self_log (LOG_ALERT, "create_event_loop: %m");
+		exit (errno);
 	}
 
-	/* process app command-line into app_argv[]. */
-	argcount = get_config (hm_confdir, "app", app_argv);
-	if (argcount == 0)
+	/*
+	** Log streams run on I/O threads (one, or as many as -t asks
+	** for), and services are dealt out to them in turn. This thread
+	** is the supervisor: it spawns, reaps, kills and keeps the
+	** heartbeat timers, and hears of heartbeats through each I/O
+	** thread's events ring.
+	*/
+	nworkers = threads < nservices ? threads : nservices;
+	if (nworkers < 1) nworkers = 1;
+	select_scan_kernel (SCAN_KERNEL_AUTO);
+	workers = calloc (nworkers, sizeof (worker_t));
+	self_log_watches = calloc (nworkers, sizeof (event_watch_t));
+	if (workers == NULL || self_log_watches == NULL)
 	{
-		syslog (LOG_ERR,
-		 "Application config must have at least arg 0 defined.");
-		exit (EXIT_FAILURE);
+		self_log (LOG_ALERT, "calloc: %m");
+		exit (errno);
 	}
-	
-	/* process logger command-line into log_argv[]. */
-	argcount = get_config (hm_confdir, "log", log_argv);
-	if (argcount == 0)
+	for (i = 0; i < nworkers; i++)
 	{
-		syslog (LOG_ERR,
-		 "Log handler config must have at least arg 0 defined.");
-		exit (EXIT_FAILURE);
+		worker = &workers[i];
+		if ((status = create_worker (worker, i)) != 0
+		 || (status = watch_fd (&loop, &worker->events_watch,
+		 worker->events.wake_fd, EPOLLIN, on_worker_events, worker)) != 0)
+		{
+			errno = status;
+			self_log (LOG_ALERT, "Failed to set up I/O thread: %m");
+			exit (status);
+		}
+
+		/* heartmon's own messages, to inject into its streams */
+		init_event_watch (&self_log_watches[i]);
+		fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd == -1 || (status = add_self_log_waker (fd)) != 0
+		 || (status = watch_fd (&worker->loop, &self_log_watches[i], fd,
+		 EPOLLIN, on_self_log_event, worker)) != 0)
+		{
+			if (fd == -1) status = errno;
+			errno = status;
+			self_log (LOG_ALERT, "Failed to set up I/O thread: %m");
+			exit (status);
+		}
 	}
 
-	/* process list of fifos, create and open. */
-	argcount = get_config (hm_confdir, "fifo", fifo_list);
-	if (argcount != 0)
+	/* -P: time the loops, the supervisor and the streams, in phases */
+	if (profile >= 0)
 	{
-		for (i = 0; i < argcount; i++)
+		profile_every = profile;
+		supervisor_profile = new_latency_hists (SV_PHASES);
+		loop.latency = new_latency_hists (1);
+		if (supervisor_profile == NULL || loop.latency == NULL)
 		{
-			// syslog (LOG_DEBUG, "Checking for fifo[%d]:[%s]",
-			//  i, fifo_list[i]);
-			/* Check for existing file at fifo location */
-			io_status = is_fifo (fifo_list[i]);
-			if (io_status == 0)
-			{
-				syslog (LOG_ALERT,
-				 "Please move existing log file out of the way: %s",
-				 fifo_list[i]);
-				exit (EXIT_FAILURE);
-			}
-			else if (io_status == -1) /* no existing file */
-			{
-				if (make_fifo (fifo_list[i]))
-				{
-					syslog (LOG_ALERT,
-					 "Failed to create fifo [%s]: %m",
-					 fifo_list[i]);
-					exit (errno);
-				}
-			}
-			/* now we should have an existing or new fifo */
-			fifo_fds[i] = open_fifo (fifo_list[i]);
-			if (fifo_fds[i] == -1)
+			self_log (LOG_ALERT, "Failed to set up profiling: %m");
+			exit (errno);
+		}
+		for (i = 0; i < nworkers; i++)
+		{
+			workers[i].loop.latency = new_latency_hists (1);
+			if (workers[i].loop.latency == NULL)
 			{
-				syslog (LOG_ALERT,
-				 "Failed to open fifo [%s]: %m",
-				 fifo_list[i]);
+				self_log (LOG_ALERT, "Failed to set up profiling: %m");
 				exit (errno);
 			}
 		}
 	}
+	for (i = 0; i < nservices; i++)
+	{
+		setup_service (services[i], &loop, &workers[i % nworkers]);
+	}
 
 	atexit (shutdown_hdlr_ptr);
-	if (signal (SIGTERM, sigterm_handler) == SIG_ERR)
-	{ syslog (LOG_WARNING, "Cannot catch SIGTERM."); }
-
-	syslog (LOG_INFO, "======== STARTUP ========");
+	/* a dead log handler shows up as EPIPE from write() instead */
+	if (signal (SIGPIPE, SIG_IGN) == SIG_ERR)
+	{ self_log (LOG_WARNING, "Cannot ignore SIGPIPE."); }
 
-	/* spawn the logger process */
-	logpid = spawn_process (log_stdin, NULL, NULL, log_argv);
-	if (logpid == -1)
+	/* child exits arrive as events; set up before the first spawn */
+	child_fd = open_signal_fd (SIGCHLD);
+	if (child_fd == -1
+	 || watch_fd (&loop, &child_watch, child_fd, EPOLLIN,
+	 on_child_event, NULL) != 0)
 	{
-		syslog (LOG_ALERT, "Failed to start log handler: %m");
-		exit (errno);
+		self_log (LOG_ALERT, "Failed to watch for SIGCHLD: %m");
+		exit (errno || EXIT_FAILURE);
 	}
-	syslog (LOG_NOTICE, "Started log handler [%d]: %s",
-	 logpid, log_argv[0]);
 
-	/* spawn the application process */
-	apppid = spawn_process (NULL, app_stdout, app_stderr, app_argv);
-	if (apppid == -1)
+	/* SIGTERM stops the children in order; see begin_shutdown() */
+	term_fd = open_signal_fd (SIGTERM);
+	if (term_fd == -1
+	 || watch_fd (&loop, &term_watch, term_fd, EPOLLIN,
+	 on_term_event, NULL) != 0)
 	{
-		syslog (LOG_ALERT, "Failed to start application: %m");
-		exit (errno);
+		self_log (LOG_ALERT, "Failed to watch for SIGTERM: %m");
+		exit (errno || EXIT_FAILURE);
 	}
-	syslog (LOG_NOTICE, "Started application [%d]: %s",
-	 apppid, app_argv[0]);
 
 	/*
-	** Give a startup grace period equal to min_thresh,
-	** so the first warning will come no earlier than
-	** min_thresh * 2.
+	** Configs are reloaded on SIGHUP, and when they are edited. Without
+	** inotify, SIGHUP still works.
 	*/
-	min_thresh = min_non0_of3 (warn_thresh, crit_thresh,
-	 restart_thresh);
-	last_heartbeat = time (NULL) + min_thresh;
-	warn_has_been_triggered = 0;
-	crit_has_been_triggered = 0;
+	hup_fd = open_signal_fd (SIGHUP);
+	timer_fd = open_timer_fd ();
+	if (hup_fd == -1
+	 || watch_fd (&loop, &hup_watch, hup_fd, EPOLLIN,
+	 on_hup_event, NULL) != 0
+	 || timer_fd == -1
+	 || watch_fd (&loop, &reload_watch, timer_fd, EPOLLIN,
+	 on_reload_event, NULL) != 0)
+	{
+		self_log (LOG_ALERT, "Failed to watch for SIGHUP: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd == -1
+	 || watch_fd (&loop, &inotify_watch, inotify_fd, EPOLLIN,
+	 on_inotify_event, NULL) != 0)
+	{
+		self_log (LOG_WARNING, "Cannot watch configs for changes: %m");
+		if (inotify_fd != -1) close (inotify_fd);
+	}
+	for (i = 0; i < nservices; i++) watch_config (services[i]);
 
-	/* main loop: read from app and write to log handler */
-	while (1)
+	/* SIGUSR1 dumps the profile, and so does a timer with -P seconds */
+	usr1_fd = open_signal_fd (SIGUSR1);
+	if (usr1_fd == -1
+	 || watch_fd (&loop, &usr1_watch, usr1_fd, EPOLLIN,
+	 on_usr1_event, NULL) != 0)
+	{
+		self_log (LOG_ALERT, "Failed to watch for SIGUSR1: %m");
+		exit (errno || EXIT_FAILURE);
+	}
+	if (profile_every > 0)
 	{
-		/* check for terminated app process. restart if needed */
-		result = waitpid (apppid, &statusinfo, WNOHANG);
-		if (result == -1)
+		timer_fd = open_timer_fd ();
+		if (timer_fd == -1
+		 || watch_fd (&loop, &profile_watch, timer_fd, EPOLLIN,
+		 on_profile_event, NULL) != 0
+		 || arm_timer_fd (timer_fd, monotonic_ms () + profile_every) == -1)
 		{
-			syslog (LOG_ERR, "Problem checking status of app process: %m");
-			/* kill the app process and restart it */
-			if (kill (apppid, SIGKILL) != 0)
-			{
-				syslog (LOG_ALERT,
-				 "kill(apppid,SIGKILL) failed: %m");
-				exit (errno || EXIT_FAILURE);
-			}
-			apppid = spawn_process (NULL, app_stdout, app_stderr, app_argv);
-			if (apppid == -1)
-			{
-				syslog (LOG_ALERT, "Failed to start application: %m");
-				exit (errno);
-			}
-			syslog (LOG_NOTICE, "Started application [%d]: %s",
-			 apppid, app_argv[0]);
-			last_heartbeat = time (NULL) + min_thresh;
-			warn_has_been_triggered = 0;
-			crit_has_been_triggered = 0;
-		}
-		else if (result != 0)
-		{
-			syslog (LOG_ERR, "Application has terminated unexpectedly.");
-			/* restart it */
-			apppid = spawn_process (NULL, app_stdout, app_stderr, app_argv);
-			if (apppid == -1)
-			{
-				syslog (LOG_ALERT, "Failed to start application: %m");
-				exit (errno);
-			}
-			syslog (LOG_NOTICE, "Started application [%d]: %s",
-			 apppid, app_argv[0]);
-			last_heartbeat = time (NULL) + min_thresh;
-			warn_has_been_triggered = 0;
-			crit_has_been_triggered = 0;
+			self_log (LOG_ALERT, "Failed to create profile timer: %m");
+			exit (errno || EXIT_FAILURE);
 		}
-
-		/* shrink log stream buffer if needed */
-		if (get_char_buffer_space (ls_buffer) >= BUFFERSIZE * 2)
+	}
+	if (nworkers > 1)
+	{
+		timer_fd = open_timer_fd ();
+		if (timer_fd == -1
+		 || watch_fd (&loop, &rebalance_watch, timer_fd, EPOLLIN,
+		 on_rebalance_event, NULL) != 0
+		 || arm_timer_fd (timer_fd, monotonic_ms () + REBALANCE_MS) == -1)
 		{
-			resize_status = resize_char_buffer (ls_buffer, -1 * BUFFERSIZE);
-			if (resize_status > 0)
-			{
-				syslog (LOG_ALERT, "resize_char_buffer: %m");
-				exit (errno);
-			}
-			if (resize_status == -1)
-			{
-				syslog (LOG_ERR,
-				 "Buffer resize would lose data (although we checked first).");
-			}
+			self_log (LOG_ALERT, "Failed to create rebalance timer: %m");
+			exit (errno || EXIT_FAILURE);
 		}
+	}
 
-		/* extend log stream buffer if needed */
-		if (get_char_buffer_space (ls_buffer) <= BUFFERSIZE / 2)
+	/* -M: counts for Prometheus, served by this thread */
+	if (*metrics_path != '\0')
+	{
+		status = open_text_server (&metrics_server, &loop, metrics_path,
+		 render_metrics, &loop, 0);
+		if (status != 0)
 		{
-			resize_status = resize_char_buffer (ls_buffer, BUFFERSIZE);
-			if (resize_status > 0)
-			{
-				syslog (LOG_ALERT, "resize_char_buffer: %m");
-				exit (errno);
-			}
-			if (resize_status == -1)
-			{
-				syslog (LOG_ERR,
-	 "Buffer resize would lose data (although we asked to grow, not shrink).");
-			}
+			errno = status;
+			self_log (LOG_ALERT, "Cannot serve metrics on [%s]: %m",
+			 metrics_path);
+			exit (status);
 		}
+	}
 
-		/* Read from readable file descriptors */
-		i = 0;
-		fds[i++] = app_stdout[READ_END];
-		fds[i++] = app_stderr[READ_END];
-		for (j = 0; j < MAXFDS - 3; j++)
+	/* -C: commands from the operator, also carried out by this thread */
+	if (*control_path != '\0')
+	{
+		status = open_text_server (&control_server, &loop, control_path,
+		 render_control, NULL, 1);
+		if (status != 0)
 		{
-			if (fifo_fds[j] != -1) fds[i++] = fifo_fds[j];
+			errno = status;
+			self_log (LOG_ALERT, "Cannot listen for control on [%s]: %m",
+			 control_path);
+			exit (status);
 		}
+	}
 
-		io_status = read_readable (fds, i, SELECT_TIMEOUT_SEC, ls_buffer);
-		if (io_status == -1)
-		{
-			syslog (LOG_ERR,
-			"Failed to read from app. Select() in read_readable() said: %m");
-		}
+	self_log (LOG_INFO, "======== STARTUP ========");
+	if (*services_dir != '\0')
+	{
+		self_log (LOG_INFO, "Supervising %d service(s) from [%s].",
+		 nservices, services_dir);
+	}
+	if (nworkers > 1)
+	{
+		self_log (LOG_INFO, "Forwarding logs on %d I/O threads.", nworkers);
+	}
 
-		/* check for heartbeat, using in_filter, ex_filter */
-		if (warn_thresh == 0 && crit_thresh == 0
-		 && restart_thresh == 0) goto nohealthchecking;
-		now = time(NULL);
-		if (contains_heartbeat (ls_buffer, in_filter, ex_filter))
-		{
-			// syslog (LOG_DEBUG, "found healthcheck");
-			if (warn_has_been_triggered || crit_has_been_triggered)
-			{ syslog (LOG_NOTICE, "Heartbeat detected. Resetting timers."); }
-			last_heartbeat = now;
-			warn_has_been_triggered = 0;
-			crit_has_been_triggered = 0;
-		} else {
-			// syslog (LOG_DEBUG, "found NO healthcheck. delta t = %ld",
-			// now - last_heartbeat);
-			// syslog (LOG_DEBUG, "last heartbeat = %ld", last_heartbeat);
-			if (!(warn_has_been_triggered) && warn_thresh != 0
-			  && now - last_heartbeat >= warn_thresh)
-			{
-				syslog (LOG_WARNING,
-				 "Heartbeat warning threshold reached for %s",
-				 app_argv[0]);
-				warn_has_been_triggered = 1;
-			}
-			if (!(crit_has_been_triggered) && crit_thresh != 0
-			  && now - last_heartbeat >= crit_thresh)
-			{
-				syslog (LOG_ERR,
-				 "Heartbeat critical threshold reached for %s",
-				 app_argv[0]);
-				crit_has_been_triggered = 1;
-			}
-			if (restart_thresh != 0
-			 && now - last_heartbeat >= restart_thresh)
-			{
-				syslog (LOG_ERR,
-				 "KILLING APP: Heartbeat restart threshold reached for %s.",
-				 app_argv[0]);
-				if (kill (apppid, SIGKILL) != 0)
-				{
-					syslog (LOG_ALERT,
-					 "kill(apppid,SIGKILL) failed: %m");
-					exit (errno || EXIT_FAILURE);
-				}
-				apppid = spawn_process (NULL, app_stdout, app_stderr, app_argv);
-				if (apppid == -1)
-				{
-					syslog (LOG_ALERT, "Failed to start application: %m");
-					exit (errno);
-				}
-				syslog (LOG_NOTICE, "Started application [%d]: %s",
-				 apppid, app_argv[0]);
-				last_heartbeat = time (NULL) + min_thresh;
-				warn_has_been_triggered = 0;
-				crit_has_been_triggered = 0;
-			}
-		} /* else (not contains_heartbeat) */
-nohealthchecking:
+	for (i = 0; i < nservices; i++)
+	{
+		sv = services[i];
 
-		/* check for terminated logger process. restart if needed */
-		result = waitpid (logpid, &statusinfo, WNOHANG);
-		if (result == -1)
-		{
-			syslog (LOG_ERR,
-			 "Problem checking status of logger process: %m");
-			/* kill the logger process and restart it */
-			if (kill (logpid, SIGKILL) != 0)
-			{
-				syslog (LOG_ALERT, "kill(logpid,SIGKILL) failed: %m");
-				exit (errno || EXIT_FAILURE);
-			}
-			logpid = spawn_process (log_stdin, NULL, NULL, log_argv);
-			if (logpid == -1)
-			{
-				syslog (LOG_ALERT, "Failed to start log handler: %m");
-				exit (errno);
-			}
-			syslog (LOG_NOTICE, "Started log handler [%d]: %s",
-			 logpid, log_argv[0]);
-		}
-		else if (result != 0)
+		/* spawn the logger process */
+		start_logger (sv);
+
+		/* spawn the application process */
+		start_app (sv);
+
+		/* and, with -s, its warm standby */
+		if (sv->opts.ready_filter != NULL) start_standby (sv);
+
+		/*
+		** Give a startup grace period equal to min_thresh,
+		** so the first warning will come no earlier than
+		** min_thresh * 2.
+		*/
+		reset_heartbeat_timers (sv);
+	}
+
+	/* from here on, only the I/O threads touch the log streams */
+	for (i = 0; i < nworkers; i++)
+	{
+		if ((status = start_worker (&workers[i])) != 0)
 		{
-			syslog (LOG_ERR, "Log handler has terminated unexpectedly.");
-			logpid = spawn_process (log_stdin, NULL, NULL, log_argv);
-			if (logpid == -1)
-			{
-				syslog (LOG_ALERT, "Failed to start log handler: %m");
-				exit (errno);
-			}
-			syslog (LOG_NOTICE, "Started log handler [%d]: %s",
-			 logpid, log_argv[0]);
+			errno = status;
+			self_log (LOG_ALERT, "start_worker: %m");
+			exit (status);
 		}
+	}
+	self_log_streams_ready ();
 
-		/* write buffer to logging file descriptor if writable */
-		i = 0;
-		fds[i++] = log_stdin[WRITE_END];
-		io_status = write_writable (fds, i, SELECT_TIMEOUT_SEC, ls_buffer);
+	/*
+	** main loop: supervise. The I/O threads read from the apps,
+	** write to the log handlers and pass heartbeats found by the
+	** scanner to on_worker_events(). Exits of apps and log handlers
+	** are handled (and they are re-spawned) by on_child_event(), and
+	** thresholds are enforced by on_timer_event() when a deadline
+	** comes up, all inside the event loop. Nothing here runs on a
+	** fixed period, and nothing here holds up the log streams.
+	*/
+	while (1)
+	{
+		/*
+		** Wait for a heartbeat, a child to exit, or a deadline.
+		*/
+		io_status = run_event_loop_once (&loop, -1);
 		if (io_status == -1)
 		{
-			syslog (LOG_ERR,
-	"Failed to write to log handler. Select() in write_writable() said: %m");
-		}
-		else if (io_status == -2)
-		{ syslog (LOG_ERR, "Wrote partial data to log handler."); }
-		else
-		{
-			if (clear_char_buffer (ls_buffer, 0) != 0)
-			{
-				syslog (LOG_ALERT, "clear_char_buffer: %m");
-				exit (errno);
-			}
+			self_log (LOG_ERR, "Event loop failed. epoll_wait() said: %m");
 		}
 	} /* while loop */
 
 	exit (EXIT_SUCCESS);
 }
-
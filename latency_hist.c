@@ -0,0 +1,177 @@
+/*
+**
+** Log-linear (HDR style) latency histograms.
+**
+** Recording is a bucket index (a count of leading zeros and two
+** shifts) and two stores, with no locks and no allocation, so it can
+** sit in the middle of the log path. Another thread can summarize a
+** histogram as it is being recorded into: it reads each count whole,
+** and reports only what came in since its last summary.
+**
+** new_latency_hists (int n)
+** record_latency    (latency_hist_t *hist, unsigned long long ns)
+** summarize_latency (latency_hist_t *hist, char *text, size_t size)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "latency_hist.h"
+
+
+/**********************************************************************
+** bucket_of ()
+*/
+static int
+bucket_of (unsigned long long ns)
+{
+	int e;
+
+	if (ns < HIST_SUB) return (int)ns;
+	e = 63 - __builtin_clzll (ns);
+	if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB
+	 + (int)((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+
+/**********************************************************************
+** bucket_top ()
+**
+** The highest value that goes in bucket i.
+*/
+static unsigned long long
+bucket_top (int i)
+{
+	int shift;
+
+	if (i < HIST_SUB) return i;
+	shift = i / HIST_SUB - 1;
+	return ((unsigned long long)(HIST_SUB + i % HIST_SUB + 1) << shift) - 1;
+}
+
+
+/**********************************************************************
+** format_ns ()
+*/
+static char *
+format_ns (char *text, size_t size, unsigned long long ns)
+{
+	if (ns < 1000) snprintf (text, size, "%lluns", ns);
+	else if (ns < 1000000) snprintf (text, size, "%.1fus", ns / 1e3);
+	else if (ns < 1000000000) snprintf (text, size, "%.1fms", ns / 1e6);
+	else snprintf (text, size, "%.2fs", ns / 1e9);
+	return text;
+}
+
+
+/**********************************************************************
+** new_latency_hists ()
+**
+** Allocate n empty histograms, or return NULL with errno set.
+*/
+latency_hist_t *
+new_latency_hists (int n)
+{
+	return calloc (n, sizeof (latency_hist_t));
+}
+
+
+/**********************************************************************
+** record_latency ()
+*/
+void
+record_latency (latency_hist_t *hist, unsigned long long ns)
+{
+	unsigned long long *count = &hist->counts[bucket_of (ns)];
+
+	__atomic_store_n (count, *count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&hist->sum_ns, hist->sum_ns + ns, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************
+** summarize_latency ()
+**
+** Write into text how many durations were recorded since the last
+** summary, their mean, the 50th, 90th, 99th and 99.9th percentiles
+** and the maximum. A percentile is the top of the bucket it falls in.
+**
+** Returns the number of durations summarized; if it is 0, text is
+** left alone.
+*/
+unsigned long long
+summarize_latency (latency_hist_t *hist, char *text, size_t size)
+{
+	static const double quantiles[4] = {0.5, 0.9, 0.99, 0.999};
+	unsigned long long fresh[HIST_BUCKETS];
+	unsigned long long at[4];
+	unsigned long long n = 0, seen = 0, sum;
+	unsigned long long count;
+	char mean[16], q[4][16], max[16];
+	int i, j, top = 0;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		count = __atomic_load_n (&hist->counts[i], __ATOMIC_RELAXED);
+		fresh[i] = count - hist->seen[i];
+		hist->seen[i] = count;
+		n += fresh[i];
+		if (fresh[i] != 0) top = i;
+	}
+	count = __atomic_load_n (&hist->sum_ns, __ATOMIC_RELAXED);
+	sum = count - hist->seen_sum_ns;
+	hist->seen_sum_ns = count;
+	if (n == 0) return 0;
+
+	for (j = 0; j < 4; j++)
+	{
+		/* the rank of the quantile, counting from 1 */
+		at[j] = (unsigned long long)(quantiles[j] * n);
+		if (at[j] < quantiles[j] * n || at[j] == 0) at[j]++;
+	}
+	for (i = 0, j = 0; i < HIST_BUCKETS && j < 4; i++)
+	{
+		seen += fresh[i];
+		while (j < 4 && seen >= at[j])
+		{
+			format_ns (q[j], sizeof (q[j]), bucket_top (i));
+			j++;
+		}
+	}
+	snprintf (text, size, "n=%llu mean=%s p50=%s p90=%s p99=%s p99.9=%s"
+	 " max=%s", n, format_ns (mean, sizeof (mean), sum / n), q[0], q[1],
+	 q[2], q[3], format_ns (max, sizeof (max), bucket_top (top)));
+	return n;
+}
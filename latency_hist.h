@@ -0,0 +1,73 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _LATENCY_HIST_H_ /* Brackets this whole file */
+#define _LATENCY_HIST_H_
+
+#include <stddef.h>
+
+/*
+** Log-linear buckets, HDR style: values under HIST_SUB nanoseconds
+** each have their own, and every power of two above that is split
+** into HIST_SUB equal buckets, so a value is known to within 1/16th
+** (about 6%). Anything from 2^HIST_MAX_EXP ns (about 18 minutes) up
+** goes in the last bucket.
+*/
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+/*
+** Durations of one thing, in nanoseconds. counts and sum_ns are only
+** written by the thread recording into it, and may be read by one
+** other thread, which summarizes what was recorded since it last
+** looked; seen and seen_sum_ns are that thread's.
+*/
+typedef struct
+latency_hist_struct
+{
+	unsigned long long counts[HIST_BUCKETS];
+	unsigned long long sum_ns;
+	unsigned long long seen[HIST_BUCKETS];
+	unsigned long long seen_sum_ns;
+}
+latency_hist_t;
+
+extern latency_hist_t *new_latency_hists (int);
+extern void record_latency (latency_hist_t*, unsigned long long);
+extern unsigned long long summarize_latency (latency_hist_t*, char*,
+ size_t);
+
+#endif /* _LATENCY_HIST_H_ Brackets this whole file */
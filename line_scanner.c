@@ -0,0 +1,316 @@
+/*
+**
+** Incremental heartbeat line scanner.
+**
+** The scanner remembers how far into the log stream buffer it has
+** looked, so each call only examines bytes appended since the last
+** one. All include and exclude filters are compiled into a single
+** Aho-Corasick automaton (ac_matcher.c), so each byte is looked at
+** once no matter how many filters there are, and a line that is not
+** finished yet is carried over as just the automaton's state. Lines
+** are handled by length, so embedded NUL bytes do not cut them short.
+**
+** Filters may instead be regular expressions (regex_dfa.c). They are
+** compiled to a DFA up front and scanned the same way, one table
+** lookup per byte.
+**
+** create_line_scanner   (line_scanner_t *scanner, char **in_filters,
+**                        int in_count, char **ex_filters, int ex_count,
+**                        int use_regex)
+** destroy_line_scanner  (line_scanner_t *scanner)
+** reset_line_scanner    (line_scanner_t *scanner)
+** scan_bytes            (line_scanner_t *scanner, const char *bytes,
+**                        size_t len)
+** scan_char_buffer      (line_scanner_t *scanner, char_buffer_t *bufptr)
+** mark_char_buffer_scanned (line_scanner_t *scanner,
+**                        char_buffer_t *bufptr)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _GNU_SOURCE /* memrchr */
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "buffer.h"
+#include "candidate_scan.h"
+#include "ac_matcher.h"
+#include "regex_dfa.h"
+#include "line_scanner.h"
+
+
+/**********************************************************************
+** add_filter ()
+*/
+static int
+add_filter (line_scanner_t *scanner, const char *filter, int flags)
+{
+	if (scanner->use_regex)
+	{
+		return add_regex_pattern (&scanner->regex, filter, flags);
+	}
+	return add_ac_pattern (&scanner->matcher, filter, strlen (filter),
+	 flags);
+}
+
+
+/**********************************************************************
+** create_line_scanner ()
+**
+** Compile the include and exclude filters. Either list may be empty.
+** The scanner keeps what it needs of the filter strings, so they may
+** be freed once it is created, as a config reload does.
+** With use_regex, they are extended regular expressions.
+**
+** Return values:
+**   0       success
+**   EINVAL  a regex is invalid or too complex; see scanner->regex.error
+**   *       errno from malloc failure
+*/
+int
+create_line_scanner (line_scanner_t *scanner,
+ char **in_filters, int in_count, char **ex_filters, int ex_count,
+ int use_regex)
+{
+	int i;
+	int status = 0;
+
+	create_ac_matcher (&scanner->matcher);
+	create_regex_dfa (&scanner->regex);
+	scanner->use_regex = use_regex;
+	scanner->in_count = scanner->ex_count = 0;
+	for (i = 0; i < in_count && status == 0; i++)
+	{
+		if (*in_filters[i] == '\0') continue;
+		status = add_filter (scanner, in_filters[i], SCAN_INCLUDE);
+		scanner->in_count++;
+	}
+	for (i = 0; i < ex_count && status == 0; i++)
+	{
+		if (*ex_filters[i] == '\0') continue;
+		status = add_filter (scanner, ex_filters[i], SCAN_EXCLUDE);
+		scanner->ex_count++;
+	}
+	if (status == 0 && use_regex)
+	{
+		status = compile_regex_dfa (&scanner->regex);
+	}
+	else if (status == 0)
+	{
+		status = compile_ac_matcher (&scanner->matcher);
+	}
+	scanner->scanned = 0;
+	reset_line_scanner (scanner);
+	return status;
+}
+
+
+/**********************************************************************
+** destroy_line_scanner ()
+*/
+void
+destroy_line_scanner (line_scanner_t *scanner)
+{
+	if (scanner == NULL) return;
+	destroy_ac_matcher (&scanner->matcher);
+	destroy_regex_dfa (&scanner->regex);
+}
+
+
+/**********************************************************************
+** reset_line_scanner ()
+**
+** Forget any unfinished line, e.g. after a gap in the input. A regex
+** can match before the first byte of a line (^ or x*), so the DFA's
+** start state may already carry flags.
+*/
+void
+reset_line_scanner (line_scanner_t *scanner)
+{
+	if (scanner->use_regex && scanner->regex.next != NULL)
+	{
+		scanner->state = scanner->regex.start;
+		scanner->line_flags = scanner->regex.out[scanner->regex.start];
+		return;
+	}
+	scanner->state = 0;
+	scanner->line_flags = 0;
+}
+
+
+/**********************************************************************
+** is_heartbeat ()
+**
+** A finished line is a heartbeat unless it hit an exclude filter,
+** and, if there are include filters, it must have hit one of them.
+*/
+static int
+is_heartbeat (line_scanner_t *scanner, int flags)
+{
+	if (flags & SCAN_EXCLUDE) return 0;
+	if (scanner->in_count && !(flags & SCAN_INCLUDE)) return 0;
+	return 1;
+}
+
+
+/**********************************************************************
+** scan_bytes ()
+**
+** Feed the next len bytes of the log stream to the scanner.
+**
+** Return values:
+**   1  a heartbeat line was finished within these bytes
+**   0  otherwise
+*/
+int
+scan_bytes (line_scanner_t *scanner, const char *bytes, size_t len)
+{
+	int found = 0;
+	const char *nl;
+	size_t n;
+	/*
+	** Once this flag is seen, the rest of the line cannot change its
+	** outcome: an exclude hit always loses, and with no exclude
+	** filters an include hit always wins.
+	*/
+	int stop_mask = scanner->ex_count ? SCAN_EXCLUDE : SCAN_INCLUDE;
+
+	/* without filters, any output at all is a heartbeat */
+	if (scanner->in_count == 0 && scanner->ex_count == 0) return len > 0;
+
+	while (len > 0)
+	{
+		/*
+		** Between lines, with include filters, a line that hits
+		** nothing cannot be a heartbeat, so newlines do not matter
+		** either: jump to where the next filter could start.
+		*/
+		if (scanner->state == 0 && scanner->line_flags == 0
+		 && scanner->in_count && scanner->matcher.skip.npairs > 0)
+		{
+			n = find_candidate (&scanner->matcher.skip, bytes, len, 0);
+			bytes += n;
+			len -= n;
+			if (len == 0) break;
+		}
+		if (scanner->line_flags & stop_mask)
+		{
+			/* the outcome is settled; skip to the end of the line */
+			nl = memchr (bytes, '\n', len);
+			n = nl ? nl - bytes : len;
+		} else if (scanner->use_regex) {
+			n = regex_scan (&scanner->regex, &scanner->state,
+			 &scanner->line_flags, stop_mask, bytes, len);
+		} else {
+			n = ac_scan (&scanner->matcher, &scanner->state,
+			 &scanner->line_flags, stop_mask, bytes, len);
+		}
+		bytes += n;
+		len -= n;
+		if (len == 0) break; /* the line goes on in the next call */
+		if (*bytes != '\n') continue; /* ac_scan() stopped early */
+
+		if (scanner->use_regex && !(scanner->line_flags & stop_mask))
+		{
+			/* patterns anchored with $ can only match now */
+			scanner->line_flags |= scanner->regex.eol_out[scanner->state];
+		}
+
+		if (is_heartbeat (scanner, scanner->line_flags)) found = 1;
+		reset_line_scanner (scanner);
+		bytes++;
+		len--;
+
+		/*
+		** Once a heartbeat is found, the remaining finished lines
+		** cannot change the answer. Skip to the last newline and only
+		** scan what follows it.
+		*/
+		if (found && len > 0)
+		{
+			nl = memrchr (bytes, '\n', len);
+			if (nl != NULL)
+			{
+				len -= nl + 1 - bytes;
+				bytes = nl + 1;
+			}
+		}
+	}
+	return found;
+}
+
+
+/**********************************************************************
+** scan_char_buffer ()
+**
+** Scan the bytes appended to the buffer since the previous call.
+** If some of them were consumed before they could be scanned, the
+** scanner restarts at the read cursor and drops its partial line.
+**
+** Return values:
+**   1  a heartbeat line was finished within the new bytes
+**   0  otherwise
+*/
+int
+scan_char_buffer (line_scanner_t *scanner, char_buffer_t *bufptr)
+{
+	int found = 0;
+	char *span;
+	size_t len;
+
+	if (scanner->scanned < bufptr->read_pos)
+	{
+		reset_line_scanner (scanner);
+		scanner->scanned = bufptr->read_pos;
+	}
+	while (scanner->scanned < bufptr->write_pos)
+	{
+		span = get_char_buffer_span_at (bufptr, scanner->scanned, &len);
+		if (scan_bytes (scanner, span, len)) found = 1;
+		scanner->scanned += len;
+	}
+	return found;
+}
+
+
+/**********************************************************************
+** mark_char_buffer_scanned ()
+**
+** Treat everything in the buffer as scanned, for bytes that were
+** already fed to scan_bytes() before they were appended.
+*/
+void
+mark_char_buffer_scanned (line_scanner_t *scanner, char_buffer_t *bufptr)
+{
+	scanner->scanned = bufptr->write_pos;
+}
@@ -0,0 +1,69 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _LINE_SCANNER_H_ /* Brackets this whole file */
+#define _LINE_SCANNER_H_
+
+#include <stddef.h>
+#include "buffer.h"
+#include "ac_matcher.h"
+#include "regex_dfa.h"
+
+/* per-line match flags */
+#define SCAN_INCLUDE 1
+#define SCAN_EXCLUDE 2
+
+typedef struct
+line_scanner_struct
+{
+	size_t scanned;       /* char_buffer_t position scanned up to */
+	ac_matcher_t matcher; /* all include and exclude filters */
+	regex_dfa_t regex;    /* the same, when they are regexes */
+	int use_regex;
+	int in_count;
+	int ex_count;
+	int state;            /* matcher or DFA state within the line */
+	int line_flags;       /* SCAN_* flags seen so far in this line */
+}
+line_scanner_t;
+
+extern int create_line_scanner (line_scanner_t*, char**, int, char**, int,
+ int);
+extern void destroy_line_scanner (line_scanner_t*);
+extern void reset_line_scanner (line_scanner_t*);
+extern int scan_bytes (line_scanner_t*, const char*, size_t);
+extern int scan_char_buffer (line_scanner_t*, char_buffer_t*);
+extern void mark_char_buffer_scanned (line_scanner_t*, char_buffer_t*);
+
+#endif /* _LINE_SCANNER_H_ Brackets this whole file */
@@ -0,0 +1,246 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include "buffer.h"
+#include "candidate_scan.h"
+#include "line_scanner.h"
+
+
+static void
+feed (line_scanner_t *scanner, const char *bytes, size_t len)
+{
+	int found = scan_bytes (scanner, bytes, len);
+	printf ("Fed %zu bytes, heartbeat: %d, line flags: %d\n",
+	 len, found, scanner->line_flags);
+}
+
+
+/*
+** Feed a stream in odd-sized pieces and return a checksum of which
+** pieces held a heartbeat. skip 0 runs the automaton alone.
+*/
+static unsigned long
+scan_stream (const char *stream, size_t len, int skip)
+{
+	char *in[] = { "HEART", "BEAT", "AT" };
+	char *ex[] = { "DEBUG", "BAD" };
+	line_scanner_t scanner;
+	unsigned long sum = 0;
+	size_t pos, n;
+
+	if (create_line_scanner (&scanner, in, 3, ex, 2, 0) != 0)
+	{ err (errno, "ERROR: create_line_scanner"); }
+	if (!skip) scanner.matcher.skip.npairs = -1;
+	for (pos = 0; pos < len; pos += n)
+	{
+		n = 1 + (pos * 7919) % 97;
+		if (n > len - pos) n = len - pos;
+		sum = sum * 31 + scan_bytes (&scanner, stream + pos, n);
+	}
+	destroy_line_scanner (&scanner);
+	return sum;
+}
+
+
+int
+main ()
+{
+	line_scanner_t scanner;
+	line_scanner_t multi;
+	char *in_filters[] = { "HEARTBEAT" };
+	char *ex_filters[] = { "DEBUG" };
+	char *multi_in[] = { "alive", "tick", "she", "hers" };
+	char *multi_ex[] = { "DEBUG", "he said" };
+	char_buffer_t *buf = calloc (1, sizeof (char_buffer_t));
+	char *longline;
+	char *stream;
+	const char alphabet[] = "HEARTBDGU .\n";
+	int kernels[] = { SCAN_KERNEL_SCALAR, SCAN_KERNEL_SSE2, SCAN_KERNEL_AVX2 };
+	const char *names[] = { "scalar", "sse2", "avx2" };
+	unsigned long expect;
+	line_scanner_t regex;
+	char *regex_in[] = { "HEARTBEAT seq=[0-9]+$", "^ok( |$)" };
+	char *regex_ex[] = { "DEBUG|TRACE" };
+	char *regex_bad[] = { "HEARTBEAT (seq" };
+	int i, found, npairs;
+
+	printf ("==== #010 Creating scanner, in='HEARTBEAT' ex='DEBUG' ====\n");
+	if (create_line_scanner (&scanner, in_filters, 1, ex_filters, 1, 0) != 0)
+	{ err (errno, "ERROR: create_line_scanner"); }
+	printf ("\n");
+
+	printf ("==== #020 One plain line (expect 0) ====\n");
+	feed (&scanner, "hello\n", 6);
+	printf ("\n");
+
+	printf ("==== #030 Heartbeat split over three feeds (expect 0,0,1) ====\n");
+	feed (&scanner, "app: HEART", 10);
+	feed (&scanner, "BE", 2);
+	feed (&scanner, "AT seq=1\n", 9);
+	printf ("\n");
+
+	printf ("==== #040 Excluded heartbeat line (expect 0) ====\n");
+	feed (&scanner, "DEBUG HEARTBEAT\n", 16);
+	printf ("\n");
+
+	printf ("==== #050 Heartbeat after an embedded NUL (expect 1) ====\n");
+	feed (&scanner, "a\0b HEARTBEAT\n", 14);
+	printf ("\n");
+
+	printf ("==== #060 Heartbeat without newline yet (expect 0, then 1) ====\n");
+	feed (&scanner, "HEARTBEAT", 9);
+	feed (&scanner, "\n", 1);
+	printf ("\n");
+
+	printf ("==== #070 Heartbeat straddling the partial cut (expect 1) ====\n");
+	longline = malloc (10000);
+	for (i = 0; i < 10000; i++) longline[i] = 'x';
+	feed (&scanner, longline, 4090);
+	feed (&scanner, "HEARTBEAT", 9);
+	feed (&scanner, longline, 5000);
+	feed (&scanner, "\n", 1);
+	printf ("\n");
+
+	printf ("==== #075 Heartbeat at each offset of a line, automaton alone (expect 600 of 600) ====\n");
+	npairs = scanner.matcher.skip.npairs;
+	scanner.matcher.skip.npairs = -1;
+	for (i = 0, found = 0; i < 600; i++)
+	{
+		memset (longline, 'x', 610);
+		memcpy (longline + i, "HEARTBEAT", 9);
+		longline[609] = '\n';
+		found += scan_bytes (&scanner, longline, 610);
+	}
+	printf ("%d of 600\n", found);
+	scanner.matcher.skip.npairs = npairs;
+	printf ("\n");
+
+	printf ("==== #080 Scanning a wrapped char_buffer_t (expect 0, 1, 0) ====\n");
+	if (create_char_buffer (buf, 32) != 0)
+	{ err (errno, "ERROR: create_char_buffer"); }
+	append_to_char_buffer (buf, "0123456789012345678901234");
+	printf ("Heartbeat: %d\n", scan_char_buffer (&scanner, buf));
+	consume_char_buffer (buf, 25);
+	append_to_char_buffer (buf, "\nHEARTBEAT\n");
+	printf ("Heartbeat: %d\n", scan_char_buffer (&scanner, buf));
+	printf ("Heartbeat: %d\n", scan_char_buffer (&scanner, buf));
+	printf ("\n");
+
+	printf ("==== #082 Creating scanner, in='alive','tick','she','hers' ex='DEBUG','he said' ====\n");
+	if (create_line_scanner (&multi, multi_in, 4, multi_ex, 2, 0) != 0)
+	{ err (errno, "ERROR: create_line_scanner"); }
+	printf ("\n");
+
+	printf ("==== #084 Each include pattern on its own line (expect 1,1,1,0) ====\n");
+	feed (&multi, "still alive\n", 12);
+	feed (&multi, "tick 42\n", 8);
+	feed (&multi, "ushers\n", 7);
+	feed (&multi, "nothing here\n", 13);
+	printf ("\n");
+
+	printf ("==== #086 Excluded after and before an include (expect 0,0) ====\n");
+	feed (&multi, "alive DEBUG\n", 12);
+	feed (&multi, "DEBUG tick\n", 11);
+	printf ("\n");
+
+	printf ("==== #088 Overlapping include and exclude, split feed (expect 0,0) ====\n");
+	feed (&multi, "she s", 5);
+	feed (&multi, "aid hello\n", 10);
+	printf ("\n");
+
+	printf ("==== #089 Candidate kernels agree with the automaton alone ====\n");
+	stream = malloc (1 << 20);
+	srand (1);
+	for (i = 0; i < 1 << 20; i++)
+	{ stream[i] = alphabet[rand () % (sizeof (alphabet) - 1)]; }
+	expect = scan_stream (stream, 1 << 20, 0);
+	for (i = 0; i < 3; i++)
+	{
+		if (select_scan_kernel (kernels[i]) != 0)
+		{
+			printf ("%s: not supported\n", names[i]);
+			continue;
+		}
+		printf ("%s: %s\n", names[i],
+		 scan_stream (stream, 1 << 20, 1) == expect ? "agree" : "DIFFER");
+	}
+	free (stream);
+	printf ("\n");
+
+	printf ("==== #090 Destroying the scanners ====\n");
+	destroy_line_scanner (&scanner);
+	destroy_line_scanner (&multi);
+	destroy_char_buffer (buf);
+	free (longline);
+	printf ("\n");
+
+	printf ("==== #100 Creating regex scanner, in='HEARTBEAT seq=[0-9]+$','^ok( |$)' ex='DEBUG|TRACE' ====\n");
+	if (create_line_scanner (&regex, regex_in, 2, regex_ex, 1, 1) != 0)
+	{ errx (EXIT_FAILURE, "ERROR: %s", regex.regex.error); }
+	printf ("\n");
+
+	printf ("==== #110 Regex matches (expect 1,1,1) ====\n");
+	feed (&regex, "HEARTBEAT seq=42\n", 17);
+	feed (&regex, "ok\n", 3);
+	feed (&regex, "ok 200\n", 7);
+	printf ("\n");
+
+	printf ("==== #120 Regex non-matches (expect 0,0,0,0) ====\n");
+	feed (&regex, "HEARTBEAT seq=\n", 15);
+	feed (&regex, "HEARTBEAT seq=42 late\n", 22);
+	feed (&regex, "not ok\n", 7);
+	feed (&regex, "TRACE HEARTBEAT seq=1\n", 22);
+	printf ("\n");
+
+	printf ("==== #130 Anchored match split over feeds (expect 0,0,1) ====\n");
+	feed (&regex, "HEARTBEAT s", 11);
+	feed (&regex, "eq=7", 4);
+	feed (&regex, "\n", 1);
+	printf ("\n");
+
+	printf ("==== #140 Destroying the regex scanner ====\n");
+	destroy_line_scanner (&regex);
+	printf ("\n");
+
+	printf ("==== #150 Invalid regex is rejected (expect EINVAL) ====\n");
+	if (create_line_scanner (&regex, regex_bad, 1, NULL, 0, 1) == EINVAL)
+	{ printf ("EINVAL: %s\n", regex.regex.error); }
+	destroy_line_scanner (&regex);
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "listen_socket.h"
+
+
+/**********************************************************************
+** open_unix_socket (const char*, mode_t)
+** 
+** Listen on a unix stream socket at path. A socket file left behind
+** by an earlier run is removed first; any other file is not. With a
+** mode, the socket file is given it between bind() and listen(), so
+** no one can connect before it has it.
+*/
+static int
+open_unix_socket (const char *path, mode_t mode)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+	int saved;
+
+	if (strlen (path) >= sizeof (addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, path);
+	if (lstat (path, &st) == 0 && S_ISSOCK (st.st_mode)) unlink (path);
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) return -1;
+	if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) == -1
+	 || (mode != 0 && chmod (path, mode) == -1)
+	 || listen (fd, SOMAXCONN) == -1)
+	{
+		saved = errno;
+		close (fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+
+/**********************************************************************
+** open_inet_socket (const char*)
+** 
+** Listen on TCP at "port", "host:port" or "[ipv6-address]:port". With
+** no host, it is every address; an IPv6 socket then takes IPv4 as well.
+*/
+static int
+open_inet_socket (const char *spec)
+{
+	struct addrinfo hints, *res, *ai;
+	char host[256];
+	const char *port;
+	const char *colon;
+	size_t len;
+	int fd = -1;
+	int on = 1, off = 0;
+	int status, saved = EADDRNOTAVAIL;
+
+	colon = strrchr (spec, ':');
+	if (colon == NULL) port = spec;
+	else
+	{
+		port = colon + 1;
+		if (*spec == '[' && colon > spec && colon[-1] == ']') spec++;
+		len = colon - spec - (colon[-1] == ']');
+		if (len >= sizeof (host))
+		{
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memcpy (host, spec, len);
+		host[len] = '\0';
+	}
+
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	status = getaddrinfo (colon == NULL || *host == '\0' ? NULL : host,
+	 port, &hints, &res);
+	if (status != 0)
+	{
+		errno = (status == EAI_SYSTEM) ? errno : EINVAL;
+		return -1;
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next)
+	{
+		fd = socket (ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+		 ai->ai_protocol);
+		if (fd == -1)
+		{
+			saved = errno;
+			continue;
+		}
+		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+		if (ai->ai_family == AF_INET6)
+		{
+			setsockopt (fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof (off));
+		}
+		if (bind (fd, ai->ai_addr, ai->ai_addrlen) == 0
+		 && listen (fd, SOMAXCONN) == 0)
+		{ break; }
+		saved = errno;
+		close (fd);
+		fd = -1;
+	}
+	freeaddrinfo (res);
+	if (fd == -1) errno = saved;
+	return fd;
+}
+
+
+/**********************************************************************
+** open_listen_socket (const char*)
+** 
+** Create a listening socket, close-on-exec, as given by spec: a path
+** (starting with '/') for a unix stream socket, or "port",
+** "host:port" or "[ipv6-address]:port" for TCP. The backlog is
+** SOMAXCONN, so connections made while no process is accepting wait
+** in the kernel.
+** 
+** Return value:
+**   -1 upon failure. An error code is stored in errno.
+**    * file descriptor number if successful
+*/
+int
+open_listen_socket (const char *spec)
+{
+	if (*spec == '/') return open_unix_socket (spec, 0);
+	return open_inet_socket (spec);
+}
+
+
+/**********************************************************************
+** open_private_socket (const char*)
+** 
+** As open_listen_socket(), for a socket only this user may connect
+** to: a unix stream socket at an absolute path, mode 0600.
+** 
+** Return value:
+**   -1 upon failure. An error code is stored in errno; EINVAL if path
+**      is not absolute.
+**    * file descriptor number if successful
+*/
+int
+open_private_socket (const char *path)
+{
+	if (*path != '/')
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return open_unix_socket (path, S_IRUSR | S_IWUSR);
+}
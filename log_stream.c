@@ -0,0 +1,1051 @@
+/*
+**
+** The log stream: app pipes and fifos in, logger pipe out.
+**
+** Sources are watched edge-triggered and drained to EAGAIN into the
+** ring buffer, and the buffer is written to the logger's pipe as far
+** as it will take. New bytes are scanned for a heartbeat before any
+** of them can be written out.
+**
+** In zero-copy mode the bytes move from a source pipe straight into
+** the logger's pipe with splice(), as long as nothing is waiting in
+** the buffer ahead of them. When the scanner still wants to see the
+** stream, a bounded copy is taken with tee() first. When the logger's
+** pipe is full, the source falls back to being read into the buffer,
+** so the app never blocks on a slow logger.
+**
+** heartmon's own messages (self_log.c) for a stream are injected into
+** it as lines of their own, between the lines from the sources. Where
+** those have left a line unfinished, the messages wait for it to end,
+** for up to SELF_LOG_HOLD_MS. Bytes spliced past the buffer are not
+** seen, so in zero-copy mode a message may land within a line.
+**
+** Instead of a logger's pipe, the sink can be a file (file_sink.c),
+** written a line at a time from the buffer. It is synced after each
+** write or on a timer, as it was opened to be, and a write that fails
+** (the disk is full) is tried again on the same timer.
+**
+** create_log_stream  (log_stream_t *ls, event_loop_t *loop,
+**                     line_scanner_t *scanner)
+** enable_zero_copy   (log_stream_t *ls, long long scan_window)
+** profile_log_stream (log_stream_t *ls)
+** flush_log_stream   (log_stream_t *ls)
+** inject_self_log    (log_stream_t *ls)
+** attach_source      (log_stream_t *ls, log_source_t *src, int fd,
+**                     int is_fifo)
+** detach_source      (log_source_t *src)
+** attach_sink        (log_stream_t *ls, int fd)
+** detach_sink        (log_stream_t *ls)
+** close_sink         (log_stream_t *ls)
+** attach_file_sink   (log_stream_t *ls, file_sink_t *fs)
+** detach_file_sink   (log_stream_t *ls, int all)
+** park_log_stream    (log_stream_t *ls)
+** unpark_log_stream  (log_stream_t *ls, event_loop_t *loop)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _GNU_SOURCE /* splice, tee, pipe2 */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include "buffer.h"
+#include "event_loop.h"
+#include "line_scanner.h"
+#include "spawn_process.h"
+#include "latency_hist.h"
+#include "self_log.h"
+#include "file_sink.h"
+#include "log_stream.h"
+#include "probes.h"
+
+
+/**********************************************************************
+** grow_log_buffer ()
+**
+** Extend the log stream buffer until it has more than `want' bytes
+** of space. The ring doubles, so once it has grown to fit the
+** backlog it stays put; it is never shrunk back.
+**
+** Causes exit if the buffer cannot be grown.
+*/
+static void
+grow_log_buffer (char_buffer_t *ls_buffer, size_t want)
+{
+	int resize_status;
+
+	while (get_char_buffer_space (ls_buffer) <= want)
+	{
+		resize_status = resize_char_buffer (ls_buffer,
+		 (long)get_char_buffer_size (ls_buffer));
+		if (resize_status > 0)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ALERT,
+			 "resize_char_buffer: %m");
+			exit (errno);
+		}
+		if (resize_status == -1)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+			 "Buffer resize would lose data (although we asked to grow, not shrink).");
+			break;
+		}
+	}
+}
+
+
+/**********************************************************************
+** add_count ()
+**
+** Add to one of the stream's counts. Only the thread running the
+** stream writes them, but other threads may read them (to see how
+** busy the stream is, or for the metrics), so each is stored in one
+** piece.
+*/
+static void
+add_count (unsigned long long *count, unsigned long long n)
+{
+	__atomic_store_n (count, *count + n, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************
+** count_lines ()
+*/
+static unsigned long long
+count_lines (const char *p, size_t len)
+{
+	const char *end = p + len;
+	unsigned long long lines = 0;
+
+	while ((p = memchr (p, '\n', end - p)) != NULL)
+	{
+		lines++;
+		p++;
+	}
+	return lines;
+}
+
+
+/**********************************************************************
+** count_bytes_in ()
+**
+** Count n bytes taken from src, with the given number of lines in them.
+*/
+static void
+count_bytes_in (log_source_t *src, ssize_t n, unsigned long long lines)
+{
+	add_count (&src->bytes_in, n);
+	add_count (&src->lines_in, lines);
+	add_count (&src->stream->bytes_in, n);
+}
+
+
+/**********************************************************************
+** count_buffer_use ()
+**
+** Note the buffer's size and how full it is, and whether that is a new
+** high.
+*/
+static void
+count_buffer_use (log_stream_t *ls)
+{
+	size_t held = get_char_buffer_contlen (ls->buffer);
+
+	if (held != ls->buffer_held)
+	{ __atomic_store_n (&ls->buffer_held, held, __ATOMIC_RELAXED); }
+	if (held > ls->buffer_hwm)
+	{ __atomic_store_n (&ls->buffer_hwm, held, __ATOMIC_RELAXED); }
+	if (ls->buffer->size != ls->buffer_size)
+	{
+		__atomic_store_n (&ls->buffer_size, ls->buffer->size,
+		 __ATOMIC_RELAXED);
+	}
+}
+
+
+/**********************************************************************
+** phase_start ()
+**
+** When a phase begins, if the stream is being profiled. Without
+** profiling, this and phase_end() cost one test of ls->profile.
+*/
+static unsigned long long
+phase_start (log_stream_t *ls)
+{
+	return ls->profile ? monotonic_ns () : 0;
+}
+
+
+/**********************************************************************
+** phase_end ()
+**
+** Record how long a phase took, and return it (0 without profiling).
+*/
+static unsigned long long
+phase_end (log_stream_t *ls, int phase, unsigned long long started)
+{
+	unsigned long long took;
+
+	if (!ls->profile) return 0;
+	took = monotonic_ns () - started;
+	record_latency (&ls->profile[phase], took);
+	return took;
+}
+
+
+/**********************************************************************
+** found_heartbeat ()
+**
+** The scanner matched a heartbeat in what was just taken from src.
+*/
+static void
+found_heartbeat (log_source_t *src)
+{
+	log_stream_t *ls = src->stream;
+
+	PROBE (heartbeat, src->watch.fd, ls->bytes_in, src->pid, 0);
+	add_count (&ls->heartbeats, 1);
+	if (ls->on_heartbeat) ls->on_heartbeat (ls, ls->heartbeat_data);
+	if (ls->zero_copy) ls->scan_after = monotonic_ms () + ls->scan_window;
+}
+
+
+/**********************************************************************
+** drain_source ()
+**
+** Read from a source until it would block, growing the buffer as
+** needed, and scan what came in for a heartbeat before any of it can
+** be written out. Edge-triggered watches only fire again once new
+** data arrives, so a source must be drained to EAGAIN, unless it is
+** re-armed. After budget bytes (if budget is not 0) this stops early
+** and returns 1; the caller must then re-arm the watch.
+**
+** A pipe that reaches EOF (the app closed it or exited) is closed.
+*/
+static int
+drain_source (log_source_t *src, size_t budget)
+{
+	log_stream_t *ls = src->stream;
+	ssize_t readbytes;
+	size_t taken = 0;
+	size_t pos, len;
+	char *span;
+	unsigned long long lines;
+	unsigned long long started;
+	int more = 0;
+	int fd = src->watch.fd;
+
+	started = phase_start (ls);
+	while (fd != -1)
+	{
+		if (budget && taken >= budget)
+		{
+			more = 1;
+			break;
+		}
+		grow_log_buffer (ls->buffer, BUFFERSIZE / 2);
+		readbytes = read_fd_into_char_buffer (ls->buffer, fd);
+		PROBE (read, fd, readbytes, src->pid, 0);
+		if (readbytes > 0)
+		{
+			lines = 0;
+			pos = ls->buffer->write_pos - readbytes;
+			while ((span = get_char_buffer_span_at (ls->buffer, pos, &len),
+			 len > 0))
+			{
+				lines += count_lines (span, len);
+				pos += len;
+			}
+			count_bytes_in (src, readbytes, lines);
+			taken += readbytes;
+			span = get_char_buffer_span_at (ls->buffer,
+			 ls->buffer->write_pos - 1, &len);
+			ls->line_open = (*span != '\n');
+			continue;
+		}
+		if (readbytes == -1 && errno == EINTR) continue;
+		if (readbytes == -1 && errno == EAGAIN) break;
+		if (readbytes == -1)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+			 "Failed to read from fd %d: %m", fd);
+		}
+		/* the writer is gone; so is the rest of its line */
+		if (ls->line_open)
+		{
+			grow_log_buffer (ls->buffer, 1);
+			append_bytes_to_char_buffer (ls->buffer, "\n", 1);
+			ls->line_open = 0;
+		}
+		if (src->is_fifo) break;
+		unwatch_fd (ls->loop, &src->watch);
+		close (fd);
+		fd = -1;
+	}
+	phase_end (ls, PHASE_READ, started);
+	count_buffer_use (ls);
+	if (!ls->scanning) return more;
+	if (ls->scan_skipped)
+	{
+		/* the line in progress went by unseen */
+		reset_line_scanner (ls->scanner);
+		ls->scan_skipped = 0;
+	}
+	started = phase_start (ls);
+	if (scan_char_buffer (ls->scanner, ls->buffer)) found_heartbeat (src);
+	phase_end (ls, PHASE_SCAN, started);
+	return more;
+}
+
+
+/**********************************************************************
+** splice_source ()
+**
+** Move a source's data into the sink with splice() while nothing is
+** buffered ahead of it. If the scanner wants to see it, tee() up to
+** PEEK_SIZE bytes into the peek pipe, scan that copy, and splice
+** exactly those bytes. Whatever splice() could not move (the sink is
+** full, the logger is gone, or the source is at EOF) is left to
+** drain_source(), which reads it into the buffer as usual. The budget
+** covers both, and the return value is drain_source()'s.
+*/
+static int
+splice_source (log_source_t *src, size_t budget)
+{
+	log_stream_t *ls = src->stream;
+	int fd = src->watch.fd;
+	ssize_t peeked, moved, left;
+	size_t taken = 0;
+	unsigned long long started, scan_started, scanned = 0;
+	int tried = 0;
+	int spent = 0;
+
+	/* scanning the peeked copy is PHASE_SCAN, not part of this */
+	started = phase_start (ls);
+	while (fd != -1 && ls->sink.fd != -1
+	 && get_char_buffer_contlen (ls->buffer) == 0)
+	{
+		if (taken >= budget)
+		{
+			spent = 1;
+			break;
+		}
+		tried = 1;
+		if (!ls->scanning || monotonic_ms () < ls->scan_after)
+		{
+			moved = splice (fd, NULL, ls->sink.fd, NULL, SPLICE_SIZE,
+			 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			PROBE (read, fd, moved, src->pid, 1);
+			if (moved <= 0) break;
+			PROBE (write, ls->sink.fd, moved, ls->sink_pid, moved);
+			count_bytes_in (src, moved, 0);
+			add_count (&ls->bytes_out, moved);
+			taken += moved;
+			if (ls->scanning) ls->scan_skipped = 1;
+			continue;
+		}
+
+		/* the peek pipe is always empty here, so only fd can block */
+		peeked = tee (fd, ls->peek_pipe[WRITE_END], PEEK_SIZE,
+		 SPLICE_F_NONBLOCK);
+		PROBE (read, fd, peeked, src->pid, 0);
+		if (peeked <= 0) break;
+		if (read (ls->peek_pipe[READ_END], ls->peek, peeked) != peeked)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+			 "Short read from peek pipe: %m");
+			exit (errno || EXIT_FAILURE);
+		}
+		if (ls->scan_skipped)
+		{
+			reset_line_scanner (ls->scanner);
+			ls->scan_skipped = 0;
+		}
+		scan_started = phase_start (ls);
+		if (scan_bytes (ls->scanner, ls->peek, peeked)) found_heartbeat (src);
+		scanned += phase_end (ls, PHASE_SCAN, scan_started);
+
+		moved = splice (fd, NULL, ls->sink.fd, NULL, peeked,
+		 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		PROBE (write, ls->sink.fd, moved, ls->sink_pid, peeked);
+		count_bytes_in (src, peeked, count_lines (ls->peek, peeked));
+		taken += peeked;
+		if (moved > 0) add_count (&ls->bytes_out, moved);
+		if (moved == peeked) continue;
+		if (moved > 0) add_count (&ls->partial_writes, 1);
+		if (moved < 0) moved = 0;
+
+		/*
+		** The sink took only part of it. The rest has been scanned
+		** already, so read exactly that much into the buffer and
+		** tell the scanner not to look at it again.
+		*/
+		left = peeked - moved;
+		grow_log_buffer (ls->buffer, left);
+		if (read (fd, ls->peek, left) != left)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+			 "Short read of peeked data: %m");
+			exit (errno || EXIT_FAILURE);
+		}
+		append_bytes_to_char_buffer (ls->buffer, ls->peek, left);
+		mark_char_buffer_scanned (ls->scanner, ls->buffer);
+		break;
+	}
+	if (ls->profile && tried)
+	{
+		record_latency (&ls->profile[PHASE_SPLICE],
+		 monotonic_ns () - started - scanned);
+	}
+	if (spent) return 1;
+	return drain_source (src, taken < budget ? budget - taken : 1);
+}
+
+
+/**********************************************************************
+** take_self_log ()
+**
+** Append the self_log messages for this stream to the buffer, once it
+** is at a line boundary; if the sources leave a line unfinished for
+** SELF_LOG_HOLD_MS, it is ended for them. The scanner is moved past
+** the messages, so they are never taken for heartbeats.
+**
+** Returns 1 if anything was appended.
+*/
+static int
+take_self_log (log_stream_t *ls)
+{
+	self_log_entry_t entry;
+	char line[SELF_LOG_TEXT + 64];
+	unsigned long long lost = 0;
+	long long now;
+	size_t len;
+	int taken = 0;
+
+	if (ls->self_log_tag == NULL || !self_log_pending (ls->self_log_next))
+	{ return 0; }
+	if (ls->line_open)
+	{
+		now = monotonic_ms ();
+		if (ls->self_log_held_at == 0) ls->self_log_held_at = now;
+		if (now - ls->self_log_held_at < SELF_LOG_HOLD_MS) return 0;
+		grow_log_buffer (ls->buffer, 1);
+		append_bytes_to_char_buffer (ls->buffer, "\n", 1);
+		ls->line_open = 0;
+		taken = 1;
+	}
+	ls->self_log_held_at = 0;
+	while (read_self_log (&ls->self_log_next, ls->self_log_tag, &entry,
+	 &lost))
+	{
+		len = format_self_log_line (&entry, line, sizeof (line));
+		grow_log_buffer (ls->buffer, len);
+		append_bytes_to_char_buffer (ls->buffer, line, len);
+		taken = 1;
+	}
+	if (lost)
+	{
+		entry.priority = LOG_WARNING;
+		entry.skip = 0;
+		snprintf (entry.text, sizeof (entry.text),
+		 "%llu message(s) lost here.", lost);
+		len = format_self_log_line (&entry, line, sizeof (line));
+		grow_log_buffer (ls->buffer, len);
+		append_bytes_to_char_buffer (ls->buffer, line, len);
+		taken = 1;
+	}
+	if (taken && ls->scanner != NULL)
+	{
+		/* a line cut short above leaves the scanner mid-line */
+		if (ls->scanning) reset_line_scanner (ls->scanner);
+		else ls->scan_skipped = 1;
+		mark_char_buffer_scanned (ls->scanner, ls->buffer);
+	}
+	return taken;
+}
+
+
+/**********************************************************************
+** arm_file_timer ()
+**
+** Have the file timer go off at monotonic ms at, unless it is set to
+** go off sooner already.
+*/
+static void
+arm_file_timer (log_stream_t *ls, long long at)
+{
+	if (ls->file_timer_at != 0 && ls->file_timer_at <= at) return;
+	if (arm_timer_fd (ls->file_timer.fd, at) == -1)
+	{
+		self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+		 "Failed to arm log file timer: %m");
+		return;
+	}
+	ls->file_timer_at = at;
+}
+
+
+/**********************************************************************
+** note_file_status ()
+**
+** Log a write or sync to the file sink that failed, or the first that
+** worked after one that failed; not the same failure over and over.
+*/
+static void
+note_file_status (log_stream_t *ls, int status, const char *what)
+{
+	if (status != 0 && status != ls->file_error)
+	{
+		errno = status;
+		self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+		 "Failed to %s log file: %m", what);
+	}
+	else if (status == 0 && ls->file_error != 0)
+	{
+		self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_NOTICE,
+		 "Log file can be written again.");
+	}
+	ls->file_error = status;
+}
+
+
+/**********************************************************************
+** sync_file ()
+**
+** Sync the file sink if what has been written is due, or set the
+** timer for when it will be.
+*/
+static void
+sync_file (log_stream_t *ls)
+{
+	file_sink_t *fs = ls->file;
+	long long now;
+
+	if (!fs->dirty || fs->sync == FILE_SYNC_NONE) return;
+	if (fs->sync_every > 0)
+	{
+		now = monotonic_ms ();
+		if (ls->sync_due == 0) ls->sync_due = now + fs->sync_every;
+		if (now < ls->sync_due)
+		{
+			arm_file_timer (ls, ls->sync_due);
+			return;
+		}
+	}
+	ls->sync_due = 0;
+	note_file_status (ls, sync_file_sink (fs), "sync");
+}
+
+
+/**********************************************************************
+** write_file ()
+**
+** Write the whole lines in the buffer to the file sink (and, with all,
+** an unfinished one too), then sync it if that is due. If a write
+** fails, what is left stays in the buffer, and is tried again
+** FILE_RETRY_MS later, or when more comes in.
+*/
+static void
+write_file (log_stream_t *ls, int all)
+{
+	ssize_t byteswritten;
+	size_t held;
+	unsigned long long started;
+
+	started = get_char_buffer_contlen (ls->buffer) > 0 ? phase_start (ls) : 0;
+	while ((held = get_char_buffer_contlen (ls->buffer)) > 0)
+	{
+		byteswritten = write_file_sink (ls->file, ls->buffer, all);
+		PROBE (write, ls->file->fd, byteswritten, 0, held);
+		if (byteswritten > 0)
+		{
+			add_count (&ls->bytes_out, byteswritten);
+			note_file_status (ls, 0, "write to");
+			continue;
+		}
+		if (byteswritten == -1 && errno == EINTR) continue;
+		if (byteswritten == -1)
+		{
+			note_file_status (ls, errno, "write to");
+			arm_file_timer (ls, monotonic_ms () + FILE_RETRY_MS);
+		}
+		break;
+	}
+	if (started) phase_end (ls, PHASE_WRITE, started);
+	count_buffer_use (ls);
+	sync_file (ls);
+}
+
+
+/**********************************************************************
+** on_file_timer_event ()
+**
+** event_handler_t for the file sink's timerfd: a sync is due, or a
+** write is to be tried again.
+*/
+static void
+on_file_timer_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	log_stream_t *ls = data;
+	unsigned long long expirations;
+
+	if (read (fd, &expirations, sizeof (expirations)) == -1
+	 && errno == EAGAIN) return;
+	ls->file_timer_at = 0;
+	if (ls->file != NULL) write_file (ls, 0);
+}
+
+
+/**********************************************************************
+** on_source_event ()
+**
+** event_handler_t for the app pipes and fifos.
+*/
+static void
+on_source_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	log_source_t *src = data;
+	int more;
+
+	if (src->stream->zero_copy) more = splice_source (src, DRAIN_BUDGET);
+	else more = drain_source (src, DRAIN_BUDGET);
+	take_self_log (src->stream);
+	flush_log_stream (src->stream);
+	if (more) rearm_watch (loop, &src->watch);
+}
+
+
+/**********************************************************************
+** on_sink_event ()
+**
+** event_handler_t for the logger's stdin pipe.
+*/
+static void
+on_sink_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	flush_log_stream ((log_stream_t *)data);
+}
+
+
+/**********************************************************************
+** create_log_stream ()
+**
+** Set up an empty log stream on loop. The scanner is used only when
+** ls->scanning is set.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc failure
+*/
+int
+create_log_stream (log_stream_t *ls, event_loop_t *loop,
+ line_scanner_t *scanner)
+{
+	int i;
+	int status;
+
+	memset (ls, 0, sizeof (*ls));
+	ls->loop = loop;
+	ls->scanner = scanner;
+	ls->peek_pipe[READ_END] = ls->peek_pipe[WRITE_END] = -1;
+	init_event_watch (&ls->app_stdout.watch);
+	init_event_watch (&ls->app_stderr.watch);
+	for (i = 0; i < MAXSOURCES; i++)
+	{
+		init_event_watch (&ls->fifos[i].watch);
+	}
+	init_event_watch (&ls->sink);
+	init_event_watch (&ls->file_timer);
+	ls->buffer = calloc (1, sizeof (char_buffer_t));
+	if (ls->buffer == NULL) return errno;
+	status = create_char_buffer (ls->buffer, BUFFERSIZE);
+	if (status == 0) ls->buffer_size = ls->buffer->size;
+	return status;
+}
+
+
+/**********************************************************************
+** enable_zero_copy ()
+**
+** Switch the stream to splice() forwarding. After a heartbeat, the
+** sources are not peeked at for scan_window milliseconds.
+**
+** Return values:
+**   0  success
+**   *  errno from pipe2() or malloc()
+*/
+int
+enable_zero_copy (log_stream_t *ls, long long scan_window)
+{
+	if (pipe2 (ls->peek_pipe, O_NONBLOCK | O_CLOEXEC) == -1) return errno;
+	ls->peek = malloc (PEEK_SIZE);
+	if (ls->peek == NULL) return errno;
+	ls->scan_window = scan_window;
+	ls->zero_copy = 1;
+	return 0;
+}
+
+
+/**********************************************************************
+** profile_log_stream ()
+**
+** Start timing the stream's phases (PHASE_READ and so on).
+**
+** Return values:
+**   0  success
+**   *  errno from malloc failure
+*/
+int
+profile_log_stream (log_stream_t *ls)
+{
+	ls->profile = new_latency_hists (STREAM_PHASES);
+	if (ls->profile == NULL) return errno;
+	return 0;
+}
+
+
+/**********************************************************************
+** flush_log_stream ()
+**
+** Write as much of the buffer to the logger as its pipe will take
+** without blocking. If something is left over, watch the pipe for
+** EPOLLOUT so the rest goes out as soon as there is room; otherwise
+** stop watching for it. A sink being closed is closed once the buffer
+** is empty, or the log handler is gone.
+*/
+void
+flush_log_stream (log_stream_t *ls)
+{
+	ssize_t byteswritten;
+	size_t held;
+	unsigned long long started;
+	int gone = 0;
+
+	if (ls->file != NULL)
+	{
+		write_file (ls, 0);
+		return;
+	}
+	if (ls->sink.fd == -1) return;
+	started = get_char_buffer_contlen (ls->buffer) > 0 ? phase_start (ls) : 0;
+	while ((held = get_char_buffer_contlen (ls->buffer)) > 0)
+	{
+		byteswritten = write_char_buffer_to_fd (ls->buffer, ls->sink.fd);
+		PROBE (write, ls->sink.fd, byteswritten, ls->sink_pid, held);
+		if (byteswritten > 0)
+		{
+			add_count (&ls->bytes_out, byteswritten);
+			if (byteswritten < held) add_count (&ls->partial_writes, 1);
+			continue;
+		}
+		if (byteswritten == -1 && errno == EINTR) continue;
+		if (byteswritten == -1 && errno != EAGAIN && errno != EPIPE)
+		{
+			self_log_for (SELF_LOG_SYSLOG_ONLY, NULL, LOG_ERR,
+			 "Failed to write to log handler: %m");
+		}
+		/*
+		** EPIPE means the log handler is gone. The data stays in the
+		** buffer until it has been re-spawned.
+		*/
+		gone = (byteswritten == -1 && errno == EPIPE);
+		break;
+	}
+	if (started) phase_end (ls, PHASE_WRITE, started);
+	count_buffer_use (ls);
+	if (ls->sink_closing
+	 && (gone || get_char_buffer_contlen (ls->buffer) == 0))
+	{
+		detach_sink (ls);
+		return;
+	}
+	rewatch_fd (ls->loop, &ls->sink, EPOLLET
+	 | (get_char_buffer_contlen (ls->buffer) > 0 ? EPOLLOUT : 0));
+}
+
+
+/**********************************************************************
+** inject_self_log ()
+**
+** Take up the self_log messages that have come in for this stream,
+** if it is at a line boundary, and write them out.
+*/
+void
+inject_self_log (log_stream_t *ls)
+{
+	if (take_self_log (ls)) flush_log_stream (ls);
+}
+
+
+/**********************************************************************
+** attach_source ()
+**
+** Make fd non-blocking and start watching it (edge-triggered).
+**
+** Return values:
+**   0  success
+**   *  errno from fcntl() or epoll_ctl()
+*/
+int
+attach_source (log_stream_t *ls, log_source_t *src, int fd, int is_fifo)
+{
+	src->stream = ls;
+	src->is_fifo = is_fifo;
+	if (is_fifo)
+	{
+		/* the slot may have been another fifo's; start its counts over */
+		__atomic_store_n (&src->bytes_in, 0, __ATOMIC_RELAXED);
+		__atomic_store_n (&src->lines_in, 0, __ATOMIC_RELAXED);
+	}
+	if (set_nonblocking (fd) == -1) return errno;
+	return watch_fd (ls->loop, &src->watch, fd, EPOLLIN | EPOLLET,
+	 on_source_event, src);
+}
+
+
+/**********************************************************************
+** release_source ()
+**
+** Take whatever is left in a source, then stop watching it and hand
+** its fd back, still open, e.g. to attach it to another stream. What
+** was taken goes to the buffer, not straight to the sink.
+**
+** Return value:
+**   -1 if the source was not open or has reached EOF (and is closed)
+**    * the source's fd
+*/
+int
+release_source (log_source_t *src)
+{
+	int fd = src->watch.fd;
+
+	if (fd == -1) return -1;
+	drain_source (src, 0);
+	if (src->watch.fd == -1) return -1; /* drain_source() closed it */
+	unwatch_fd (src->stream->loop, &src->watch);
+	return fd;
+}
+
+
+/**********************************************************************
+** detach_source ()
+**
+** Take whatever is left in a source, then stop watching and close it.
+** What was taken goes to the buffer, not straight to the sink.
+*/
+void
+detach_source (log_source_t *src)
+{
+	int fd = release_source (src);
+
+	if (fd != -1) close (fd);
+}
+
+
+/**********************************************************************
+** attach_sink ()
+**
+** Make the logger's stdin pipe the sink, and send it whatever is
+** buffered.
+**
+** Return values:
+**   0  success
+**   *  errno from fcntl() or epoll_ctl()
+*/
+int
+attach_sink (log_stream_t *ls, int fd)
+{
+	int status;
+
+	if (set_nonblocking (fd) == -1) return errno;
+	status = watch_fd (ls->loop, &ls->sink, fd, EPOLLET,
+	 on_sink_event, ls);
+	if (status == 0) flush_log_stream (ls);
+	return status;
+}
+
+
+/**********************************************************************
+** detach_sink ()
+**
+** Stop watching and close the logger's pipe. Buffered data is kept
+** for the next sink.
+*/
+void
+detach_sink (log_stream_t *ls)
+{
+	int fd = ls->sink.fd;
+
+	ls->sink_closing = 0;
+	if (fd == -1) return;
+	unwatch_fd (ls->loop, &ls->sink);
+	close (fd);
+}
+
+
+/**********************************************************************
+** close_sink ()
+**
+** Close the logger's pipe once everything buffered has been written
+** to it; if the pipe is full now, that is up to on_sink_event().
+** Nothing is waited for, so a log handler that stops reading holds up
+** only its own stream.
+*/
+void
+close_sink (log_stream_t *ls)
+{
+	if (ls->sink.fd == -1) return;
+	ls->sink_closing = 1;
+	flush_log_stream (ls);
+}
+
+
+/**********************************************************************
+** attach_file_sink ()
+**
+** Make fs the sink, in place of a logger's pipe, and write whatever is
+** buffered to it. The stream owns fs from here on, and frees it.
+**
+** Return values:
+**   0  success
+**   *  errno from timerfd_create() or epoll_ctl()
+*/
+int
+attach_file_sink (log_stream_t *ls, file_sink_t *fs)
+{
+	int fd;
+	int status;
+
+	fd = open_timer_fd ();
+	if (fd == -1) return errno;
+	status = watch_fd (ls->loop, &ls->file_timer, fd, EPOLLIN,
+	 on_file_timer_event, ls);
+	if (status != 0)
+	{
+		close (fd);
+		return status;
+	}
+	ls->file = fs;
+	ls->file_timer_at = ls->sync_due = 0;
+	ls->file_error = 0;
+	write_file (ls, 0);
+	return 0;
+}
+
+
+/**********************************************************************
+** detach_file_sink ()
+**
+** Write out the whole lines in the buffer (with all, the unfinished
+** one too), sync the file if it is synced at all, and close and free
+** it. Whatever could not be written is kept for the next sink.
+*/
+void
+detach_file_sink (log_stream_t *ls, int all)
+{
+	file_sink_t *fs = ls->file;
+	int fd = ls->file_timer.fd;
+
+	if (fs == NULL) return;
+	write_file (ls, all);
+	if (fs->sync != FILE_SYNC_NONE)
+	{
+		note_file_status (ls, sync_file_sink (fs), "sync");
+	}
+	unwatch_fd (ls->loop, &ls->file_timer);
+	close (fd);
+	close_file_sink (fs);
+	free (fs);
+	ls->file = NULL;
+}
+
+
+/**********************************************************************
+** park_log_stream ()
+**
+** Stop watching the sources and the sink, keeping them open, so the
+** stream can be moved to another event loop with unpark_log_stream().
+*/
+void
+park_log_stream (log_stream_t *ls)
+{
+	int i;
+
+	park_watch (ls->loop, &ls->app_stdout.watch);
+	park_watch (ls->loop, &ls->app_stderr.watch);
+	for (i = 0; i < MAXSOURCES; i++)
+	{
+		park_watch (ls->loop, &ls->fifos[i].watch);
+	}
+	park_watch (ls->loop, &ls->sink);
+	park_watch (ls->loop, &ls->file_timer);
+}
+
+
+/**********************************************************************
+** unpark_log_stream ()
+**
+** Watch a parked stream's sources and sink again, on loop. Whatever
+** arrived in between is picked up right away.
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_ctl()
+*/
+int
+unpark_log_stream (log_stream_t *ls, event_loop_t *loop)
+{
+	int status;
+	int i;
+
+	ls->loop = loop;
+	if ((status = unpark_watch (loop, &ls->app_stdout.watch)) != 0
+	 || (status = unpark_watch (loop, &ls->app_stderr.watch)) != 0
+	 || (status = unpark_watch (loop, &ls->sink)) != 0
+	 || (status = unpark_watch (loop, &ls->file_timer)) != 0)
+	{ return status; }
+	for (i = 0; i < MAXSOURCES; i++)
+	{
+		status = unpark_watch (loop, &ls->fifos[i].watch);
+		if (status != 0) return status;
+	}
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _LOG_STREAM_H_ /* Brackets this whole file */
+#define _LOG_STREAM_H_
+
+#include "buffer.h"
+#include "event_loop.h"
+#include "line_scanner.h"
+#include "latency_hist.h"
+#include "file_sink.h"
+
+#define BUFFERSIZE 8192
+#define MAXSOURCES 64
+
+/* bytes peeked with tee() per pass in zero-copy mode */
+#define PEEK_SIZE 65536
+
+/* bytes moved with splice() per pass when nothing is peeked */
+#define SPLICE_SIZE (1024 * 1024)
+
+/*
+** bytes taken from one source per event; a source that always has
+** more (a log flood) then waits its turn behind the other watches
+*/
+#define DRAIN_BUDGET (256 * 1024)
+
+/* how long heartmon's own messages wait for a line to be finished */
+#define SELF_LOG_HOLD_MS 500
+
+/* how soon a write to the built-in file sink that failed is tried again */
+#define FILE_RETRY_MS 1000
+
+/* what a stream spends its time on, when profiling (-P) */
+#define PHASE_READ 0            /* read() into the buffer */
+#define PHASE_SCAN 1            /* looking for a heartbeat */
+#define PHASE_WRITE 2           /* writev() to the sink */
+#define PHASE_SPLICE 3          /* tee() and splice(), in zero-copy mode */
+#define STREAM_PHASES 4
+
+struct log_stream_struct;
+
+/* called from the source handlers when a heartbeat line is scanned */
+typedef void (*heartbeat_handler_t)(struct log_stream_struct*, void*);
+
+/*
+** One input to the log stream: the app's stdout or stderr pipe, or
+** a fifo. A fifo reads EOF whenever no writer has it open, so it is
+** kept open across EOF; a pipe is closed on EOF.
+**
+** The counts are only written by the stream's thread, and may be read
+** from any other (see count_bytes_in()). Lines are counted in what is
+** read or peeked; bytes spliced by unseen in zero-copy mode are not.
+*/
+typedef struct
+log_source_struct
+{
+	event_watch_t watch;
+	int is_fifo;
+	struct log_stream_struct *stream;
+	pid_t pid;              /* the writer, for tracing; 0 for a fifo */
+	unsigned long long bytes_in;
+	unsigned long long lines_in;
+}
+log_source_t;
+
+/*
+** Everything the event handlers need. The sources are drained into
+** the buffer as soon as they are readable, and the buffer is written
+** to the logger's stdin pipe (the sink) as far as the pipe allows.
+** EPOLLOUT is only asked for on the sink while output is pending.
+**
+** In zero-copy mode, data goes from a source pipe to the sink pipe
+** with splice() whenever the buffer is empty, and a bounded copy is
+** peeked with tee() for the scanner only while a heartbeat is still
+** wanted (scanning, and not before scan_after).
+**
+** With a file sink (file), there is no pipe: the buffer is written to
+** the file a line at a time, as soon as whole lines are in it, and
+** nothing is spliced.
+*/
+typedef struct
+log_stream_struct
+{
+	event_loop_t *loop;
+	char_buffer_t *buffer;
+	line_scanner_t *scanner;
+	int scanning;           /* scan for heartbeats as data arrives */
+	heartbeat_handler_t on_heartbeat;
+	void *heartbeat_data;
+	int zero_copy;          /* splice() sources into the sink */
+	int peek_pipe[2];       /* tee() target for the scanner's copy */
+	char *peek;             /* PEEK_SIZE bytes read from peek_pipe */
+	long long scan_window;  /* ms after a heartbeat not to peek */
+	long long scan_after;   /* monotonic ms when peeking resumes */
+	int scan_skipped;       /* bytes went by unscanned */
+	unsigned long long bytes_in; /* from all sources; see count_bytes_in() */
+	unsigned long long bytes_out;      /* to the sink */
+	unsigned long long partial_writes; /* the sink took only some */
+	unsigned long long heartbeats;     /* lines the scanner matched */
+	unsigned long long buffer_size;
+	unsigned long long buffer_held;    /* waiting for the sink just now */
+	unsigned long long buffer_hwm;     /* most ever held in the buffer */
+	latency_hist_t *profile;           /* STREAM_PHASES of them, or NULL */
+	log_source_t app_stdout;
+	log_source_t app_stderr;
+	log_source_t fifos[MAXSOURCES];
+	event_watch_t sink;
+	pid_t sink_pid;         /* the log handler, for tracing */
+	int sink_closing;       /* close the sink once the buffer is empty */
+	file_sink_t *file;      /* written instead of the sink, or NULL */
+	event_watch_t file_timer; /* timerfd for syncs and retries */
+	long long file_timer_at; /* what it is set to, or 0 */
+	long long sync_due;     /* monotonic ms the file is due a sync, or 0 */
+	int file_error;         /* errno of the last write or sync, or 0 */
+	const void *self_log_tag; /* takes self_log messages for it, or NULL */
+	unsigned long long self_log_next; /* its place among them */
+	int line_open;          /* the last byte read was not a newline */
+	long long self_log_held_at; /* monotonic ms messages began to wait */
+}
+log_stream_t;
+
+extern int create_log_stream (log_stream_t*, event_loop_t*,
+ line_scanner_t*);
+extern int enable_zero_copy (log_stream_t*, long long);
+extern int profile_log_stream (log_stream_t*);
+extern void flush_log_stream (log_stream_t*);
+extern void inject_self_log (log_stream_t*);
+extern int attach_source (log_stream_t*, log_source_t*, int, int);
+extern int release_source (log_source_t*);
+extern void detach_source (log_source_t*);
+extern int attach_sink (log_stream_t*, int);
+extern void detach_sink (log_stream_t*);
+extern void close_sink (log_stream_t*);
+extern int attach_file_sink (log_stream_t*, file_sink_t*);
+extern void detach_file_sink (log_stream_t*, int);
+extern void park_log_stream (log_stream_t*);
+extern int unpark_log_stream (log_stream_t*, event_loop_t*);
+
+#endif /* _LOG_STREAM_H_ Brackets this whole file */
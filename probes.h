@@ -0,0 +1,118 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _PROBES_H_ /* Brackets this whole file */
+#define _PROBES_H_
+
+/*
+** Static tracepoints (USDT), for perf, bpftrace or SystemTap to attach
+** to a running heartmon, e.g.
+**
+**   bpftrace -e 'usdt:./heartmon:heartmon:read { @[arg2] = sum(arg1); }'
+**
+** Every probe passes the same first four arguments:
+**
+**   arg0  fd         the fd read or written, or -1
+**   arg1  bytes      bytes read or written (-1 on error), or 0
+**   arg2  pid        the process at the other end, or 0 if not known
+**   arg3  timestamp  CLOCK_MONOTONIC nanoseconds
+**   arg4             per probe, as below
+**
+**   read       a source read, tee()d or spliced; arg4 is 0, or 1 for
+**              a splice() that went straight to the sink
+**   write      a write or splice() to the log handler's pipe; arg4 is
+**              how much was waiting to go, for a partial write
+**   heartbeat  a heartbeat line matched in what was just read from fd;
+**              bytes is what the stream has taken in so far, arg4 is 0
+**   spawn      spawn_process() started pid; fd is the pipe heartmon
+**              keeps to it, and arg4 is its argv[0]
+**   threshold  a heartbeat threshold was reached for pid; bytes is how
+**              long ago (ms) the last heartbeat was, arg4 is "warn",
+**              "crit" or "restart"
+**
+** With <sys/sdt.h> (systemtap-sdt-dev and the like) each probe is a
+** nop and an ELF note, behind a semaphore that the tracer sets while
+** it is attached, so the arguments (the clock read included) are only
+** worked out while someone is tracing. Without it, the probes compile
+** to nothing.
+*/
+
+#if defined (__has_include)
+# if __has_include (<sys/sdt.h>)
+#  define HAVE_SDT_PROBES 1
+# endif
+#endif
+
+#ifdef HAVE_SDT_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#include <time.h>
+
+/* one per probe; weak, so every file that includes this can define it */
+#define PROBE_SEMAPHORE(name) \
+	unsigned short heartmon_##name##_semaphore \
+	__attribute__ ((weak, unused, section (".probes")))
+
+PROBE_SEMAPHORE (read);
+PROBE_SEMAPHORE (write);
+PROBE_SEMAPHORE (heartbeat);
+PROBE_SEMAPHORE (spawn);
+PROBE_SEMAPHORE (threshold);
+
+static inline unsigned long long
+probe_timestamp (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define PROBE(name, fd, bytes, pid, arg4) \
+	do { \
+		if (__builtin_expect (heartmon_##name##_semaphore, 0)) \
+		{ \
+			STAP_PROBE5 (heartmon, name, (long)(fd), (long long)(bytes), \
+			 (long)(pid), probe_timestamp (), (arg4)); \
+		} \
+	} while (0)
+
+#else
+
+#define PROBE(name, fd, bytes, pid, arg4) do { } while (0)
+
+#endif /* HAVE_SDT_PROBES */
+
+#endif /* _PROBES_H_ Brackets this whole file */
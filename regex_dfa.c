@@ -0,0 +1,1008 @@
+/*
+**
+** Regular expression filters compiled to a DFA.
+**
+** Each pattern is parsed into a small syntax tree, turned into a
+** Thompson NFA, and all of them are then converted together into one
+** DFA by subset construction, ahead of time. There is no backtracking
+** and no lazy state building, so the time to scan a line is linear
+** in its length and the same for every input.
+**
+** Supported syntax (POSIX extended, matched against one line):
+**   c  .  [abc]  [^a-z]  [[:digit:]]  \d \D \w \W \s \S  \t  \c
+**   ( )  |  *  +  ?  {m}  {m,}  {m,n}  ^  $
+**
+** create_regex_dfa  (regex_dfa_t *dfa)
+** destroy_regex_dfa (regex_dfa_t *dfa)
+** add_regex_pattern (regex_dfa_t *dfa, const char *pattern, int flags)
+** compile_regex_dfa (regex_dfa_t *dfa)
+** regex_scan        (regex_dfa_t *dfa, int *state, int *flags,
+**                    int stop_mask, const char *bytes, size_t len)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "regex_dfa.h"
+
+/* NFA node types */
+#define RX_SPLIT 0  /* epsilon moves to out1 and, if set, out2 */
+#define RX_SET   1  /* one byte from set, then out1 */
+#define RX_BOL   2  /* only at the beginning of a line */
+#define RX_EOL   3  /* only at the end of a line */
+#define RX_MATCH 4  /* a pattern with these flags has matched */
+
+typedef struct
+regex_node_struct
+{
+	int type;
+	int out1;
+	int out2;
+	int flags;
+	unsigned char set[32];  /* RX_SET: bitmap of accepted bytes */
+}
+regex_node_t;
+
+/* syntax tree node types */
+#define AST_SET    0
+#define AST_BOL    1
+#define AST_EOL    2
+#define AST_EMPTY  3
+#define AST_CAT    4
+#define AST_ALT    5
+#define AST_REPEAT 6
+
+typedef struct
+regex_ast_struct
+{
+	int type;
+	int left;
+	int right;
+	int min;
+	int max;                /* -1 for no upper bound */
+	unsigned char set[32];
+}
+regex_ast_t;
+
+typedef struct
+regex_parser_struct
+{
+	const char *p;
+	regex_ast_t *ast;
+	int nast;
+	int maxast;
+	regex_dfa_t *dfa;       /* for error messages */
+}
+regex_parser_t;
+
+/* an NFA fragment; end is an RX_SPLIT whose out1 is still open */
+typedef struct
+regex_frag_struct
+{
+	int start;
+	int end;
+}
+regex_frag_t;
+
+#define SET_HAS(set, b) ((set)[(b) >> 3] & (1 << ((b) & 7)))
+#define SET_ADD(set, b) ((set)[(b) >> 3] |= (1 << ((b) & 7)))
+
+static int parse_alt (regex_parser_t*);
+
+
+/**********************************************************************
+** create_regex_dfa ()
+*/
+void
+create_regex_dfa (regex_dfa_t *dfa)
+{
+	memset (dfa, 0, sizeof (*dfa));
+	dfa->entry = -1;
+}
+
+
+/**********************************************************************
+** destroy_regex_dfa ()
+*/
+void
+destroy_regex_dfa (regex_dfa_t *dfa)
+{
+	if (dfa == NULL) return;
+	free (dfa->nodes);
+	free (dfa->next);
+	free (dfa->out);
+	free (dfa->eol_out);
+	create_regex_dfa (dfa);
+}
+
+
+/**********************************************************************
+** Parsing
+**
+** Each parse_* function returns the index of a syntax tree node, or
+** -1 after putting the reason in dfa->error.
+*/
+
+static int
+new_ast (regex_parser_t *ps, int type)
+{
+	regex_ast_t *grown;
+	int max;
+
+	if (ps->nast == ps->maxast)
+	{
+		max = ps->maxast ? ps->maxast * 2 : 32;
+		grown = realloc (ps->ast, max * sizeof (regex_ast_t));
+		if (grown == NULL)
+		{
+			snprintf (ps->dfa->error, sizeof (ps->dfa->error),
+			 "out of memory");
+			return -1;
+		}
+		ps->ast = grown;
+		ps->maxast = max;
+	}
+	memset (&ps->ast[ps->nast], 0, sizeof (regex_ast_t));
+	ps->ast[ps->nast].type = type;
+	ps->ast[ps->nast].left = ps->ast[ps->nast].right = -1;
+	return ps->nast++;
+}
+
+
+static int
+syntax_error (regex_parser_t *ps, const char *what)
+{
+	snprintf (ps->dfa->error, sizeof (ps->dfa->error), "%s", what);
+	return -1;
+}
+
+
+/*
+** Add the bytes of a \d, \w or \s style escape to set. Return 0 if c
+** is not one.
+*/
+static int
+add_escape_class (unsigned char *set, int c)
+{
+	unsigned char class[32];
+	int b, i;
+
+	if (tolower (c) != 'd' && tolower (c) != 'w' && tolower (c) != 's')
+	{ return 0; }
+	memset (class, 0, sizeof (class));
+	for (b = 0; b < 256; b++)
+	{
+		if ((tolower (c) == 'd' && isdigit (b))
+		 || (tolower (c) == 'w' && (isalnum (b) || b == '_'))
+		 || (tolower (c) == 's' && isspace (b)))
+		{ SET_ADD (class, b); }
+	}
+	for (i = 0; i < 32; i++)
+	{
+		set[i] |= isupper (c) ? (unsigned char)~class[i] : class[i];
+	}
+	return 1;
+}
+
+
+/* the byte an escape like \t or \. stands for */
+static int
+escaped_byte (int c)
+{
+	switch (c)
+	{
+		case 't': return '\t';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		default: return c;
+	}
+}
+
+
+/* [:name:] inside a bracket expression */
+static int
+add_named_class (regex_parser_t *ps, unsigned char *set)
+{
+	static const char *names[] = {
+		"alpha", "digit", "alnum", "upper", "lower", "space",
+		"xdigit", "punct", "blank", "print", "cntrl", "graph",
+	};
+	const char *close = strstr (ps->p, ":]");
+	size_t len;
+	int n, b, in;
+
+	if (close == NULL) return syntax_error (ps, "unterminated [: :]");
+	len = close - (ps->p + 2);
+	for (n = 0; n < (int)(sizeof (names) / sizeof (*names)); n++)
+	{
+		if (strlen (names[n]) == len
+		 && strncmp (ps->p + 2, names[n], len) == 0) break;
+	}
+	if (n == sizeof (names) / sizeof (*names))
+	{ return syntax_error (ps, "unknown character class"); }
+	for (b = 0; b < 256; b++)
+	{
+		switch (n)
+		{
+			case 0: in = isalpha (b); break;
+			case 1: in = isdigit (b); break;
+			case 2: in = isalnum (b); break;
+			case 3: in = isupper (b); break;
+			case 4: in = islower (b); break;
+			case 5: in = isspace (b); break;
+			case 6: in = isxdigit (b); break;
+			case 7: in = ispunct (b); break;
+			case 8: in = (b == ' ' || b == '\t'); break;
+			case 9: in = isprint (b); break;
+			case 10: in = iscntrl (b); break;
+			default: in = isgraph (b); break;
+		}
+		if (in) SET_ADD (set, b);
+	}
+	ps->p = close + 2;
+	return 0;
+}
+
+
+/* a bracket expression; ps->p is just past the '[' */
+static int
+parse_bracket (regex_parser_t *ps)
+{
+	int node, negate = 0, first = 1;
+	int lo, hi, b, i;
+	unsigned char *set;
+
+	if ((node = new_ast (ps, AST_SET)) < 0) return -1;
+	if (*ps->p == '^')
+	{
+		negate = 1;
+		ps->p++;
+	}
+	while (*ps->p != ']' || first)
+	{
+		set = ps->ast[node].set;
+		first = 0;
+		if (*ps->p == '\0')
+		{ return syntax_error (ps, "unterminated [ ]"); }
+		if (ps->p[0] == '[' && ps->p[1] == ':')
+		{
+			if (add_named_class (ps, set) != 0) return -1;
+			continue;
+		}
+		if (*ps->p == '\\' && ps->p[1] != '\0')
+		{
+			if (add_escape_class (set, (unsigned char)ps->p[1]))
+			{
+				ps->p += 2;
+				continue;
+			}
+			lo = escaped_byte ((unsigned char)ps->p[1]);
+			ps->p += 2;
+		} else {
+			lo = (unsigned char)*ps->p++;
+		}
+		hi = lo;
+		if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0')
+		{
+			ps->p++;
+			if (*ps->p == '\\' && ps->p[1] != '\0')
+			{
+				hi = escaped_byte ((unsigned char)ps->p[1]);
+				ps->p += 2;
+			} else {
+				hi = (unsigned char)*ps->p++;
+			}
+			if (hi < lo) return syntax_error (ps, "invalid range in [ ]");
+		}
+		for (b = lo; b <= hi; b++) SET_ADD (set, b);
+	}
+	ps->p++;
+	if (negate)
+	{
+		for (i = 0; i < 32; i++)
+		{
+			ps->ast[node].set[i] = ~ps->ast[node].set[i];
+		}
+	}
+	return node;
+}
+
+
+static int
+parse_atom (regex_parser_t *ps)
+{
+	int node, c;
+
+	c = (unsigned char)*ps->p++;
+	switch (c)
+	{
+		case '(':
+			if ((node = parse_alt (ps)) < 0) return -1;
+			if (*ps->p != ')') return syntax_error (ps, "unmatched (");
+			ps->p++;
+			return node;
+		case '[':
+			return parse_bracket (ps);
+		case '^':
+			return new_ast (ps, AST_BOL);
+		case '$':
+			return new_ast (ps, AST_EOL);
+		case '.':
+			if ((node = new_ast (ps, AST_SET)) < 0) return -1;
+			memset (ps->ast[node].set, 0xff, 32);
+			return node;
+		case '*': case '+': case '?': case '{':
+			return syntax_error (ps, "nothing to repeat");
+		case '\\':
+			if (*ps->p == '\0') return syntax_error (ps, "trailing \\");
+			c = (unsigned char)*ps->p++;
+			if ((node = new_ast (ps, AST_SET)) < 0) return -1;
+			if (!add_escape_class (ps->ast[node].set, c))
+			{
+				SET_ADD (ps->ast[node].set, escaped_byte (c));
+			}
+			return node;
+		default:
+			if ((node = new_ast (ps, AST_SET)) < 0) return -1;
+			SET_ADD (ps->ast[node].set, c);
+			return node;
+	}
+}
+
+
+/* a decimal count in {m,n}; -1 if there is none */
+static int
+parse_count (regex_parser_t *ps)
+{
+	int n = -1;
+
+	while (isdigit ((unsigned char)*ps->p))
+	{
+		n = (n < 0 ? 0 : n * 10) + (*ps->p++ - '0');
+		if (n > REGEX_DUP_MAX) return -2;
+	}
+	return n;
+}
+
+
+static int
+parse_repeat (regex_parser_t *ps)
+{
+	int node, rep, min, max;
+
+	if ((node = parse_atom (ps)) < 0) return -1;
+	while (*ps->p == '*' || *ps->p == '+' || *ps->p == '?'
+	 || *ps->p == '{')
+	{
+		switch (*ps->p++)
+		{
+			case '*': min = 0; max = -1; break;
+			case '+': min = 1; max = -1; break;
+			case '?': min = 0; max = 1; break;
+			default:
+				min = parse_count (ps);
+				max = min;
+				if (*ps->p == ',')
+				{
+					ps->p++;
+					max = parse_count (ps);
+				}
+				if (min < 0 || max < -1 || *ps->p != '}'
+				 || (max >= 0 && max < min))
+				{ return syntax_error (ps, "invalid {m,n}"); }
+				ps->p++;
+				break;
+		}
+		if ((rep = new_ast (ps, AST_REPEAT)) < 0) return -1;
+		ps->ast[rep].left = node;
+		ps->ast[rep].min = min;
+		ps->ast[rep].max = max;
+		node = rep;
+	}
+	return node;
+}
+
+
+static int
+parse_cat (regex_parser_t *ps)
+{
+	int node = -1, next, cat;
+
+	while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+	{
+		if ((next = parse_repeat (ps)) < 0) return -1;
+		if (node < 0)
+		{
+			node = next;
+			continue;
+		}
+		if ((cat = new_ast (ps, AST_CAT)) < 0) return -1;
+		ps->ast[cat].left = node;
+		ps->ast[cat].right = next;
+		node = cat;
+	}
+	if (node < 0) node = new_ast (ps, AST_EMPTY);
+	return node;
+}
+
+
+static int
+parse_alt (regex_parser_t *ps)
+{
+	int node, next, alt;
+
+	if ((node = parse_cat (ps)) < 0) return -1;
+	while (*ps->p == '|')
+	{
+		ps->p++;
+		if ((next = parse_cat (ps)) < 0) return -1;
+		if ((alt = new_ast (ps, AST_ALT)) < 0) return -1;
+		ps->ast[alt].left = node;
+		ps->ast[alt].right = next;
+		node = alt;
+	}
+	return node;
+}
+
+
+/**********************************************************************
+** NFA construction
+**
+** Fragments are built Thompson style. Every fragment ends in an
+** RX_SPLIT node whose out1 is patched to whatever comes next.
+*/
+
+static int
+new_node (regex_dfa_t *dfa, int type, int out1, int out2)
+{
+	regex_node_t *grown;
+	int max;
+
+	if (dfa->nnodes == REGEX_MAX_NODES)
+	{
+		snprintf (dfa->error, sizeof (dfa->error), "pattern too large");
+		return -1;
+	}
+	if (dfa->nnodes == dfa->maxnodes)
+	{
+		max = dfa->maxnodes ? dfa->maxnodes * 2 : 64;
+		grown = realloc (dfa->nodes, max * sizeof (regex_node_t));
+		if (grown == NULL)
+		{
+			snprintf (dfa->error, sizeof (dfa->error), "out of memory");
+			return -1;
+		}
+		dfa->nodes = grown;
+		dfa->maxnodes = max;
+	}
+	memset (&dfa->nodes[dfa->nnodes], 0, sizeof (regex_node_t));
+	dfa->nodes[dfa->nnodes].type = type;
+	dfa->nodes[dfa->nnodes].out1 = out1;
+	dfa->nodes[dfa->nnodes].out2 = out2;
+	return dfa->nnodes++;
+}
+
+
+/* a fragment that accepts nothing but the empty string */
+static int
+emit_empty (regex_dfa_t *dfa, regex_frag_t *frag)
+{
+	frag->start = frag->end = new_node (dfa, RX_SPLIT, -1, -1);
+	return frag->start < 0 ? -1 : 0;
+}
+
+
+/* frag, then next */
+static void
+emit_cat (regex_dfa_t *dfa, regex_frag_t *frag, regex_frag_t *next)
+{
+	dfa->nodes[frag->end].out1 = next->start;
+	frag->end = next->end;
+}
+
+
+/* frag, zero or one time, or, if loop is set, zero or more times */
+static int
+emit_optional (regex_dfa_t *dfa, regex_frag_t *frag, int loop)
+{
+	int end, split;
+
+	if ((end = new_node (dfa, RX_SPLIT, -1, -1)) < 0) return -1;
+	if ((split = new_node (dfa, RX_SPLIT, frag->start, end)) < 0) return -1;
+	dfa->nodes[frag->end].out1 = loop ? split : end;
+	frag->start = split;
+	frag->end = end;
+	return 0;
+}
+
+
+static int
+emit_ast (regex_dfa_t *dfa, regex_parser_t *ps, int node,
+ regex_frag_t *frag)
+{
+	regex_ast_t *ast = &ps->ast[node];
+	regex_frag_t left, right;
+	int i, type;
+
+	switch (ast->type)
+	{
+		case AST_SET:
+		case AST_BOL:
+		case AST_EOL:
+			if (emit_empty (dfa, frag) < 0) return -1;
+			type = ast->type == AST_SET ? RX_SET
+			 : ast->type == AST_BOL ? RX_BOL : RX_EOL;
+			if ((frag->start = new_node (dfa, type, frag->end, -1)) < 0)
+			{ return -1; }
+			memcpy (dfa->nodes[frag->start].set, ast->set, 32);
+			return 0;
+		case AST_EMPTY:
+			return emit_empty (dfa, frag);
+		case AST_CAT:
+			if (emit_ast (dfa, ps, ast->left, frag) < 0) return -1;
+			if (emit_ast (dfa, ps, ast->right, &right) < 0) return -1;
+			emit_cat (dfa, frag, &right);
+			return 0;
+		case AST_ALT:
+			if (emit_ast (dfa, ps, ast->left, &left) < 0) return -1;
+			if (emit_ast (dfa, ps, ast->right, &right) < 0) return -1;
+			if (emit_empty (dfa, frag) < 0) return -1;
+			dfa->nodes[left.end].out1 = frag->end;
+			dfa->nodes[right.end].out1 = frag->end;
+			frag->start = new_node (dfa, RX_SPLIT, left.start, right.start);
+			return frag->start < 0 ? -1 : 0;
+		default: /* AST_REPEAT: min copies, then the optional ones */
+			if (emit_empty (dfa, frag) < 0) return -1;
+			for (i = 0; i < ast->min; i++)
+			{
+				if (emit_ast (dfa, ps, ast->left, &right) < 0) return -1;
+				emit_cat (dfa, frag, &right);
+			}
+			if (ast->max < 0)
+			{
+				if (emit_ast (dfa, ps, ast->left, &right) < 0) return -1;
+				if (emit_optional (dfa, &right, 1) < 0) return -1;
+				emit_cat (dfa, frag, &right);
+			}
+			for (i = ast->min; i < ast->max; i++)
+			{
+				if (emit_ast (dfa, ps, ast->left, &right) < 0) return -1;
+				if (emit_optional (dfa, &right, 0) < 0) return -1;
+				emit_cat (dfa, frag, &right);
+			}
+			return 0;
+	}
+}
+
+
+/**********************************************************************
+** add_regex_pattern ()
+**
+** Parse pattern and add it to the NFA. A match anywhere in a line
+** reports flags.
+**
+** Return values:
+**   0       success
+**   EINVAL  syntax error, or the pattern is too large; see dfa->error
+**   ENOMEM  out of memory
+*/
+int
+add_regex_pattern (regex_dfa_t *dfa, const char *pattern, int flags)
+{
+	regex_parser_t ps;
+	regex_frag_t frag;
+	int root, match, entry;
+	int status = EINVAL;
+
+	memset (&ps, 0, sizeof (ps));
+	ps.p = pattern;
+	ps.dfa = dfa;
+	dfa->error[0] = '\0';
+	root = parse_alt (&ps);
+	if (root >= 0 && *ps.p == ')')
+	{
+		root = syntax_error (&ps, "unmatched )");
+	}
+	if (root >= 0 && emit_ast (dfa, &ps, root, &frag) == 0
+	 && (match = new_node (dfa, RX_MATCH, -1, -1)) >= 0
+	 && (entry = new_node (dfa, RX_SPLIT, frag.start, dfa->entry)) >= 0)
+	{
+		dfa->nodes[frag.end].out1 = match;
+		dfa->nodes[match].flags = flags;
+		dfa->entry = entry;
+		status = 0;
+	}
+	if (strcmp (dfa->error, "out of memory") == 0) status = ENOMEM;
+	free (ps.ast);
+	return status;
+}
+
+
+/**********************************************************************
+** Subset construction
+*/
+
+typedef struct
+regex_builder_struct
+{
+	regex_dfa_t *dfa;
+	int *stack;             /* closure work list, nnodes long */
+	int *mark;              /* closure generation per NFA node */
+	int generation;
+	int *set;               /* the set being built, sorted */
+	int nset;
+	int *pool;              /* every state's NFA node set */
+	size_t npool;
+	size_t maxpool;
+	size_t *set_at;         /* where each state's set is in pool */
+	int *set_len;
+	int *table;             /* hash of sets to state numbers */
+	int maxstates;
+}
+regex_builder_t;
+
+#define TABLE_SIZE (REGEX_MAX_STATES * 2)
+
+
+/*
+** Add the nodes reachable from the nodes in start[0..n) by epsilon
+** moves to b->set. ^ can only be passed at the beginning of a line,
+** $ only at the end; an unpassed $ stays in the set, to be passed if
+** the line ends there.
+*/
+static void
+closure (regex_builder_t *b, const int *start, int n, int at_bol,
+ int at_eol)
+{
+	regex_node_t *nodes = b->dfa->nodes;
+	int depth = 0;
+	int i, s;
+
+	b->generation++;
+	b->nset = 0;
+	for (i = 0; i < n; i++)
+	{
+		if (b->mark[start[i]] == b->generation) continue;
+		b->mark[start[i]] = b->generation;
+		b->stack[depth++] = start[i];
+	}
+	while (depth > 0)
+	{
+		s = b->stack[--depth];
+		switch (nodes[s].type)
+		{
+			case RX_SPLIT:
+				if (nodes[s].out2 >= 0
+				 && b->mark[nodes[s].out2] != b->generation)
+				{
+					b->mark[nodes[s].out2] = b->generation;
+					b->stack[depth++] = nodes[s].out2;
+				}
+				/* fall through */
+			case RX_BOL:
+			case RX_EOL:
+				if ((nodes[s].type == RX_BOL && !at_bol)
+				 || (nodes[s].type == RX_EOL && !at_eol))
+				{
+					if (nodes[s].type == RX_EOL) b->set[b->nset++] = s;
+					break;
+				}
+				if (nodes[s].out1 >= 0
+				 && b->mark[nodes[s].out1] != b->generation)
+				{
+					b->mark[nodes[s].out1] = b->generation;
+					b->stack[depth++] = nodes[s].out1;
+				}
+				break;
+			default: /* RX_SET, RX_MATCH */
+				b->set[b->nset++] = s;
+				break;
+		}
+	}
+}
+
+
+static int
+compare_ints (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+
+/* the state for b->set, added if it is new; -1 on error */
+static int
+find_state (regex_builder_t *b)
+{
+	regex_dfa_t *dfa = b->dfa;
+	unsigned int hash = 2166136261u;
+	size_t slot;
+	int i, s, nc = dfa->nclasses;
+	void *grown;
+
+	qsort (b->set, b->nset, sizeof (int), compare_ints);
+	for (i = 0; i < b->nset; i++) hash = (hash ^ b->set[i]) * 16777619u;
+	for (slot = hash % TABLE_SIZE; (s = b->table[slot]) >= 0;
+	 slot = (slot + 1) % TABLE_SIZE)
+	{
+		if (b->set_len[s] == b->nset
+		 && memcmp (b->pool + b->set_at[s], b->set,
+		 b->nset * sizeof (int)) == 0) return s;
+	}
+
+	if (dfa->nstates == REGEX_MAX_STATES)
+	{
+		snprintf (dfa->error, sizeof (dfa->error),
+		 "patterns need more than %d DFA states", REGEX_MAX_STATES);
+		return -1;
+	}
+	if (dfa->nstates == b->maxstates)
+	{
+		b->maxstates = b->maxstates ? b->maxstates * 2 : 64;
+		if ((grown = realloc (dfa->next,
+		 b->maxstates * nc * sizeof (int))) == NULL) goto nomem;
+		dfa->next = grown;
+		if ((grown = realloc (dfa->out,
+		 b->maxstates * sizeof (int))) == NULL) goto nomem;
+		dfa->out = grown;
+		if ((grown = realloc (dfa->eol_out,
+		 b->maxstates * sizeof (int))) == NULL) goto nomem;
+		dfa->eol_out = grown;
+		if ((grown = realloc (b->set_at,
+		 b->maxstates * sizeof (size_t))) == NULL) goto nomem;
+		b->set_at = grown;
+		if ((grown = realloc (b->set_len,
+		 b->maxstates * sizeof (int))) == NULL) goto nomem;
+		b->set_len = grown;
+	}
+	if (b->npool + b->nset > b->maxpool)
+	{
+		b->maxpool = (b->maxpool + b->nset) * 2;
+		if ((grown = realloc (b->pool,
+		 b->maxpool * sizeof (int))) == NULL) goto nomem;
+		b->pool = grown;
+	}
+	s = dfa->nstates++;
+	memcpy (b->pool + b->npool, b->set, b->nset * sizeof (int));
+	b->set_at[s] = b->npool;
+	b->set_len[s] = b->nset;
+	b->npool += b->nset;
+	b->table[slot] = s;
+	return s;
+
+nomem:
+	snprintf (dfa->error, sizeof (dfa->error), "out of memory");
+	return -1;
+}
+
+
+/*
+** Split the bytes into classes that every RX_SET treats alike, so
+** that the table has one column per class rather than per byte.
+*/
+static void
+make_byte_classes (regex_dfa_t *dfa)
+{
+	unsigned char refined[256];
+	int id[512];
+	int i, c, n, key;
+
+	memset (dfa->class_of, 0, sizeof (dfa->class_of));
+	dfa->nclasses = 1;
+	for (i = 0; i < dfa->nnodes; i++)
+	{
+		if (dfa->nodes[i].type != RX_SET) continue;
+		for (key = 0; key < 512; key++) id[key] = -1;
+		n = 0;
+		for (c = 0; c < 256; c++)
+		{
+			key = dfa->class_of[c] * 2
+			 + (SET_HAS (dfa->nodes[i].set, c) ? 1 : 0);
+			if (id[key] < 0) id[key] = n++;
+			refined[c] = id[key];
+		}
+		memcpy (dfa->class_of, refined, sizeof (refined));
+		dfa->nclasses = n;
+	}
+}
+
+
+/**********************************************************************
+** compile_regex_dfa ()
+**
+** Build the whole DFA for every pattern added so far. Each line is
+** searched for every pattern, as if each began with .* unless it is
+** anchored with ^.
+**
+** Return values:
+**   0       success
+**   EINVAL  too many states; see dfa->error
+**   ENOMEM  out of memory
+*/
+int
+compile_regex_dfa (regex_dfa_t *dfa)
+{
+	regex_builder_t b;
+	regex_node_t *node;
+	int rep[256];
+	int *moved = NULL;
+	int loop, any, s, c, i, n, t;
+	int status = ENOMEM;
+
+	memset (&b, 0, sizeof (b));
+	b.dfa = dfa;
+	free (dfa->next);
+	free (dfa->out);
+	free (dfa->eol_out);
+	dfa->next = dfa->out = dfa->eol_out = NULL;
+	dfa->nstates = 0;
+
+	/* the unanchored search loop: .* in front of every pattern */
+	if ((any = new_node (dfa, RX_SET, -1, -1)) < 0
+	 || (loop = new_node (dfa, RX_SPLIT, any, dfa->entry)) < 0)
+	{ return strcmp (dfa->error, "out of memory") ? EINVAL : ENOMEM; }
+	memset (dfa->nodes[any].set, 0xff, 32);
+	dfa->nodes[any].out1 = loop;
+
+	make_byte_classes (dfa);
+	for (c = 255; c >= 0; c--) rep[dfa->class_of[c]] = c;
+
+	b.stack = malloc (dfa->nnodes * sizeof (int));
+	b.mark = calloc (dfa->nnodes, sizeof (int));
+	b.set = malloc (dfa->nnodes * sizeof (int));
+	moved = malloc (dfa->nnodes * sizeof (int));
+	b.table = malloc (TABLE_SIZE * sizeof (int));
+	if (b.stack == NULL || b.mark == NULL || b.set == NULL
+	 || moved == NULL || b.table == NULL) goto end;
+	for (i = 0; i < TABLE_SIZE; i++) b.table[i] = -1;
+
+	/*
+	** The loop node is kept in the start state's set, so that no
+	** later state is mistaken for it; only there can an empty line
+	** pass both $ and ^.
+	*/
+	closure (&b, &loop, 1, 1, 0);
+	b.set[b.nset++] = loop;
+	if ((dfa->start = find_state (&b)) < 0) goto fail;
+
+	/* states are numbered in the order found, so this is breadth first */
+	for (s = 0; s < dfa->nstates; s++)
+	{
+		for (c = 0; c < dfa->nclasses; c++)
+		{
+			n = 0;
+			for (i = 0; i < b.set_len[s]; i++)
+			{
+				node = &dfa->nodes[b.pool[b.set_at[s] + i]];
+				if (node->type == RX_SET && SET_HAS (node->set, rep[c]))
+				{
+					moved[n++] = node->out1;
+				}
+			}
+			closure (&b, moved, n, 0, 0);
+			if ((t = find_state (&b)) < 0) goto fail;
+			dfa->next[s * dfa->nclasses + c] = t;
+		}
+
+		dfa->out[s] = 0;
+		n = 0;
+		for (i = 0; i < b.set_len[s]; i++)
+		{
+			node = &dfa->nodes[b.pool[b.set_at[s] + i]];
+			if (node->type == RX_MATCH) dfa->out[s] |= node->flags;
+			if (node->type == RX_EOL) moved[n++] = node->out1;
+		}
+		dfa->eol_out[s] = dfa->out[s];
+		closure (&b, moved, n, s == dfa->start, 1);
+		for (i = 0; i < b.nset; i++)
+		{
+			node = &dfa->nodes[b.set[i]];
+			if (node->type == RX_MATCH) dfa->eol_out[s] |= node->flags;
+		}
+	}
+	status = 0;
+	goto end;
+
+fail:
+	status = strcmp (dfa->error, "out of memory") ? EINVAL : ENOMEM;
+end:
+	free (b.stack);
+	free (b.mark);
+	free (b.set);
+	free (b.pool);
+	free (b.set_at);
+	free (b.set_len);
+	free (b.table);
+	free (moved);
+	free (dfa->nodes);
+	dfa->nodes = NULL;
+	dfa->nnodes = dfa->maxnodes = 0;
+	dfa->entry = -1;
+	if (status != 0)
+	{
+		free (dfa->next);
+		free (dfa->out);
+		free (dfa->eol_out);
+		dfa->next = dfa->out = dfa->eol_out = NULL;
+		dfa->nstates = 0;
+		if (status == ENOMEM) snprintf (dfa->error, sizeof (dfa->error),
+		 "out of memory");
+	}
+	return status;
+}
+
+
+/**********************************************************************
+** regex_scan ()
+**
+** Run the DFA from *state over bytes, up to but not including the
+** first newline. The flags of every match are ORed into *flags, and
+** scanning stops early once *flags has a bit of stop_mask set. At the
+** end of a line, eol_out[*state] adds the patterns anchored with $.
+**
+** Return value: the number of bytes consumed. If it is less than
+** len, bytes[returned] is either a newline or the caller's stop.
+*/
+size_t
+regex_scan (regex_dfa_t *dfa, int *state, int *flags, int stop_mask,
+ const char *bytes, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)bytes;
+	const unsigned char *end = p + len;
+	const unsigned char *class_of = dfa->class_of;
+	const int *next = dfa->next;
+	const int *out = dfa->out;
+	int nc = dfa->nclasses;
+	int s = *state;
+
+	if (next == NULL) /* nothing compiled */
+	{
+		p = memchr (p, '\n', len);
+		return p ? (const char *)p - bytes : len;
+	}
+	while (p < end && *p != '\n')
+	{
+		s = next[s * nc + class_of[*p++]];
+		if (out[s])
+		{
+			*flags |= out[s];
+			if (*flags & stop_mask) break;
+		}
+	}
+	*state = s;
+	return (const char *)p - bytes;
+}
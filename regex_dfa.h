@@ -0,0 +1,79 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _REGEX_DFA_H_ /* Brackets this whole file */
+#define _REGEX_DFA_H_
+
+#include <stddef.h>
+
+/* limits that keep compiling and scanning bounded */
+#define REGEX_MAX_STATES 4096  /* DFA states for all patterns together */
+#define REGEX_MAX_NODES 65536  /* NFA nodes, after {m,n} is expanded */
+#define REGEX_DUP_MAX 255      /* largest count in {m,n} */
+
+struct regex_node_struct;
+
+/*
+** Extended regular expressions, all compiled into one DFA. Each
+** pattern carries flags, and a state reports the flags of every
+** pattern that has matched in the line so far. The table is built
+** completely at compile time, so scanning costs one lookup per byte
+** whatever the patterns are.
+*/
+typedef struct
+regex_dfa_struct
+{
+	struct regex_node_struct *nodes; /* NFA, until compiled */
+	int nnodes;
+	int maxnodes;
+	int entry;              /* NFA node that tries every pattern */
+	unsigned char class_of[256];
+	int nclasses;
+	int nstates;
+	int start;              /* state at the beginning of a line */
+	int *next;              /* nstates * nclasses transitions */
+	int *out;               /* flags of patterns matched on entry */
+	int *eol_out;           /* out, plus patterns ending with $ */
+	char error[128];        /* why the last call failed */
+}
+regex_dfa_t;
+
+extern void create_regex_dfa (regex_dfa_t*);
+extern void destroy_regex_dfa (regex_dfa_t*);
+extern int add_regex_pattern (regex_dfa_t*, const char*, int);
+extern int compile_regex_dfa (regex_dfa_t*);
+extern size_t regex_scan (regex_dfa_t*, int*, int*, int, const char*,
+ size_t);
+
+#endif /* _REGEX_DFA_H_ Brackets this whole file */
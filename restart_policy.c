@@ -0,0 +1,137 @@
+/*
+**
+** Exponential restart backoff with jitter, and crash-loop detection.
+**
+** The caller notes when it starts a process, and asks how long to
+** wait when it exits; the wait itself is up to the caller's timers.
+**
+** default_restart_policy (restart_policy_t *policy)
+** init_restart_backoff   (restart_backoff_t *backoff, unsigned int seed)
+** note_process_start     (restart_backoff_t *backoff, long long now)
+** next_restart_delay     (const restart_policy_t *policy,
+**                         restart_backoff_t *backoff, long long now)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h> /* rand_r */
+#include <string.h>
+#include "restart_policy.h"
+
+
+/**********************************************************************
+** default_restart_policy ()
+**
+** 100ms doubling up to 30s, 10% jitter, stable after 10s, and
+** crash-looping at 5 restarts in a minute.
+*/
+void
+default_restart_policy (restart_policy_t *policy)
+{
+	policy->initial_ms = 100;
+	policy->max_ms = 30000;
+	policy->multiplier = 2.0;
+	policy->jitter_pct = 10;
+	policy->stable_ms = 10000;
+	policy->loop_restarts = 5;
+	policy->loop_window_ms = 60000;
+}
+
+
+/**********************************************************************
+** init_restart_backoff ()
+*/
+void
+init_restart_backoff (restart_backoff_t *backoff, unsigned int seed)
+{
+	memset (backoff, 0, sizeof (*backoff));
+	backoff->seed = seed;
+}
+
+
+/**********************************************************************
+** note_process_start ()
+*/
+void
+note_process_start (restart_backoff_t *backoff, long long now)
+{
+	backoff->started = now;
+}
+
+
+/**********************************************************************
+** next_restart_delay ()
+**
+** The process exited at now. Record the restart and return how many
+** milliseconds to wait before starting it again. crash_looping is
+** updated; the caller can compare it with what it was before.
+*/
+long long
+next_restart_delay (const restart_policy_t *policy,
+ restart_backoff_t *backoff, long long now)
+{
+	long long delay;
+	long long span;
+	int oldest;
+
+	backoff->restarts[backoff->nrestarts % MAX_LOOP_RESTARTS] = now;
+	backoff->nrestarts++;
+
+	if (now - backoff->started >= policy->stable_ms)
+	{
+		backoff->delay_ms = 0;
+		backoff->crash_looping = 0;
+		return 0;
+	}
+
+	if (backoff->delay_ms == 0) delay = policy->initial_ms;
+	else delay = backoff->delay_ms * policy->multiplier;
+	if (delay > policy->max_ms) delay = policy->max_ms;
+	backoff->delay_ms = delay;
+
+	if (policy->loop_restarts > 0
+	 && backoff->nrestarts >= policy->loop_restarts)
+	{
+		oldest = (backoff->nrestarts - policy->loop_restarts)
+		 % MAX_LOOP_RESTARTS;
+		if (now - backoff->restarts[oldest] <= policy->loop_window_ms)
+		{ backoff->crash_looping = 1; }
+	}
+
+	span = delay * policy->jitter_pct / 100;
+	if (span > 0)
+	{
+		delay += rand_r (&backoff->seed) % (2 * span + 1) - span;
+	}
+	return delay;
+}
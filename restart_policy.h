@@ -0,0 +1,83 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _RESTART_POLICY_H_ /* Brackets this whole file */
+#define _RESTART_POLICY_H_
+
+/* most restarts a crash-loop window can count */
+#define MAX_LOOP_RESTARTS 64
+
+/*
+** How soon a process that exited is started again. One that ran for
+** at least stable_ms is restarted at once. Each quick exit after that
+** waits initial_ms, then multiplier times as long as the last wait, up
+** to max_ms, give or take jitter_pct percent so that services which
+** failed together do not all come back in the same instant.
+**
+** A process restarted loop_restarts times within loop_window_ms is
+** crash-looping until it has run for stable_ms again.
+*/
+typedef struct
+restart_policy_struct
+{
+	long long initial_ms;
+	long long max_ms;
+	double multiplier;
+	int jitter_pct;
+	long long stable_ms;
+	int loop_restarts;
+	long long loop_window_ms;
+}
+restart_policy_t;
+
+/* where one process is in its restart policy */
+typedef struct
+restart_backoff_struct
+{
+	long long delay_ms;          /* last wait before jitter; 0 = none */
+	long long started;           /* monotonic ms of the last start */
+	long long restarts[MAX_LOOP_RESTARTS]; /* ring of restart times */
+	int nrestarts;               /* restarts recorded, ever */
+	int crash_looping;
+	unsigned int seed;           /* for rand_r() */
+}
+restart_backoff_t;
+
+extern void default_restart_policy (restart_policy_t*);
+extern void init_restart_backoff (restart_backoff_t*, unsigned int);
+extern void note_process_start (restart_backoff_t*, long long);
+extern long long next_restart_delay (const restart_policy_t*,
+ restart_backoff_t*, long long);
+
+#endif /* _RESTART_POLICY_H_ Brackets this whole file */
@@ -0,0 +1,286 @@
+/*
+**
+** Heartbeat filter microbenchmark.
+**
+** Times one core filtering a synthetic log stream, fed in
+** BUFFERSIZE reads, with the old strdup/strsep/strstr line loop and
+** with the line scanner on each candidate scan kernel this CPU
+** supports. Each is run over three logs: one where no line hits a
+** filter, so every byte has to be looked at; one where one line in
+** INCLUDE_EVERY is a heartbeat; and one where one line in
+** EXCLUDE_EVERY hits an exclude filter, as debug logging would.
+** The 9 in + 4 ex filters have too many first and last bytes to skip
+** with, so they always run on the automaton alone.
+** Prints GB/s of log data per core.
+**
+** usage: scan_bench [megabytes]
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _GNU_SOURCE /* strsep */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+#include "candidate_scan.h"
+#include "line_scanner.h"
+
+#define BUFFERSIZE 8192
+#define PASSES 3
+
+/* how often a line hits a filter, in the logs that have hits */
+#define INCLUDE_EVERY 256
+#define EXCLUDE_EVERY 8
+
+static const char *words[] = {
+	"GET", "POST", "/api/v1/items", "200", "404", "user=alice",
+	"latency_ms=12", "INFO", "WARN", "request", "completed", "session",
+	"cache", "miss", "upstream", "connection", "reset", "id=7f3a9c",
+	"bytes=5120", "worker-3", "queue", "depth=0", "retry", "ok",
+};
+
+
+/**********************************************************************
+** make_log ()
+**
+** Fill len bytes with log-like lines of 40 to 200 bytes. If hit is
+** not NULL, every nth line has it as its first word.
+*/
+static void
+make_log (char *log, size_t len, const char *hit, int every)
+{
+	unsigned int seed = 12345;
+	size_t pos = 0, end;
+	const char *word;
+	size_t n;
+	int line = 0;
+
+	while (pos < len)
+	{
+		seed = seed * 1103515245 + 12345;
+		end = pos + 40 + (seed >> 16) % 160;
+		if (end > len) end = len;
+		pos += snprintf (log + pos, end - pos, "2026-10-17T12:%02u:%02u %s",
+		 (seed >> 8) % 60, (seed >> 20) % 60,
+		 hit != NULL && ++line % every == 0 ? hit : "");
+		/* snprintf() returns what it would have written, had it fit */
+		if (pos > end - 1) pos = end - 1;
+		while (pos < end - 1)
+		{
+			seed = seed * 1103515245 + 12345;
+			word = words[(seed >> 16) % (sizeof (words) / sizeof (*words))];
+			n = strlen (word);
+			if (pos + n + 1 >= end) break;
+			memcpy (log + pos, word, n);
+			pos += n;
+			log[pos++] = ' ';
+		}
+		while (pos < end - 1) log[pos++] = '.';
+		log[pos++] = '\n';
+	}
+}
+
+
+/**********************************************************************
+** cpu_seconds ()
+*/
+static double
+cpu_seconds (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**********************************************************************
+** legacy_contains_heartbeat ()
+**
+** The line loop heartmon used to run over a NUL-terminated copy of
+** its buffer.
+*/
+static int
+legacy_contains_heartbeat (const char *bytes,
+ const char *in_filter, const char *ex_filter)
+{
+	int status = 0;
+	char *line, *content, *to_free;
+
+	content = to_free = strdup (bytes);
+	while ((line = strsep (&content, "\n")) != NULL)
+	{
+		if (*ex_filter != '\0')
+		{
+			if (strstr (line, ex_filter) != NULL)
+			{ continue; }
+		}
+		if (*in_filter != '\0')
+		{
+			if (strstr (line, in_filter) != NULL)
+			{
+				status = 1;
+				break;
+			}
+		}
+	}
+	free (to_free);
+	return status;
+}
+
+
+/**********************************************************************
+** report ()
+*/
+static void
+report (const char *what, size_t bytes, double seconds, int found)
+{
+	printf ("%-48s %8.2f GB/s  (heartbeats: %d)\n",
+	 what, bytes / seconds / 1e9, found);
+}
+
+
+/**********************************************************************
+** bench_legacy ()
+*/
+static void
+bench_legacy (const char *log, size_t len, const char *data)
+{
+	char label[64];
+	char chunk[BUFFERSIZE + 1];
+	double start;
+	size_t pos, n;
+	int pass, found = 0;
+
+	start = cpu_seconds ();
+	for (pass = 0; pass < PASSES; pass++)
+	{
+		for (pos = 0; pos < len; pos += n)
+		{
+			n = len - pos < BUFFERSIZE ? len - pos : BUFFERSIZE;
+			memcpy (chunk, log + pos, n);
+			chunk[n] = '\0';
+			found += legacy_contains_heartbeat (chunk, "HEARTBEAT", "DEBUG");
+		}
+	}
+	snprintf (label, sizeof (label), "strsep/strstr, 1 in + 1 ex, %s", data);
+	report (label, len * PASSES, cpu_seconds () - start, found);
+}
+
+
+/**********************************************************************
+** bench_scanner ()
+*/
+static void
+bench_scanner (const char *log, size_t len, const char *data,
+ const char *what, int skip, char **in_filters, int in_count,
+ char **ex_filters, int ex_count)
+{
+	line_scanner_t scanner;
+	char label[64];
+	double start;
+	size_t pos, n;
+	int pass, found = 0;
+
+	if (create_line_scanner (&scanner, in_filters, in_count,
+	 ex_filters, ex_count, 0) != 0)
+	{ err (errno, "ERROR: create_line_scanner"); }
+	if (!skip) scanner.matcher.skip.npairs = -1;
+	start = cpu_seconds ();
+	for (pass = 0; pass < PASSES; pass++)
+	{
+		for (pos = 0; pos < len; pos += n)
+		{
+			n = len - pos < BUFFERSIZE ? len - pos : BUFFERSIZE;
+			found += scan_bytes (&scanner, log + pos, n);
+		}
+	}
+	snprintf (label, sizeof (label), "%s, %s, %s",
+	 scanner.matcher.skip.npairs > 0 ? scan_kernel_name ()
+	 : "automaton only", what, data);
+	report (label, len * PASSES, cpu_seconds () - start, found);
+	destroy_line_scanner (&scanner);
+}
+
+
+int
+main (int argc, char **argv)
+{
+	char *in_one[] = { "HEARTBEAT" };
+	char *ex_one[] = { "DEBUG" };
+	char *in_many[] = { "HEARTBEAT", "heartbeat", "alive", "tick" };
+	char *ex_many[] = { "DEBUG", "TRACE" };
+	/* more first/last byte pairs than SCAN_PAIRS_MAX: no skipping */
+	char *in_lots[] = { "HEARTBEAT", "heartbeat", "alive", "tick",
+	 "pulse", "healthy", "ready", "up=1", "beat" };
+	char *ex_lots[] = { "DEBUG", "TRACE", "VERBOSE", "dump" };
+	int kernels[] = { SCAN_KERNEL_SCALAR, SCAN_KERNEL_SSE2, SCAN_KERNEL_AVX2 };
+	const char *data[3] = { "no hits", "include hits", "exclude hits" };
+	const char *hits[3] = { NULL, "HEARTBEAT ", "DEBUG " };
+	int every[3] = { 1, INCLUDE_EVERY, EXCLUDE_EVERY };
+	size_t len;
+	char *log;
+	int d, k;
+
+	len = (argc > 1 ? strtoul (argv[1], NULL, 10) : 64) * 1024 * 1024;
+	if ((log = malloc (len)) == NULL)
+	{ err (errno, "ERROR: malloc"); }
+	printf ("%zu MB of log data, %d passes, %d-byte reads\n",
+	 len / (1024 * 1024), PASSES, BUFFERSIZE);
+
+	for (d = 0; d < 3; d++)
+	{
+		make_log (log, len, hits[d], every[d]);
+		printf ("\n");
+		bench_legacy (log, len, data[d]);
+		bench_scanner (log, len, data[d], "1 in + 1 ex", 0, in_one, 1,
+		 ex_one, 1);
+		bench_scanner (log, len, data[d], "4 in + 2 ex", 0, in_many, 4,
+		 ex_many, 2);
+		bench_scanner (log, len, data[d], "9 in + 4 ex", 1, in_lots, 9,
+		 ex_lots, 4);
+		for (k = 0; k < 3; k++)
+		{
+			if (select_scan_kernel (kernels[k]) != 0) continue;
+			bench_scanner (log, len, data[d], "1 in + 1 ex", 1, in_one, 1,
+			 ex_one, 1);
+			bench_scanner (log, len, data[d], "4 in + 2 ex", 1, in_many, 4,
+			 ex_many, 2);
+		}
+	}
+	free (log);
+	return 0;
+}
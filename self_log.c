@@ -0,0 +1,427 @@
+/*
+**
+** heartmon's own messages, without ever waiting on syslog.
+**
+** A message is formatted into a preallocated ring and left there; no
+** lock is taken and nothing is allocated. Each reader keeps its own
+** place in the ring: every log stream, which injects the messages
+** meant for it into what it forwards, and a background thread, which
+** copies them to syslog at its own pace. A reader that falls a whole
+** ring behind loses the oldest messages, and is told how many.
+**
+** A slot is written like a seqlock: its seq is odd while the text is
+** copied in, and a reader that finds it changed after copying the
+** text out knows it was overwritten.
+**
+** Until open_self_log() is called, messages go straight to syslog.
+**
+** open_self_log         (const char *ident, int copy)
+** self_log_streams_ready (void)
+** add_self_log_waker    (int fd)
+** self_log              (int priority, const char *format, ...)
+** self_log_for          (const void *tag, const char *name,
+**                        int priority, const char *format, ...)
+** self_log_pending      (unsigned long long next)
+** read_self_log         (unsigned long long *next, const void *tag,
+**                        self_log_entry_t *entry,
+**                        unsigned long long *lost)
+** format_self_log_line  (self_log_entry_t *entry, char *line,
+**                        size_t size)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "self_log.h"
+
+static self_log_entry_t ring[SELF_LOG_SLOTS];
+static unsigned long long head = 0;      /* tickets handed out */
+static int opened = 0;
+static const char *log_ident = "";
+static pid_t log_pid;
+
+/* the syslog copy */
+static int copy_all = 1;
+static unsigned long long ready_at = ULLONG_MAX; /* see streams_ready */
+static unsigned long long flushed = 0;   /* next ticket to copy */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t flusher;
+static int flush_fd = -1;
+
+static int wakers[SELF_LOG_WAKERS];
+static int nwakers = 0;
+
+
+/**********************************************************************
+** wake ()
+**
+** Add one to an eventfd. EAGAIN means the counter is about to
+** overflow, when its reader is woken up anyway. Any other failure
+** cannot be reported from here without logging again, so it is not.
+*/
+static void
+wake (int fd)
+{
+	unsigned long long one = 1;
+
+	while (write (fd, &one, sizeof (one)) == -1)
+	{
+		if (errno != EINTR) break;
+	}
+}
+
+
+/**********************************************************************
+** put_entry ()
+**
+** Take the next slot, copy the message into it and wake the readers.
+*/
+static void
+put_entry (const void *tag, int skip, int priority, const char *text)
+{
+	unsigned long long ticket;
+	self_log_entry_t *entry;
+	int i;
+
+	ticket = __atomic_fetch_add (&head, 1, __ATOMIC_RELAXED);
+	entry = &ring[ticket % SELF_LOG_SLOTS];
+	__atomic_store_n (&entry->seq, 2 * ticket + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	entry->priority = priority;
+	entry->tag = tag;
+	entry->skip = skip;
+	snprintf (entry->text, sizeof (entry->text), "%s", text);
+	__atomic_store_n (&entry->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
+
+	wake (flush_fd);
+	for (i = 0; i < __atomic_load_n (&nwakers, __ATOMIC_ACQUIRE); i++)
+	{
+		wake (wakers[i]);
+	}
+}
+
+
+/**********************************************************************
+** self_log_for ()
+**
+** Log a message about the log stream tagged tag, as syslog() would
+** (%m included). In syslog, it is prefixed with "[name] " if name is
+** not NULL or empty; in the stream, it is not.
+*/
+void
+self_log_for (const void *tag, const char *name, int priority,
+ const char *format, ...)
+{
+	char text[SELF_LOG_TEXT];
+	va_list ap;
+	int skip = 0;
+
+	if (name != NULL && *name)
+	{
+		skip = snprintf (text, sizeof (text), "[%s] ", name);
+		if (skip >= sizeof (text)) skip = 0;
+	}
+	va_start (ap, format);
+	vsnprintf (text + skip, sizeof (text) - skip, format, ap);
+	va_end (ap);
+	if (!__atomic_load_n (&opened, __ATOMIC_ACQUIRE))
+	{
+		syslog (priority, "%s", text);
+		return;
+	}
+	put_entry (tag, skip, priority, text);
+}
+
+
+/**********************************************************************
+** self_log ()
+**
+** Log a message for every log stream, as syslog() would.
+*/
+void
+self_log (int priority, const char *format, ...)
+{
+	char text[SELF_LOG_TEXT];
+	va_list ap;
+
+	va_start (ap, format);
+	vsnprintf (text, sizeof (text), format, ap);
+	va_end (ap);
+	if (!__atomic_load_n (&opened, __ATOMIC_ACQUIRE))
+	{
+		syslog (priority, "%s", text);
+		return;
+	}
+	put_entry (NULL, 0, priority, text);
+}
+
+
+/**********************************************************************
+** self_log_pending ()
+**
+** Whether a reader at next has anything left to read (if perhaps not
+** for it).
+*/
+int
+self_log_pending (unsigned long long next)
+{
+	return __atomic_load_n (&head, __ATOMIC_ACQUIRE) != next;
+}
+
+
+/**********************************************************************
+** read_self_log ()
+**
+** Copy the next message from *next on into entry and move *next past
+** it. With a tag, only messages for that tag or for every stream are
+** read (and the rest skipped); without one, all of them. Messages
+** overwritten before they could be read are added to *lost.
+**
+** Return values:
+**   1  entry holds a message
+**   0  nothing more for now
+*/
+int
+read_self_log (unsigned long long *next, const void *tag,
+ self_log_entry_t *entry, unsigned long long *lost)
+{
+	self_log_entry_t *slot;
+	unsigned long long ticket, newest, seq;
+	const void *slot_tag;
+	int wanted;
+
+	while (1)
+	{
+		ticket = *next;
+		newest = __atomic_load_n (&head, __ATOMIC_ACQUIRE);
+		if (ticket == newest) return 0;
+		if (newest - ticket > SELF_LOG_SLOTS)
+		{
+			*lost += newest - SELF_LOG_SLOTS - ticket;
+			*next = newest - SELF_LOG_SLOTS;
+			continue;
+		}
+		slot = &ring[ticket % SELF_LOG_SLOTS];
+		seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq < 2 * ticket + 2) return 0; /* still being written */
+		if (seq == 2 * ticket + 2)
+		{
+			slot_tag = slot->tag;
+			wanted = (tag == NULL || slot_tag == NULL || slot_tag == tag);
+			if (wanted) memcpy (entry, slot, sizeof (*entry));
+			__atomic_thread_fence (__ATOMIC_ACQUIRE);
+			if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) == seq)
+			{
+				*next = ticket + 1;
+				if (wanted) return 1;
+				continue;
+			}
+		}
+		/* overwritten, before or while it was read */
+		(*lost)++;
+		*next = ticket + 1;
+	}
+}
+
+
+/**********************************************************************
+** format_self_log_line ()
+**
+** Write a message as a line for a log stream, e.g.
+** "heartmon[42] warning: Standby is ready.\n", cut short to fit size.
+** Returns its length.
+*/
+size_t
+format_self_log_line (self_log_entry_t *entry, char *line, size_t size)
+{
+	static const char *levels[8] = {"emerg", "alert", "crit", "err",
+	 "warning", "notice", "info", "debug"};
+	int n;
+
+	n = snprintf (line, size, "%s[%d] %s: %s", log_ident, (int)log_pid,
+	 levels[LOG_PRI (entry->priority)], entry->text + entry->skip);
+	if (n < 0) n = 0;
+	if (n > size - 2) n = size - 2;
+	line[n++] = '\n';
+	line[n] = '\0';
+	return n;
+}
+
+
+/**********************************************************************
+** copy_to_syslog ()
+**
+** Copy what has come in since the last call to syslog. Only one
+** thread at a time may call this.
+*/
+static void
+copy_to_syslog (void)
+{
+	self_log_entry_t entry;
+	unsigned long long lost = 0;
+	unsigned long long ticket;
+
+	while (read_self_log (&flushed, NULL, &entry, &lost))
+	{
+		ticket = (entry.seq - 2) / 2;
+		if (copy_all || ticket < __atomic_load_n (&ready_at, __ATOMIC_ACQUIRE)
+		 || entry.tag == SELF_LOG_SYSLOG_ONLY || entry.priority <= LOG_CRIT)
+		{ syslog (entry.priority, "%s", entry.text); }
+	}
+	if (lost) syslog (LOG_WARNING, "%llu message(s) lost.", lost);
+}
+
+
+/**********************************************************************
+** run_flusher ()
+**
+** The syslog copy's thread: sleep until there are messages, and copy
+** them out. syslog() may block here as long as it likes.
+*/
+static void *
+run_flusher (void *arg)
+{
+	unsigned long long count;
+
+	while (1)
+	{
+		if (read (flush_fd, &count, sizeof (count)) == -1
+		 && errno != EINTR)
+		{ break; }
+		pthread_mutex_lock (&flush_lock);
+		copy_to_syslog ();
+		pthread_mutex_unlock (&flush_lock);
+	}
+	return NULL;
+}
+
+
+/**********************************************************************
+** drain_at_exit ()
+**
+** atexit() handler: copy to syslog what the flusher has not, so the
+** last messages (often the reason for the exit) are not lost.
+*/
+static void
+drain_at_exit (void)
+{
+	pthread_mutex_lock (&flush_lock);
+	copy_to_syslog ();
+	pthread_mutex_unlock (&flush_lock);
+}
+
+
+/**********************************************************************
+** open_self_log ()
+**
+** Start keeping messages in the ring, and the thread that copies them
+** to syslog (already opened with openlog()). ident is what the lines
+** injected into log streams are headed with. Without copy, only
+** messages from before self_log_streams_ready(), messages of LOG_CRIT
+** or worse and those for syslog only are copied.
+**
+** Return values:
+**   0  success
+**   *  errno from eventfd() or pthread_create()
+*/
+int
+open_self_log (const char *ident, int copy)
+{
+	sigset_t all, old;
+	int status;
+
+	log_ident = ident;
+	log_pid = getpid ();
+	copy_all = copy;
+	flush_fd = eventfd (0, EFD_CLOEXEC);
+	if (flush_fd == -1) return errno;
+
+	/* signals are for the threads watching their signalfds */
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+	status = pthread_create (&flusher, NULL, run_flusher, NULL);
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+	if (status != 0)
+	{
+		close (flush_fd);
+		flush_fd = -1;
+		return status;
+	}
+	atexit (drain_at_exit);
+	__atomic_store_n (&opened, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+/**********************************************************************
+** self_log_streams_ready ()
+**
+** The log streams are running, and can take the messages from here on
+** (the ones before them went to syslog in any case).
+*/
+void
+self_log_streams_ready (void)
+{
+	__atomic_store_n (&ready_at, __atomic_load_n (&head, __ATOMIC_ACQUIRE),
+	 __ATOMIC_RELEASE);
+}
+
+
+/**********************************************************************
+** add_self_log_waker ()
+**
+** Have fd (an eventfd) written to whenever a message comes in. Call
+** this before other threads log.
+**
+** Return values:
+**   0  success
+**   *  ENOSPC: SELF_LOG_WAKERS are taken
+*/
+int
+add_self_log_waker (int fd)
+{
+	if (nwakers == SELF_LOG_WAKERS) return ENOSPC;
+	wakers[nwakers] = fd;
+	__atomic_store_n (&nwakers, nwakers + 1, __ATOMIC_RELEASE);
+	return 0;
+}
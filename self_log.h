@@ -0,0 +1,79 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _SELF_LOG_H_ /* Brackets this whole file */
+#define _SELF_LOG_H_
+
+#include <stddef.h>
+
+/* messages kept; a reader that falls this far behind loses some */
+#define SELF_LOG_SLOTS 256
+#define SELF_LOG_TEXT 480
+
+/* eventfds to wake when a message comes in (one per I/O thread) */
+#define SELF_LOG_WAKERS 256
+
+/* tag of a message for syslog only, never for a log stream */
+#define SELF_LOG_SYSLOG_ONLY ((const void*)-1)
+
+/*
+** One of heartmon's own messages. tag says which log stream it is
+** injected into: the one whose tag it is, or every stream if it is
+** NULL. The first skip bytes of text (a service name) are only for
+** syslog.
+*/
+typedef struct
+self_log_entry_struct
+{
+	unsigned long long seq;      /* 2 * ticket + 2; odd while written */
+	int priority;
+	const void *tag;
+	int skip;
+	char text[SELF_LOG_TEXT];
+}
+self_log_entry_t;
+
+extern int open_self_log (const char*, int);
+extern void self_log_streams_ready (void);
+extern int add_self_log_waker (int);
+extern void self_log (int, const char*, ...)
+ __attribute__ ((format (printf, 2, 3)));
+extern void self_log_for (const void*, const char*, int, const char*, ...)
+ __attribute__ ((format (printf, 4, 5)));
+extern int self_log_pending (unsigned long long);
+extern int read_self_log (unsigned long long*, const void*,
+ self_log_entry_t*, unsigned long long*);
+extern size_t format_self_log_line (self_log_entry_t*, char*, size_t);
+
+#endif /* _SELF_LOG_H_ Brackets this whole file */
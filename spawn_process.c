@@ -32,20 +32,262 @@
 */
 
 
-#include <unistd.h> /* pipe, pid_t, fork, exec */
-#include <stdlib.h> /* exit */
+#define _GNU_SOURCE /* pipe2 */
+#include <unistd.h> /* pipe2, vfork, execve, pid_t */
+#include <stdlib.h> /* malloc */
+#include <stdio.h> /* snprintf */
+#include <string.h>
+#include <fcntl.h> /* O_CLOEXEC */
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include "spawn_process.h"
+#include "probes.h"
+
+/* passed sockets start here, as in systemd socket activation */
+#define LISTEN_FDS_START 3
+
+
+/**********************************************************************
+** close_pipe (int*)
+** 
+** Close both ends of a pipe made by open_pipes(), if it was made.
+** errno is preserved.
+*/
+static void
+close_pipe (int *p)
+{
+	int saved = errno;
+
+	if (p == NULL || p[READ_END] == -1) return;
+	close (p[READ_END]);
+	close (p[WRITE_END]);
+	p[READ_END] = p[WRITE_END] = -1;
+	errno = saved;
+}
+
+
+/**********************************************************************
+** open_pipes (int*,int*,int*)
+** 
+** Create the requested pipes, close-on-exec, so that a child only
+** ever gets the ends it is given as stdin, stdout and stderr and not
+** those of every other service. If one fails, the ones already made
+** are closed again.
+** 
+** Return values:
+**    0 success
+**   -1 failure, errno from pipe2()
+*/
+static int
+open_pipes (int *app_stdin, int *app_stdout, int *app_stderr)
+{
+	int *p[3] = { app_stdin, app_stdout, app_stderr };
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (p[i] != NULL) p[i][READ_END] = p[i][WRITE_END] = -1;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		if (p[i] != NULL && pipe2 (p[i], O_CLOEXEC) == -1)
+		{
+			while (i-- > 0) close_pipe (p[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+** make_child_env (int)
+** 
+** Copy environ for a child, leaving out any LISTEN_* variables. With
+** nlisten sockets, add LISTEN_FDS and a LISTEN_PID entry with room
+** for the child to write its own pid into, which is returned in
+** *pid_entry. Free the result with free(); it is one allocation.
+** 
+** Return value:
+**   NULL upon failure (errno from malloc())
+**   * the environment
+*/
+static char **
+make_child_env (int nlisten, char **pid_entry)
+{
+	char **env;
+	char *strings;
+	size_t count = 0;
+	size_t i, n = 0;
+
+	for (i = 0; environ[i] != NULL; i++) count++;
+	env = malloc ((count + 3) * sizeof (char*) + 64);
+	if (env == NULL) return NULL;
+	strings = (char *)(env + count + 3);
+	for (i = 0; i < count; i++)
+	{
+		if (strncmp (environ[i], "LISTEN_", 7) == 0) continue;
+		env[n++] = environ[i];
+	}
+	*pid_entry = NULL;
+	if (nlisten > 0)
+	{
+		snprintf (strings, 32, "LISTEN_FDS=%d", nlisten);
+		env[n++] = strings;
+		strcpy (strings + 32, "LISTEN_PID=");
+		env[n++] = *pid_entry = strings + 32;
+	}
+	env[n] = NULL;
+	return env;
+}
+
+
+/**********************************************************************
+** write_pid (char*,pid_t)
+** 
+** Append pid in decimal to the string s. Only async-signal-safe code
+** may run in the vfork() child, so no snprintf().
+*/
+static void
+write_pid (char *s, pid_t pid)
+{
+	char digits[16];
+	int n = 0;
+
+	while (*s) s++;
+	do { digits[n++] = '0' + pid % 10; pid /= 10; } while (pid > 0);
+	while (n > 0) *s++ = digits[--n];
+	*s = '\0';
+}
 
 
 /**********************************************************************
-** spawn_process (int*,int*,int*,char*const*)
+** exec_child ()
+** 
+** In the vfork() child: put the pipe ends on 0, 1 and 2 and the
+** sockets on LISTEN_FDS_START onwards, give every signal its default
+** action and an empty mask, make the child the leader of its own
+** process group, so it can be signalled along with anything it
+** starts, and exec. Everything else heartmon has
+** open is close-on-exec. The child shares the parent's memory until
+** exec, so it only writes to pid_entry and *exec_errno, and on
+** failure leaves with _exit().
+** 
+** Each fd is first copied above every target, so that moving one
+** into place cannot clobber another that is still to be moved.
+*/
+static void
+exec_child (int *app_stdin, int *app_stdout, int *app_stderr,
+ const int *listen_fds, int nlisten, char *const *app_argv,
+ char **env, char *pid_entry, volatile int *exec_errno)
+{
+	int from[3 + MAXLISTEN];
+	int to[3 + MAXLISTEN];
+	int n = 0;
+	int i;
+	struct sigaction dfl;
+	sigset_t nomask;
+
+	if (app_stdin) { from[n] = app_stdin[READ_END]; to[n++] = 0; }
+	if (app_stdout) { from[n] = app_stdout[WRITE_END]; to[n++] = 1; }
+	if (app_stderr) { from[n] = app_stderr[WRITE_END]; to[n++] = 2; }
+	for (i = 0; i < nlisten; i++)
+	{
+		from[n] = listen_fds[i];
+		to[n++] = LISTEN_FDS_START + i;
+	}
+	for (i = 0; i < n; i++)
+	{
+		from[i] = fcntl (from[i], F_DUPFD_CLOEXEC, LISTEN_FDS_START + nlisten);
+		if (from[i] == -1) goto fail;
+	}
+	/* dup2() clears close-on-exec on the copies in place */
+	for (i = 0; i < n; i++)
+	{
+		if (dup2 (from[i], to[i]) == -1) goto fail;
+	}
+
+	memset (&dfl, 0, sizeof (dfl));
+	dfl.sa_handler = SIG_DFL;
+	for (i = 1; i < NSIG; i++) sigaction (i, &dfl, NULL);
+	sigemptyset (&nomask);
+	sigprocmask (SIG_SETMASK, &nomask, NULL);
+	if (setpgid (0, 0) == -1) goto fail;
+
+	if (pid_entry != NULL) write_pid (pid_entry, getpid ());
+	execve (app_argv[0], app_argv, env);
+fail:
+	*exec_errno = errno;
+	_exit (127);
+}
+
+
+/**********************************************************************
+** start_child ()
+** 
+** vfork() and exec the child with env, which the caller made and
+** frees. This is kept out of line so that the caller's env is not a
+** variable of the frame vfork() returns to twice; pid_entry is, so it
+** is volatile and the child reads it from memory.
+** 
+** Return values:
+**   Success:
+**     The pid of the child process
+**   Failure:
+**     -1
+**     Global var errno will contain the relevant error code
+**     (including that of a failed exec, whose child is reaped)
+*/
+static pid_t __attribute__ ((noinline))
+start_child (int *app_stdin, int *app_stdout, int *app_stderr,
+ const int *listen_fds, int nlisten, char *const *app_argv,
+ char **env, char *volatile pid_entry)
+{
+	volatile int exec_errno = 0;
+	sigset_t all, saved;
+	pid_t apppid;
+	int status;
+
+	/*
+	** Until it has reset them, the child must not run heartmon's
+	** signal handlers, which would act for the parent.
+	*/
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &saved);
+	apppid = vfork ();
+	if (apppid == 0)
+	{
+		exec_child (app_stdin, app_stdout, app_stderr, listen_fds, nlisten,
+		 app_argv, env, pid_entry, &exec_errno);
+	}
+	status = (apppid == -1) ? errno : exec_errno;
+	pthread_sigmask (SIG_SETMASK, &saved, NULL);
+	if (status == 0) return apppid;
+	if (apppid != -1) waitpid (apppid, NULL, 0);
+	errno = status;
+	return -1;
+}
+
+
+/**********************************************************************
+** spawn_process (int*,int*,int*,const int*,int,char*const*)
 ** 
 ** Create pipes for stdin, stdout, stderr, and store them
 ** in the int* arrays (e.g.  int app_stdout[2]).
 ** Set int* to NULL for any pipes you don't need.
 ** 
-** Fork() and exec() the application process described in the
-** char*const* array (an argv[] array for execv).
+** Pass nlisten (up to MAXLISTEN) listening sockets from listen_fds,
+** systemd style: on fds 3 onwards, with LISTEN_FDS and LISTEN_PID set
+** in the environment. LISTEN_PID has to be the child's own pid, which
+** posix_spawn() has no way to say, so this does what glibc's
+** posix_spawn() does: vfork() (CLONE_VM|CLONE_VFORK), which does not
+** copy heartmon's page tables, so its cost does not grow with
+** heartmon's size. A failed exec is reported here instead of leaving
+** a child behind.
+** 
+** The child's end of each pipe is closed here; the caller keeps the
+** other end, which is close-on-exec.
 ** 
 ** Return values:
 **   Success:
@@ -53,44 +295,48 @@
 **   Failure:
 **     -1
 **     Global var errno will contain the relevant error code
+**     (including that of a failed exec); no pipes are left open
 */
 pid_t
 spawn_process (int *app_stdin, int *app_stdout, int *app_stderr,
- char *const *app_argv)
+ const int *listen_fds, int nlisten, char *const *app_argv)
 {
+	char **env;
+	char *pid_entry;
 	pid_t apppid;
+	int status = 0;
 
-	if (app_stdin && pipe (app_stdin)) return -1;
-	if (app_stdout && pipe (app_stdout)) return -1;
-	if (app_stderr && pipe (app_stderr)) return -1;
-
-	apppid = fork ();
-	if (apppid == -1) return -1;
-	if (apppid == 0) /* child */
+	if (nlisten < 0 || nlisten > MAXLISTEN)
 	{
-		if (app_stdin)
-		{
-			dup2 (app_stdin[READ_END], 0);
-			close (app_stdin[WRITE_END]);
-		}
-		if (app_stdout)
-		{
-			dup2 (app_stdout[WRITE_END], 1);
-			close (app_stdout[READ_END]);
-		}
-		if (app_stderr)
-		{
-			dup2 (app_stderr[WRITE_END], 2);
-			close (app_stderr[READ_END]);
-		}
-
-		if (execv (app_argv[0], app_argv) == -1) return -1;
+		errno = EINVAL;
+		return -1;
+	}
+	if (open_pipes (app_stdin, app_stdout, app_stderr) == -1) return -1;
+	env = make_child_env (nlisten, &pid_entry);
+	if (env == NULL)
+	{
+		close_pipe (app_stdin);
+		close_pipe (app_stdout);
+		close_pipe (app_stderr);
+		return -1;
+	}
+	apppid = start_child (app_stdin, app_stdout, app_stderr, listen_fds,
+	 nlisten, app_argv, env, pid_entry);
+	if (apppid == -1) status = errno;
+	free (env);
 
-	} else { /* parent */
-		if (app_stdin) close (app_stdin[READ_END]);
-		if (app_stdout) close (app_stdout[WRITE_END]);
-		if (app_stderr) close (app_stderr[WRITE_END]);
+	if (app_stdin) close (app_stdin[READ_END]);
+	if (app_stdout) close (app_stdout[WRITE_END]);
+	if (app_stderr) close (app_stderr[WRITE_END]);
+	if (status != 0)
+	{
+		if (app_stdin) close (app_stdin[WRITE_END]);
+		if (app_stdout) close (app_stdout[READ_END]);
+		if (app_stderr) close (app_stderr[READ_END]);
+		errno = status;
+		return -1;
 	}
+	PROBE (spawn, app_stdin ? app_stdin[WRITE_END]
+	 : app_stdout ? app_stdout[READ_END] : -1, 0, apppid, app_argv[0]);
 	return apppid;
 }
-
@@ -38,6 +38,10 @@
 #define READ_END 0
 #define WRITE_END 1
 
-extern pid_t spawn_process (int*, int*, int*, char*const*);
+/* most listening sockets passed to one child */
+#define MAXLISTEN 64
+
+extern pid_t spawn_process (int*, int*, int*, const int*, int,
+ char*const*);
 
 #endif
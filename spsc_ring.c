@@ -0,0 +1,163 @@
+/*
+**
+** Single-producer/single-consumer ring between two threads.
+**
+** The producer fills the slot at tail and then publishes it by
+** storing tail + 1 with release ordering; the consumer reads tail
+** with acquire ordering, so it never sees a slot before its contents.
+** The same goes for head in the other direction. Neither side takes
+** a lock or waits for the other. The consumer can sleep on wake_fd in
+** its event loop; every push makes it readable.
+**
+** create_spsc_ring  (spsc_ring_t *ring, size_t capacity)
+** destroy_spsc_ring (spsc_ring_t *ring)
+** spsc_push         (spsc_ring_t *ring, void *ptr, long long value)
+** spsc_pop          (spsc_ring_t *ring, spsc_item_t *item)
+** spsc_take_dropped (spsc_ring_t *ring)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include "spsc_ring.h"
+
+
+/**********************************************************************
+** create_spsc_ring ()
+**
+** capacity must be a power of two.
+**
+** Return values:
+**   0       success
+**   EINVAL  capacity is not a power of two
+**   *       errno from malloc() or eventfd()
+*/
+int
+create_spsc_ring (spsc_ring_t *ring, size_t capacity)
+{
+	memset (ring, 0, sizeof (*ring));
+	ring->wake_fd = -1;
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0) return EINVAL;
+	ring->items = malloc (capacity * sizeof (spsc_item_t));
+	if (ring->items == NULL) return errno;
+	ring->mask = capacity - 1;
+	ring->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->wake_fd == -1) return errno;
+	return 0;
+}
+
+
+/**********************************************************************
+** destroy_spsc_ring ()
+*/
+void
+destroy_spsc_ring (spsc_ring_t *ring)
+{
+	free (ring->items);
+	ring->items = NULL;
+	if (ring->wake_fd != -1) close (ring->wake_fd);
+	ring->wake_fd = -1;
+}
+
+
+/**********************************************************************
+** spsc_push ()
+**
+** Producer side. Append an item and wake the consumer.
+**
+** Return values:
+**   0       success
+**   ENOSPC  the ring is full; the item was dropped and counted
+*/
+int
+spsc_push (spsc_ring_t *ring, void *ptr, long long value)
+{
+	size_t tail = ring->tail;
+	size_t head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+	spsc_item_t *slot;
+	uint64_t one = 1;
+
+	if (tail - head > ring->mask)
+	{
+		__atomic_add_fetch (&ring->dropped, 1, __ATOMIC_RELAXED);
+		return ENOSPC;
+	}
+	slot = &ring->items[tail & ring->mask];
+	slot->ptr = ptr;
+	slot->value = value;
+	__atomic_store_n (&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	/* can only fail when the counter is saturated: readable anyway */
+	write (ring->wake_fd, &one, sizeof (one));
+	return 0;
+}
+
+
+/**********************************************************************
+** spsc_pop ()
+**
+** Consumer side. Take the oldest item, if any.
+**
+** Return values:
+**   1  *item holds an item
+**   0  the ring is empty
+*/
+int
+spsc_pop (spsc_ring_t *ring, spsc_item_t *item)
+{
+	size_t head = ring->head;
+	size_t tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) return 0;
+	*item = ring->items[head & ring->mask];
+	__atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+
+/**********************************************************************
+** spsc_take_dropped ()
+**
+** Consumer side. Return how many items were dropped since the last
+** call.
+*/
+unsigned long
+spsc_take_dropped (spsc_ring_t *ring)
+{
+	if (__atomic_load_n (&ring->dropped, __ATOMIC_RELAXED) == 0) return 0;
+	return __atomic_exchange_n (&ring->dropped, 0, __ATOMIC_RELAXED);
+}
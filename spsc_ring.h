@@ -0,0 +1,75 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _SPSC_RING_H_ /* Brackets this whole file */
+#define _SPSC_RING_H_
+
+#include <stddef.h>
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct
+spsc_item_struct
+{
+	void *ptr;
+	long long value;
+}
+spsc_item_t;
+
+/*
+** A bounded queue from exactly one producer thread to exactly one
+** consumer thread, with no locks: each side only writes its own index.
+** The indexes sit on separate cache lines so the two threads do not
+** keep stealing one line from each other. The producer never waits;
+** when the ring is full the item is dropped and counted.
+*/
+typedef struct
+spsc_ring_struct
+{
+	spsc_item_t *items;
+	size_t mask;            /* capacity - 1 */
+	int wake_fd;            /* eventfd, readable after a push */
+	size_t head __attribute__ ((aligned (SPSC_CACHE_LINE))); /* consumer */
+	size_t tail __attribute__ ((aligned (SPSC_CACHE_LINE))); /* producer */
+	unsigned long dropped;  /* pushes refused because the ring was full */
+}
+spsc_ring_t;
+
+extern int create_spsc_ring (spsc_ring_t*, size_t);
+extern void destroy_spsc_ring (spsc_ring_t*);
+extern int spsc_push (spsc_ring_t*, void*, long long);
+extern int spsc_pop (spsc_ring_t*, spsc_item_t*);
+extern unsigned long spsc_take_dropped (spsc_ring_t*);
+
+#endif /* _SPSC_RING_H_ Brackets this whole file */
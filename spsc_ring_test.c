@@ -0,0 +1,116 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+#include <sched.h>
+#include "spsc_ring.h"
+
+#define ITEMS 200000
+
+
+/*
+** Producer thread: push 0 .. ITEMS-1, retrying while the ring is full.
+*/
+static void *
+produce (void *data)
+{
+	spsc_ring_t *ring = data;
+	long long i;
+
+	for (i = 0; i < ITEMS; i++)
+	{
+		while (spsc_push (ring, ring, i) == ENOSPC)
+		{ sched_yield (); }
+	}
+	return NULL;
+}
+
+
+int
+main ()
+{
+	spsc_ring_t ring;
+	spsc_item_t item;
+	pthread_t producer;
+	long long expect = 0;
+	long long out_of_order = 0;
+	int i;
+
+	printf ("==== #010 Capacity that is not a power of two (expect EINVAL) ====\n");
+	printf ("create_spsc_ring: %s\n",
+	 create_spsc_ring (&ring, 100) == EINVAL ? "EINVAL" : "accepted");
+	destroy_spsc_ring (&ring);
+	printf ("\n");
+
+	printf ("==== #020 Fill a ring of 4 (expect 0,0,0,0,ENOSPC, dropped 1) ====\n");
+	if (create_spsc_ring (&ring, 4) != 0)
+	{ err (errno, "ERROR: create_spsc_ring"); }
+	for (i = 0; i < 5; i++)
+	{
+		printf ("push %d: %s\n", i,
+		 spsc_push (&ring, NULL, i) == ENOSPC ? "ENOSPC" : "0");
+	}
+	printf ("dropped: %lu, then %lu\n",
+	 spsc_take_dropped (&ring), spsc_take_dropped (&ring));
+	printf ("\n");
+
+	printf ("==== #030 Pop everything (expect 0,1,2,3, then empty) ====\n");
+	while (spsc_pop (&ring, &item)) printf ("pop: %lld\n", item.value);
+	printf ("empty: %d\n", spsc_pop (&ring, &item) == 0);
+	destroy_spsc_ring (&ring);
+	printf ("\n");
+
+	printf ("==== #040 %d items across two threads (expect all in order) ====\n",
+	 ITEMS);
+	if (create_spsc_ring (&ring, 1024) != 0)
+	{ err (errno, "ERROR: create_spsc_ring"); }
+	if (pthread_create (&producer, NULL, produce, &ring) != 0)
+	{ err (EXIT_FAILURE, "ERROR: pthread_create"); }
+	while (expect < ITEMS)
+	{
+		if (!spsc_pop (&ring, &item)) continue;
+		if (item.value != expect || item.ptr != &ring) out_of_order++;
+		expect = item.value + 1;
+	}
+	pthread_join (producer, NULL);
+	printf ("received: %lld, out of order: %lld\n", expect, out_of_order);
+	destroy_spsc_ring (&ring);
+	printf ("\n");
+
+	return 0;
+}
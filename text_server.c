@@ -0,0 +1,421 @@
+/*
+**
+** A listening socket that answers every connection with a page of
+** text, such as metrics, from inside an event loop; or, if it wants a
+** request, answers the one line each client sends, such as a command.
+**
+** The text is put together when the client connects (or when its
+** request is in) and written as the socket takes it; the connection
+** is closed once it has all gone out. Nothing is ever waited for, so
+** a client that connects and never reads, or never finishes its line,
+** costs one slot (and is dropped when the slots run out) but never
+** holds up the loop.
+**
+** open_text_server  (text_server_t *server, event_loop_t *loop,
+**                    const char *path, text_render_t render,
+**                    void *data, int wants_request)
+** close_text_server (text_server_t *server)
+** text_printf       (text_out_t *out, const char *format, ...)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#define _GNU_SOURCE /* accept4 */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include "event_loop.h"
+#include "listen_socket.h"
+#include "self_log.h"
+#include "text_server.h"
+
+
+/**********************************************************************
+** text_printf ()
+**
+** Append to out, growing it as needed. If it cannot grow, out->failed
+** is set and the rest is left off.
+*/
+void
+text_printf (text_out_t *out, const char *format, ...)
+{
+	va_list ap;
+	int n;
+	size_t size;
+	char *text;
+
+	if (out->failed) return;
+	while (1)
+	{
+		va_start (ap, format);
+		n = vsnprintf (out->text + out->len, out->size - out->len, format,
+		 ap);
+		va_end (ap);
+		if (n < 0)
+		{
+			out->failed = 1;
+			return;
+		}
+		if (out->len + n < out->size) break;
+		size = out->size ? out->size * 2 : 4096;
+		while (size <= out->len + n) size *= 2;
+		text = realloc (out->text, size);
+		if (text == NULL)
+		{
+			out->failed = 1;
+			return;
+		}
+		out->text = text;
+		out->size = size;
+	}
+	out->len += n;
+}
+
+
+/**********************************************************************
+** free_dropped ()
+**
+** Free the clients drop_client() was told to keep until the batch
+** that dropped them was over.
+*/
+static void
+free_dropped (text_server_t *server)
+{
+	text_client_t *client;
+
+	while ((client = server->dropped) != NULL)
+	{
+		server->dropped = client->next;
+		free (client->out.text);
+		free (client);
+	}
+}
+
+
+/**********************************************************************
+** drop_client ()
+**
+** Forget a client and hang up on it. Whatever it sent is read first,
+** so the close does not turn into a reset that could lose what was
+** written to it.
+**
+** A client dropped from another watch's handler may still have an
+** event queued in the same batch, which the loop looks at through its
+** watch; with later, the client is only put on server->dropped, to be
+** freed by free_dropped() once that batch is over.
+*/
+static void
+drop_client (text_client_t *client, int later)
+{
+	text_server_t *server = client->server;
+	text_client_t **link;
+	char junk[256];
+	int fd = client->watch.fd;
+
+	for (link = &server->clients; *link != NULL; link = &(*link)->next)
+	{
+		if (*link != client) continue;
+		*link = client->next;
+		server->nclients--;
+		break;
+	}
+	unwatch_fd (server->loop, &client->watch);
+	while (read (fd, junk, sizeof (junk)) > 0) ;
+	close (fd);
+	if (later)
+	{
+		client->next = server->dropped;
+		server->dropped = client;
+		return;
+	}
+	free (client->out.text);
+	free (client);
+}
+
+
+/**********************************************************************
+** send_text ()
+**
+** Write as much of the text as the socket will take.
+**
+** Return values:
+**   0  there is more to send once the socket has room
+**   1  done: everything was sent, or the client has gone away
+*/
+static int
+send_text (text_client_t *client)
+{
+	ssize_t n;
+
+	while (client->sent < client->out.len)
+	{
+		n = send (client->watch.fd, client->out.text + client->sent,
+		 client->out.len - client->sent, MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			client->sent += n;
+			continue;
+		}
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1 && errno == EAGAIN) return 0;
+		return 1;
+	}
+	return 1;
+}
+
+
+/**********************************************************************
+** read_request ()
+**
+** Read what the client has sent of its request line. The line ends at
+** a newline, or where the client shut down its end or filled
+** TEXT_REQUEST_MAX; a trailing carriage return is dropped.
+**
+** Return values:
+**   0  the line is not all there yet
+**   1  client->request holds the line
+**  -1  the client has gone away
+*/
+static int
+read_request (text_client_t *client)
+{
+	char *end;
+	ssize_t n;
+
+	while (client->got < sizeof (client->request) - 1)
+	{
+		n = read (client->watch.fd, client->request + client->got,
+		 sizeof (client->request) - 1 - client->got);
+		if (n > 0)
+		{
+			end = memchr (client->request + client->got, '\n', n);
+			client->got += n;
+			if (end == NULL) continue;
+			client->got = end - client->request;
+			break;
+		}
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1 && errno == EAGAIN) return 0;
+		if (n == -1) return -1;
+		break; /* EOF */
+	}
+	if (client->got > 0 && client->request[client->got - 1] == '\r')
+	{ client->got--; }
+	client->request[client->got] = '\0';
+	return 1;
+}
+
+
+/**********************************************************************
+** serve_text ()
+**
+** Take the client as far as it will go: read its request if there is
+** to be one, render the text once it is in, and send what the socket
+** will take.
+**
+** Return values:
+**   0  waiting for the client to send or to make room
+**   1  done with it, one way or another
+*/
+static int
+serve_text (text_client_t *client)
+{
+	text_server_t *server = client->server;
+	int status;
+
+	if (!client->rendered)
+	{
+		if (server->wants_request)
+		{
+			status = read_request (client);
+			if (status == -1) return 1;
+			if (status == 0) return 0;
+		}
+		server->render (&client->out,
+		 server->wants_request ? client->request : NULL, server->data);
+		client->rendered = 1;
+	}
+	return send_text (client);
+}
+
+
+/**********************************************************************
+** on_client_event ()
+**
+** event_handler_t for a client still being served.
+*/
+static void
+on_client_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	text_client_t *client = data;
+
+	if (serve_text (client)) drop_client (client, 0);
+}
+
+
+/**********************************************************************
+** serve_client ()
+**
+** Take on a new connection and serve it as far as it goes at once;
+** the client is only kept if there is more to do.
+*/
+static void
+serve_client (text_server_t *server, int fd)
+{
+	text_client_t *client;
+	text_client_t *oldest;
+
+	client = calloc (1, sizeof (text_client_t));
+	if (client == NULL)
+	{
+		close (fd);
+		return;
+	}
+	init_event_watch (&client->watch);
+	client->server = server;
+	if (watch_fd (server->loop, &client->watch, fd, EPOLLOUT | EPOLLET
+	 | (server->wants_request ? EPOLLIN : 0), on_client_event, client) != 0)
+	{
+		self_log (LOG_WARNING, "Cannot watch a text client: %m");
+		close (fd);
+		free (client);
+		return;
+	}
+	client->next = server->clients;
+	server->clients = client;
+	server->nclients++;
+	if (serve_text (client))
+	{
+		drop_client (client, 0);
+		return;
+	}
+	if (server->nclients > TEXT_CLIENTS_MAX)
+	{
+		for (oldest = server->clients; oldest->next != NULL;
+		 oldest = oldest->next) ;
+		drop_client (oldest, 1);
+	}
+}
+
+
+/**********************************************************************
+** on_listen_event ()
+**
+** event_handler_t for the listening socket. It is watched
+** edge-triggered, so every pending connection is taken. The clients
+** dropped for new ones last time are freed first: the loop reports
+** each watch at most once per batch, so that batch is over.
+*/
+static void
+on_listen_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	text_server_t *server = data;
+	int client_fd;
+
+	free_dropped (server);
+	while (1)
+	{
+		client_fd = accept4 (fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_fd != -1)
+		{
+			serve_client (server, client_fd);
+			continue;
+		}
+		if (errno == EINTR || errno == ECONNABORTED) continue;
+		if (errno != EAGAIN) self_log (LOG_WARNING, "accept: %m");
+		break;
+	}
+}
+
+
+/**********************************************************************
+** open_text_server ()
+**
+** Listen on a unix socket at path, which only this user may connect
+** to (see open_private_socket()), and serve what render() writes,
+** called with data, to every client, on loop. With wants_request,
+** render() is given the line each client sends.
+**
+** Return values:
+**   0       success
+**   EINVAL  path is not absolute
+**   *       errno from socket(), bind(), chmod(), listen() or
+**           epoll_ctl()
+*/
+int
+open_text_server (text_server_t *server, event_loop_t *loop,
+ const char *path, text_render_t render, void *data, int wants_request)
+{
+	int fd;
+	int status;
+
+	memset (server, 0, sizeof (*server));
+	server->loop = loop;
+	server->render = render;
+	server->data = data;
+	server->wants_request = wants_request;
+	init_event_watch (&server->listen);
+	fd = open_private_socket (path);
+	if (fd == -1) return errno;
+	if (set_nonblocking (fd) == -1) status = errno;
+	else status = watch_fd (loop, &server->listen, fd, EPOLLIN | EPOLLET,
+	 on_listen_event, server);
+	if (status != 0) close (fd);
+	return status;
+}
+
+
+/**********************************************************************
+** close_text_server ()
+**
+** Stop listening and hang up on every client. Not to be called from a
+** handler on the server's loop, as the clients are freed at once.
+*/
+void
+close_text_server (text_server_t *server)
+{
+	int fd = server->listen.fd;
+
+	while (server->clients != NULL) drop_client (server->clients, 0);
+	free_dropped (server);
+	if (fd == -1) return;
+	unwatch_fd (server->loop, &server->listen);
+	close (fd);
+}
@@ -0,0 +1,106 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _TEXT_SERVER_H_ /* Brackets this whole file */
+#define _TEXT_SERVER_H_
+
+#include <stddef.h>
+#include "event_loop.h"
+
+/* clients still being written to; the oldest is dropped for a new one */
+#define TEXT_CLIENTS_MAX 16
+
+/* longest request line, newline included; the rest is cut off */
+#define TEXT_REQUEST_MAX 512
+
+/* text being put together for a client */
+typedef struct
+text_out_struct
+{
+	char *text;
+	size_t len;
+	size_t size;
+	int failed;             /* out of memory; the text is cut short */
+}
+text_out_t;
+
+/*
+** called to write out the text for each client that connects, with
+** the line it sent (no newline) if the server waits for one, or NULL
+*/
+typedef void (*text_render_t) (text_out_t*, const char*, void*);
+
+typedef struct
+text_client_struct
+{
+	event_watch_t watch;
+	text_out_t out;
+	size_t sent;
+	char request[TEXT_REQUEST_MAX];
+	size_t got;             /* bytes of request read so far */
+	int rendered;
+	struct text_server_struct *server;
+	struct text_client_struct *next;
+}
+text_client_t;
+
+/*
+** A listening socket on an event loop. Every client that connects is
+** sent what render() writes at that moment, without waiting for it to
+** say anything, and is then disconnected. A slow reader is written to
+** as it makes room, so it never holds up the loop. With wants_request,
+** render() waits instead for the client's first line (or for it to
+** shut down its end), which is read as it arrives, the same way.
+*/
+typedef struct
+text_server_struct
+{
+	event_loop_t *loop;
+	event_watch_t listen;
+	text_render_t render;
+	void *data;
+	int wants_request;
+	text_client_t *clients;  /* newest first */
+	int nclients;
+	text_client_t *dropped;  /* hung up on, not yet freed */
+}
+text_server_t;
+
+extern int open_text_server (text_server_t*, event_loop_t*, const char*,
+ text_render_t, void*, int);
+extern void close_text_server (text_server_t*);
+extern void text_printf (text_out_t*, const char*, ...)
+ __attribute__ ((format (printf, 2, 3)));
+
+#endif /* _TEXT_SERVER_H_ Brackets this whole file */
@@ -0,0 +1,543 @@
+/*
+**
+** Worker threads, each running its own event loop.
+**
+** Work is sharded by unit: everything about a unit (its fds, timers
+** and jobs) is handled on the thread of the worker that owns it, so
+** units never need locks of their own. A unit can be moved to another
+** worker: the owner parks its watches, and the new owner unparks them
+** on its own loop. Jobs posted for a unit always run on its owner.
+**
+** create_worker      (worker_t *w, int index)
+** start_worker       (worker_t *w)
+** post_worker_job    (worker_t *w, worker_job_t fn, void *arg)
+** init_worker_unit   (worker_unit_t *unit, worker_t *owner,
+**                     void (*park) (worker_unit_t*),
+**                     int (*unpark) (worker_unit_t*, event_loop_t*),
+**                     void *data)
+** worker_unit_owner  (worker_unit_t *unit)
+** post_unit_job      (worker_unit_t *unit, worker_job_t fn, void *arg)
+** move_worker_unit   (worker_unit_t *unit, worker_t *to)
+** worker_cpu_ms      (worker_t *w)
+** current_worker     (void)
+**
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+#include "self_log.h"
+#include "worker_pool.h"
+
+typedef struct
+worker_job_struct
+{
+	worker_job_t fn;
+	void *arg;
+	worker_unit_t *unit;    /* run only on this unit's owner */
+	worker_t *to;           /* where an outbox job is going */
+	struct worker_job_struct *next;
+}
+worker_job_node_t;
+
+/* a unit on its way from one worker to another */
+typedef struct
+worker_move_struct
+{
+	worker_unit_t *unit;
+	worker_t *to;
+}
+worker_move_t;
+
+/* guards every unit's owner and parked_jobs */
+static pthread_mutex_t unit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the worker running on this thread, if any */
+static __thread worker_t *this_worker = NULL;
+
+
+/**********************************************************************
+** new_job ()
+*/
+static worker_job_node_t *
+new_job (worker_job_t fn, void *arg, worker_unit_t *unit)
+{
+	worker_job_node_t *job;
+
+	job = malloc (sizeof (worker_job_node_t));
+	if (job == NULL) return NULL;
+	job->fn = fn;
+	job->arg = arg;
+	job->unit = unit;
+	job->to = NULL;
+	job->next = NULL;
+	return job;
+}
+
+
+/**********************************************************************
+** enqueue_job ()
+**
+** Append job to w's mailbox and wake w up.
+*/
+static void
+enqueue_job (worker_t *w, worker_job_node_t *job)
+{
+	uint64_t one = 1;
+
+	job->next = NULL;
+	pthread_mutex_lock (&w->lock);
+	if (w->last_job) w->last_job->next = job;
+	else w->jobs = job;
+	w->last_job = job;
+	pthread_mutex_unlock (&w->lock);
+	if (write (w->mailbox.fd, &one, sizeof (one)) == -1 && errno != EAGAIN)
+	{
+		self_log (LOG_ERR, "Failed to wake worker %d: %m", w->index);
+	}
+}
+
+
+/**********************************************************************
+** dispatch_unit_job ()
+**
+** Hand job to its unit's owner, or keep it with the unit while the
+** unit has none. Called with unit_lock held.
+*/
+static void
+dispatch_unit_job (worker_unit_t *unit, worker_job_node_t *job)
+{
+	worker_job_node_t **tail;
+
+	if (unit->owner)
+	{
+		enqueue_job (unit->owner, job);
+		return;
+	}
+	job->next = NULL;
+	for (tail = &unit->parked_jobs; *tail; tail = &(*tail)->next)
+	{ ; }
+	*tail = job;
+}
+
+
+/**********************************************************************
+** on_mailbox_event ()
+**
+** event_handler_t for a worker's eventfd. Run every job posted so far,
+** in order. A unit job that arrives after its unit has left goes on
+** after it.
+*/
+static void
+on_mailbox_event (event_loop_t *loop, int fd, unsigned int events,
+ void *data)
+{
+	worker_t *w = data;
+	worker_job_node_t *job, *next;
+	uint64_t count;
+	int mine;
+
+	while (read (fd, &count, sizeof (count)) == sizeof (count))
+	{ ; }
+
+	pthread_mutex_lock (&w->lock);
+	job = w->jobs;
+	w->jobs = w->last_job = NULL;
+	pthread_mutex_unlock (&w->lock);
+
+	for (; job; job = next)
+	{
+		next = job->next;
+		if (job->unit)
+		{
+			/* only this thread can take the unit away from itself */
+			pthread_mutex_lock (&unit_lock);
+			mine = (job->unit->owner == w);
+			if (!mine) dispatch_unit_job (job->unit, job);
+			pthread_mutex_unlock (&unit_lock);
+			if (!mine) continue;
+		}
+		job->fn (w, job->arg);
+		free (job);
+	}
+}
+
+
+/**********************************************************************
+** send_outbox ()
+**
+** Send the jobs w put aside while it was dispatching events.
+*/
+static void
+send_outbox (worker_t *w)
+{
+	worker_job_node_t *job, *next;
+
+	for (job = w->outbox, w->outbox = NULL; job; job = next)
+	{
+		next = job->next;
+		enqueue_job (job->to, job);
+	}
+}
+
+
+/**********************************************************************
+** link_unit ()
+**
+** Put a unit on w's list of the units it owns.
+*/
+static void
+link_unit (worker_t *w, worker_unit_t *unit)
+{
+	unit->prev_owned = NULL;
+	unit->next_owned = w->units;
+	if (w->units != NULL) w->units->prev_owned = unit;
+	w->units = unit;
+}
+
+
+/**********************************************************************
+** unlink_unit ()
+*/
+static void
+unlink_unit (worker_t *w, worker_unit_t *unit)
+{
+	if (unit->prev_owned != NULL)
+	{
+		unit->prev_owned->next_owned = unit->next_owned;
+	}
+	else w->units = unit->next_owned;
+	if (unit->next_owned != NULL)
+	{
+		unit->next_owned->prev_owned = unit->prev_owned;
+	}
+	unit->prev_owned = unit->next_owned = NULL;
+}
+
+
+/**********************************************************************
+** adopt_unit ()
+**
+** worker_job_t that makes w the owner of a unit in transit, and takes
+** on the jobs that were posted for it on the way.
+*/
+static void
+adopt_unit (worker_t *w, void *arg)
+{
+	worker_move_t *move = arg;
+	worker_unit_t *unit = move->unit;
+	worker_job_node_t *job, *next;
+	int status;
+
+	free (move);
+	status = unit->unpark (unit, &w->loop);
+	if (status != 0)
+	{
+		errno = status;
+		self_log (LOG_ERR, "Worker %d failed to watch a moved unit: %m",
+		 w->index);
+	}
+	link_unit (w, unit);
+	pthread_mutex_lock (&unit_lock);
+	unit->owner = w;
+	job = unit->parked_jobs;
+	unit->parked_jobs = NULL;
+	for (; job; job = next)
+	{
+		next = job->next;
+		enqueue_job (w, job);
+	}
+	pthread_mutex_unlock (&unit_lock);
+}
+
+
+/**********************************************************************
+** release_unit ()
+**
+** worker_job_t, run by a unit's owner, that parks the unit and sends
+** it on. Events for it may still be queued in the current batch; the
+** parked watches drop them, and the new owner only gets the unit once
+** the batch is over.
+*/
+static void
+release_unit (worker_t *w, void *arg)
+{
+	worker_move_t *move = arg;
+	worker_unit_t *unit = move->unit;
+	worker_job_node_t *job;
+
+	if (move->to == w)
+	{
+		free (move);
+		return;
+	}
+	job = new_job (adopt_unit, move, NULL);
+	if (job == NULL)
+	{
+		self_log (LOG_ERR, "Worker %d cannot move a unit: %m", w->index);
+		free (move);
+		return;
+	}
+	unit->park (unit);
+	unlink_unit (w, unit);
+	pthread_mutex_lock (&unit_lock);
+	unit->owner = NULL;
+	pthread_mutex_unlock (&unit_lock);
+	job->to = move->to;
+	job->next = w->outbox;
+	w->outbox = job;
+}
+
+
+/**********************************************************************
+** run_worker ()
+**
+** Thread body: run the loop forever.
+*/
+static void *
+run_worker (void *data)
+{
+	worker_t *w = data;
+
+	this_worker = w;
+	while (1)
+	{
+		if (run_event_loop_once (&w->loop, -1) == -1)
+		{
+			self_log (LOG_ERR, "Worker %d event loop failed: %m", w->index);
+		}
+		send_outbox (w);
+	}
+	return NULL;
+}
+
+
+/**********************************************************************
+** create_worker ()
+**
+** Set up a worker's loop, mailbox and events ring. Units can be given
+** to it, and their fds watched on w->loop, before its thread is
+** started.
+**
+** Return values:
+**   0  success
+**   *  errno from epoll_create1(), eventfd(), malloc() or epoll_ctl()
+*/
+int
+create_worker (worker_t *w, int index)
+{
+	int fd;
+	int status;
+
+	memset (w, 0, sizeof (*w));
+	w->index = index;
+	init_event_watch (&w->mailbox);
+	init_event_watch (&w->events_watch);
+	pthread_mutex_init (&w->lock, NULL);
+	if ((status = create_event_loop (&w->loop)) != 0) return status;
+	if ((status = create_spsc_ring (&w->events, WORKER_EVENTS)) != 0)
+	{ return status; }
+	fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd == -1) return errno;
+	return watch_fd (&w->loop, &w->mailbox, fd, EPOLLIN,
+	 on_mailbox_event, w);
+}
+
+
+/**********************************************************************
+** start_worker ()
+**
+** Start the worker's thread. It runs with every signal blocked, so
+** signals are left to the thread that started it.
+**
+** Return values:
+**   0  success
+**   *  error number from pthread_create()
+*/
+int
+start_worker (worker_t *w)
+{
+	sigset_t all, old;
+	int status;
+
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+	status = pthread_create (&w->thread, NULL, run_worker, w);
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+	if (status != 0) return status;
+	if (pthread_getcpuclockid (w->thread, &w->cpu_clock) == 0)
+	{ w->started = 1; }
+	return 0;
+}
+
+
+/**********************************************************************
+** post_worker_job ()
+**
+** Have w run fn (w, arg) on its own thread. Safe from any thread.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc()
+*/
+int
+post_worker_job (worker_t *w, worker_job_t fn, void *arg)
+{
+	worker_job_node_t *job;
+
+	if ((job = new_job (fn, arg, NULL)) == NULL) return errno;
+	enqueue_job (w, job);
+	return 0;
+}
+
+
+/**********************************************************************
+** init_worker_unit ()
+**
+** Give a unit to its first owner, before the owner's thread is
+** started. park stops watching the unit's fds on its owner's loop;
+** unpark watches them on the loop given.
+*/
+void
+init_worker_unit (worker_unit_t *unit, worker_t *owner,
+ void (*park) (worker_unit_t*),
+ int (*unpark) (worker_unit_t*, event_loop_t*), void *data)
+{
+	unit->owner = owner;
+	link_unit (owner, unit);
+	unit->parked_jobs = NULL;
+	unit->park = park;
+	unit->unpark = unpark;
+	unit->data = data;
+}
+
+
+/**********************************************************************
+** worker_unit_owner ()
+**
+** The unit's owner, or NULL while it is moving. Only the answer
+** "this thread's worker" stays true after the lock is dropped.
+*/
+worker_t *
+worker_unit_owner (worker_unit_t *unit)
+{
+	worker_t *owner;
+
+	pthread_mutex_lock (&unit_lock);
+	owner = unit->owner;
+	pthread_mutex_unlock (&unit_lock);
+	return owner;
+}
+
+
+/**********************************************************************
+** post_unit_job ()
+**
+** Have the unit's owner run fn (owner, arg), even if the unit moves
+** before it gets there. Jobs for one unit run in the order posted
+** from any one thread. Safe from any thread.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc()
+*/
+int
+post_unit_job (worker_unit_t *unit, worker_job_t fn, void *arg)
+{
+	worker_job_node_t *job;
+
+	if ((job = new_job (fn, arg, unit)) == NULL) return errno;
+	pthread_mutex_lock (&unit_lock);
+	dispatch_unit_job (unit, job);
+	pthread_mutex_unlock (&unit_lock);
+	return 0;
+}
+
+
+/**********************************************************************
+** move_worker_unit ()
+**
+** Ask the unit's owner to hand it over to worker to.
+**
+** Return values:
+**   0  success
+**   *  errno from malloc()
+*/
+int
+move_worker_unit (worker_unit_t *unit, worker_t *to)
+{
+	worker_move_t *move;
+	int status;
+
+	if ((move = malloc (sizeof (worker_move_t))) == NULL) return errno;
+	move->unit = unit;
+	move->to = to;
+	status = post_unit_job (unit, release_unit, move);
+	if (status != 0) free (move);
+	return status;
+}
+
+
+/**********************************************************************
+** worker_cpu_ms ()
+**
+** CPU time the worker's thread has used, in milliseconds.
+*/
+long long
+worker_cpu_ms (worker_t *w)
+{
+	struct timespec ts;
+
+	if (!w->started || clock_gettime (w->cpu_clock, &ts) != 0) return 0;
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**********************************************************************
+** current_worker ()
+**
+** The worker whose thread this is, or NULL on any other thread.
+*/
+worker_t *
+current_worker (void)
+{
+	return this_worker;
+}
@@ -0,0 +1,111 @@
+/*
+** Copyright (c) 2016, Kris Feldmann
+** All rights reserved.
+** 
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+** 
+**   1. Redistributions of source code must retain the above copyright
+**      notice, this list of conditions and the following disclaimer.
+** 
+**   2. Redistributions in binary form must reproduce the above
+**      copyright notice, this list of conditions and the following
+**      disclaimer in the documentation and/or other materials provided
+**      with the distribution.
+** 
+**   3. Neither the name of the copyright holder nor the names of its
+**      contributors may be used to endorse or promote products derived
+**      from this software without specific prior written permission.
+** 
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+** TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+** PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+** OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+** EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+** PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+** NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _WORKER_POOL_H_ /* Brackets this whole file */
+#define _WORKER_POOL_H_
+
+#include <pthread.h>
+#include <time.h>
+#include "event_loop.h"
+#include "spsc_ring.h"
+
+/* slots in a worker's events ring */
+#define WORKER_EVENTS 4096
+
+struct worker_struct;
+struct worker_job_struct;
+
+typedef void (*worker_job_t) (struct worker_struct*, void*);
+
+/*
+** Something a worker owns, such as a service: its fds are watched on
+** the owner's loop and its jobs run on the owner's thread. While it
+** moves between workers it has no owner, and jobs posted for it wait
+** in parked_jobs until the new owner has it. The owner also keeps it
+** in its list of units, which only the owner's thread touches.
+*/
+typedef struct
+worker_unit_struct
+{
+	struct worker_struct *owner;     /* NULL while moving */
+	struct worker_unit_struct *prev_owned;
+	struct worker_unit_struct *next_owned;
+	struct worker_job_struct *parked_jobs;
+	void (*park) (struct worker_unit_struct*);
+	int (*unpark) (struct worker_unit_struct*, event_loop_t*);
+	void *data;
+}
+worker_unit_t;
+
+/*
+** A thread running its own event loop. Other threads hand it work
+** through a mailbox (an eventfd on the loop). A unit handed to
+** another worker is only sent on once the batch of events being
+** dispatched is done, so no stale event for it can still run here.
+**
+** Going the other way, a worker reports to the thread that started it
+** through its events ring, which it never has to wait on.
+*/
+typedef struct
+worker_struct
+{
+	int index;
+	pthread_t thread;
+	int started;
+	event_loop_t loop;
+	event_watch_t mailbox;
+	pthread_mutex_t lock;            /* guards jobs */
+	struct worker_job_struct *jobs;
+	struct worker_job_struct *last_job;
+	struct worker_job_struct *outbox; /* sent after each batch */
+	worker_unit_t *units;            /* owned; this thread's alone */
+	clockid_t cpu_clock;
+	spsc_ring_t events;              /* this worker -> its starter */
+	event_watch_t events_watch;      /* for the starter's loop */
+}
+worker_t;
+
+extern int create_worker (worker_t*, int);
+extern int start_worker (worker_t*);
+extern int post_worker_job (worker_t*, worker_job_t, void*);
+extern void init_worker_unit (worker_unit_t*, worker_t*,
+ void (*) (worker_unit_t*), int (*) (worker_unit_t*, event_loop_t*),
+ void*);
+extern worker_t *worker_unit_owner (worker_unit_t*);
+extern int post_unit_job (worker_unit_t*, worker_job_t, void*);
+extern int move_worker_unit (worker_unit_t*, worker_t*);
+extern long long worker_cpu_ms (worker_t*);
+extern worker_t *current_worker (void);
+
+#endif /* _WORKER_POOL_H_ Brackets this whole file */